@@ -1,10 +1,19 @@
 #pragma once
 
+#include <mpi.h>
 #include <particle_structure.hpp>
+#include <Kokkos_UnorderedMap.hpp>
+#include <ppTiming.hpp>
 namespace pumipic {
+
+  void enable_prebarrier();
+  double prebarrier();
+
   template <class DataTypes, typename MemSpace = DefaultMemSpace>
   class CSR : public ParticleStructure<DataTypes, MemSpace> {
   public:
+    template <typename MSpace> using Mirror = CSR<DataTypes, MSpace>;
+    using typename ParticleStructure<DataTypes, MemSpace>::Types;
     using typename ParticleStructure<DataTypes, MemSpace>::execution_space;
     using typename ParticleStructure<DataTypes, MemSpace>::memory_space;
     using typename ParticleStructure<DataTypes, MemSpace>::device_type;
@@ -14,37 +23,75 @@ namespace pumipic {
     using typename ParticleStructure<DataTypes, MemSpace>::kkGidHostMirror;
     using typename ParticleStructure<DataTypes, MemSpace>::MTVs;
 
-    CSR() = delete;
+    typedef Kokkos::TeamPolicy<execution_space> PolicyType;
+    typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
+
     CSR(const CSR&) = delete;
     CSR& operator=(const CSR&) = delete;
 
+    /* Constructor of CSR as particle structure
+      num_elements - the number of elements in the mesh
+      num_particles - the number of particles needed
+      particles_per_element - the number of particles in each element
+      element_gids - (for MPI parallelism) global ids for each element (size 0 is ignored)
+      particle_elements - parent element for each particle (optional)
+      particle_info - Initial values for the particle information (optional)
+    */
     CSR(lid_t num_elements, lid_t num_particles, kkLidView particles_per_element,
         kkGidView element_gids, kkLidView particle_elements = kkLidView(),
         MTVs particle_info = NULL);
     ~CSR();
 
+    template <class MSpace>
+    Mirror<MSpace>* copy();
+
     //Functions from ParticleStructure
     using ParticleStructure<DataTypes, MemSpace>::nElems;
     using ParticleStructure<DataTypes, MemSpace>::nPtcls;
     using ParticleStructure<DataTypes, MemSpace>::capacity;
     using ParticleStructure<DataTypes, MemSpace>::numRows;
+    using ParticleStructure<DataTypes, MemSpace>::copy;
 
-
+    /* Migrates each particle to new_process and to new_element
+       Calls rebuild to recreate the CSR after migrating particles
+       new_element - array sized csr->capacity with the new element for each particle
+       new_process - array sized csr->capacity with the new process for each particle
+    */
     void migrate(kkLidView new_element, kkLidView new_process,
                  Distributor<MemSpace> dist = Distributor<MemSpace>(),
                  kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particle_info = NULL);
 
+    /*
+      Rebuilds the CSR where particles move to the element in new_element[i]
+      new_element - array sized csr->capacity with the new element for each particle
+        Optional arguments when adding new particles to the structure
+        new_particle_elements - the new element for each new particle
+        new_particles - the data for the new particles
+    */
     void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                  MTVs new_particles = NULL);
 
+    /*
+      Performs a parallel for over the elements/particles in the CSR
+      The passed in functor/lambda should take in 3 arguments (int elm_id, int ptcl_id, bool mask)
+      Note: the CSR is packed so mask is always true
+    */
     template <typename FunctionType>
     void parallel_for(FunctionType& fn, std::string s="");
 
+    //Prints metrics of the CSR
     void printMetrics() const;
 
+    //Do not call these functions:
+    void createGlobalMapping(kkGidView elmGid, kkGidView& elm2Gid, GID_Mapping& elmGid2Lid);
+    void constructOffsets(kkLidView ptcls_per_elem, kkLidView& offs, lid_t& cap);
+    void initCSRData(kkLidView particle_elements, MTVs particle_info);
+
+    template <typename DT, typename MSpace> friend class CSR;
   private:
     //Variables from ParticleStructure
+    using ParticleStructure<DataTypes, MemSpace>::name;
     using ParticleStructure<DataTypes, MemSpace>::num_elems;
     using ParticleStructure<DataTypes, MemSpace>::num_ptcls;
     using ParticleStructure<DataTypes, MemSpace>::capacity_;
@@ -53,7 +100,21 @@ namespace pumipic {
     using ParticleStructure<DataTypes, MemSpace>::num_types;
 
     //Offsets array into CSR
+    // particles of element e are stored in [offsets(e), offsets(e+1))
     kkLidView offsets;
+
+    //mappings from element to element gid and back to element
+    kkGidView element_to_gid;
+    GID_Mapping element_gid_to_lid;
+
+    //Swap space used during rebuild
+    MTVs ptcl_data_swap;
+    std::size_t current_size, swap_size;
+
+    //Padding of the allocations beyond capacity
+    double extra_padding;
+
+    CSR() : ParticleStructure<DataTypes, MemSpace>() {}
   };
 
   template <class DataTypes, typename MemSpace>
@@ -61,39 +122,172 @@ namespace pumipic {
                                 kkLidView particles_per_element,
                                 kkGidView element_gids,
                                 kkLidView particle_elements,
-                                MTVs particle_info) {
-    fprintf(stderr, "[WARNING] CSR constructor not implemented\n");
+                                MTVs particle_info) :
+    ParticleStructure<DataTypes, MemSpace>(), element_gid_to_lid(num_elements) {
+    Kokkos::Profiling::pushRegion("csr_construction");
+    num_elems = num_elements;
+    num_rows = num_elems;
+    num_ptcls = num_particles;
+    extra_padding = 0.1;
+
+    int comm_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+    if(!comm_rank)
+      fprintf(stderr, "Building CSR\n");
+
+    if (element_gids.size() > 0) {
+      createGlobalMapping(element_gids, element_to_gid, element_gid_to_lid);
+    }
+
+    //Create offsets into each element
+    constructOffsets(particles_per_element, offsets, capacity_);
+
+    //Allocate the CSR and backup with extra space
+    lid_t cap = capacity_;
+    if (extra_padding > 0)
+      cap *= (1 + extra_padding);
+    CreateViews<device_type, DataTypes>(ptcl_data, cap);
+    CreateViews<device_type, DataTypes>(ptcl_data_swap, cap);
+    swap_size = current_size = cap;
+
+    //If particle info is provided then enter the information
+    lid_t given_particles = particle_elements.size();
+    if (given_particles > 0 && particle_info != NULL) {
+      initCSRData(particle_elements, particle_info);
+    }
+    Kokkos::Profiling::popRegion();
   }
 
   template <class DataTypes, typename MemSpace>
   CSR<DataTypes, MemSpace>::~CSR() {
-    fprintf(stderr, "[WARNING] CSR deconstructor not implemented\n");
+    destroyViews<DataTypes, memory_space>(ptcl_data);
+    destroyViews<DataTypes, memory_space>(ptcl_data_swap);
   }
 
   template <class DataTypes, typename MemSpace>
-  void CSR<DataTypes, MemSpace>::migrate(kkLidView new_element, kkLidView new_process,
-                                         Distributor<MemSpace> dist,
-                                         kkLidView new_particle_elements,
-                                         MTVs new_particle_info) {
-    fprintf(stderr, "[WARNING] CSR migrate(...) not implemented\n");
+  template <class MSpace>
+  typename CSR<DataTypes, MemSpace>::template Mirror<MSpace>* CSR<DataTypes, MemSpace>::copy() {
+    Mirror<MSpace>* mirror_copy = new CSR<DataTypes, MSpace>();
+    //Call Particle structures copy
+    mirror_copy->copy(this);
+    //Copy constants
+    mirror_copy->current_size = current_size;
+    mirror_copy->swap_size = swap_size;
+    mirror_copy->extra_padding = extra_padding;
+
+    //Create the swap space
+    mirror_copy->ptcl_data_swap = createMemberViews<DataTypes, MSpace>(swap_size);
+    //Deep copy each view
+    mirror_copy->offsets = typename Mirror<MSpace>::kkLidView("mirror offsets", offsets.size());
+    Kokkos::deep_copy(mirror_copy->offsets, offsets);
+    mirror_copy->element_to_gid = typename Mirror<MSpace>::kkGidView("mirror element_to_gid",
+                                                                     element_to_gid.size());
+    Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
+    //Deep copy the gid mapping
+    mirror_copy->element_gid_to_lid.create_copy_view(element_gid_to_lid);
+    return mirror_copy;
   }
 
   template <class DataTypes, typename MemSpace>
-  void CSR<DataTypes, MemSpace>::rebuild(kkLidView new_element,
-                                         kkLidView new_particle_elements,
-                                         MTVs new_particles) {
-    fprintf(stderr, "[WARNING] CSR rebuild(...) not implemented\n");
+  void CSR<DataTypes, MemSpace>::createGlobalMapping(kkGidView elmGid, kkGidView& elm2Gid,
+                                                     GID_Mapping& elmGid2Lid) {
+    elm2Gid = kkGidView("element to element gid", numRows());
+    Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
+      const gid_t gid = elmGid(i);
+      elm2Gid(i) = gid;
+      elmGid2Lid.insert(gid, i);
+    });
   }
 
   template <class DataTypes, typename MemSpace>
-  template <typename FunctionType>
-  void CSR<DataTypes, MemSpace>::parallel_for(FunctionType& fn, std::string s) {
-    fprintf(stderr, "[WARNING] CSR parallel_for(...) not implemented\n");
+  void CSR<DataTypes, MemSpace>::constructOffsets(kkLidView ptcls_per_elem, kkLidView& offs,
+                                                  lid_t& cap) {
+    //Pad the counts by one entry so the scan also produces the total
+    kkLidView counts("ptcls_per_elem_padded", numRows() + 1);
+    Kokkos::parallel_for(ptcls_per_elem.size(), KOKKOS_LAMBDA(const lid_t& i) {
+      counts(i) = ptcls_per_elem(i);
+    });
+    offs = kkLidView("offsets", numRows() + 1);
+    exclusive_scan(counts, offs);
+    cap = getLastValue<lid_t>(offs);
+  }
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::initCSRData(kkLidView particle_elements,
+                                             MTVs particle_info) {
+    lid_t given_particles = particle_elements.size();
+    assert(given_particles == num_ptcls);
+    //Setup starting point for each element
+    kkLidView elem_index("elem_index", numRows() + 1);
+    Kokkos::deep_copy(elem_index, offsets);
+
+    kkLidView particle_indices("new_particle_csr_indices", given_particles);
+    Kokkos::parallel_for(given_particles, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t new_elem = particle_elements(i);
+      particle_indices(i) = Kokkos::atomic_fetch_add(&elem_index(new_elem), 1);
+    });
+
+    CopyViewsToViews<kkLidView, DataTypes>(ptcl_data, particle_info, particle_indices);
+  }
 
+  template <class DataTypes, typename MemSpace>
+  template <typename FunctionType>
+  void CSR<DataTypes, MemSpace>::parallel_for(FunctionType& fn, std::string name) {
+    if (nPtcls() == 0)
+      return;
+    //The functor is captured by value so no device copy has to be managed
+    FunctionType fn_d = fn;
+    const PolicyType policy(num_elems, Kokkos::AUTO);
+    auto offsets_cpy = offsets;
+    Kokkos::parallel_for(name, policy,
+                         KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
+      const lid_t elm = thread.league_rank();
+      const lid_t start = offsets_cpy(elm);
+      const lid_t end = offsets_cpy(elm + 1);
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, start, end), [&] (const lid_t& ptcl) {
+        const bool mask = true;
+        fn_d(elm, ptcl, mask);
+      });
+    });
   }
 
   template <class DataTypes, typename MemSpace>
   void CSR<DataTypes, MemSpace>::printMetrics() const {
-    fprintf(stderr, "[WARNING] CSR printMetrics() not implemented\n");
+    //Gather metrics
+    lid_t num_empty_elements = 0;
+    lid_t max_ppe = 0;
+    auto offsets_cpy = offsets;
+    Kokkos::parallel_reduce("count_empty_elements", num_elems,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+      sum += (offsets_cpy(i + 1) == offsets_cpy(i));
+    }, num_empty_elements);
+    Kokkos::parallel_reduce("max_ptcls_per_elem", num_elems,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& mx) {
+      const lid_t np = offsets_cpy(i + 1) - offsets_cpy(i);
+      if (np > mx)
+        mx = np;
+    }, Kokkos::Max<lid_t>(max_ppe));
+
+    int comm_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+    char buffer[1000];
+    char* ptr = buffer;
+
+    //Header
+    ptr += sprintf(ptr, "Metrics %d, CSR\n", comm_rank);
+    //Sizes
+    ptr += sprintf(ptr, "Nelems %d, Nptcls %d, Capacity %d, Allocation %lu\n",
+                   nElems(), nPtcls(), capacity(), current_size + swap_size);
+    //Element occupancy
+    ptr += sprintf(ptr, "Empty Elements <Tot %%> %d %.3f\n", num_empty_elements,
+                   num_empty_elements * 100.0 / (num_elems > 0 ? num_elems : 1));
+    ptr += sprintf(ptr, "Particles Per Element <Max Avg> %d %.3f\n", max_ppe,
+                   nPtcls() * 1.0 / (num_elems > 0 ? num_elems : 1));
+
+    printf("%s\n", buffer);
   }
 }
+
+//Seperate files with CSR member function implementations
+#include "CSR_rebuild.hpp"
+#include "CSR_migrate.hpp"
@@ -0,0 +1,124 @@
+#pragma once
+#include <psMigrate.h>
+namespace pumipic {
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::migrate(kkLidView new_element, kkLidView new_process,
+                                         Distributor<MemSpace> dist,
+                                         kkLidView new_particle_elements,
+                                         MTVs new_particle_info) {
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("csr_migrate");
+    Kokkos::Timer timer;
+
+    //Distributor size & rank for performing migration
+    int comm_size = dist.num_ranks();
+    int comm_rank;
+    MPI_Comm_rank(dist.mpi_comm(), &comm_rank);
+
+    //If serial, skip migration
+    if (comm_size == 1) {
+      rebuild(new_element, new_particle_elements, new_particle_info);
+      RecordTime(name + " particle migration", timer.seconds(), btime);
+      Kokkos::Profiling::popRegion();
+      return;
+    }
+
+    //Count number of particles to send to each process
+    kkLidView num_send_particles("num_send_particles", comm_size + 1);
+    countSendingParticles(this, new_process, dist, comm_rank, num_send_particles);
+
+    /********* Send # of particles being sent to each process *********/
+    kkLidView num_recv_particles("num_recv_particles", comm_size + 1);
+    std::vector<MPI_Request> count_send_requests, count_recv_requests;
+    postCountExchange<CSR>(dist, comm_rank, num_send_particles, num_recv_particles,
+                           count_send_requests, count_recv_requests);
+
+    //Gather sending particle data
+    //Perform an ex-sum on num_send_particles & num_recv_particles
+    kkLidView offset_send_particles("offset_send_particles", comm_size+1);
+    kkLidView offset_send_particles_temp("offset_send_particles_temp", comm_size + 1);
+    exclusive_scan(num_send_particles, offset_send_particles);
+    Kokkos::deep_copy(offset_send_particles_temp, offset_send_particles);
+    kkLidHostMirror offset_send_particles_host = deviceToHost(offset_send_particles);
+
+    //Pack the particles being sent into one record each
+    lid_t np_send = offset_send_particles_host(comm_size);
+    const std::size_t record_size = PackedLayout<DataTypes>::size;
+    Kokkos::View<char*, device_type> send_buffer(
+      Kokkos::ViewAllocateWithoutInitializing("send_buffer"), np_send * record_size);
+    kkLidView send_index("send_particle_index", capacity());
+    gatherSendRecords(this, new_element, new_process, dist, comm_rank, element_to_gid,
+                      offset_send_particles_temp, send_index, send_buffer.data());
+    PackParticles<CSR<DataTypes, MemSpace>, DataTypes>(this, send_buffer.data(), ptcl_data,
+                                                       new_process, send_index, comm_rank);
+
+    //Wait until all counts are received
+    PS_Comm_Waitall<device_type>(count_recv_requests.size(), count_recv_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+
+    //Count the number of processes being sent to and recv from
+    lid_t num_sending_to, num_receiving_from;
+    countMigratingRanks<CSR>(comm_size, num_send_particles, num_recv_particles,
+                             num_sending_to, num_receiving_from);
+
+    //wait for send requests if there are any
+    PS_Comm_Waitall<device_type>(count_send_requests.size(), count_send_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+
+    //If no particles are being sent or received, perform rebuild
+    if (num_sending_to == 0 && num_receiving_from == 0) {
+      rebuild(new_element, new_particle_elements, new_particle_info);
+      RecordTime(name +" particle migration", timer.seconds(), btime);
+      Kokkos::Profiling::popRegion();
+      return;
+    }
+
+    //Offset the recv particles
+    kkLidView offset_recv_particles("offset_recv_particles", comm_size+1);
+    exclusive_scan(num_recv_particles, offset_recv_particles);
+    kkLidHostMirror offset_recv_particles_host = deviceToHost(offset_recv_particles);
+    int np_recv = offset_recv_particles_host(comm_size);
+
+    //Send the records to each neighbor
+    Kokkos::View<char*, device_type> recv_buffer(
+      Kokkos::ViewAllocateWithoutInitializing("recv_buffer"), np_recv * record_size);
+    std::vector<MPI_Request> send_requests, recv_requests;
+    postRecordExchange<CSR>(dist, comm_rank, offset_send_particles_host,
+                            offset_recv_particles_host, send_buffer, recv_buffer,
+                            send_requests, recv_requests);
+    PS_Comm_Waitall<device_type>(recv_requests.size(), recv_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+
+    //Create arrays for particles being received
+    lid_t new_ptcls = new_particle_elements.size();
+    kkLidView recv_element("recv_element", np_recv + new_ptcls);
+    MTVs recv_particle;
+    //Allocate views for each data type into recv_particle[type]
+    CreateViews<device_type, DataTypes>(recv_particle, np_recv + new_ptcls);
+
+    /********** Unpack the received records and convert the element gid to element lid *****/
+    unpackRecvRecords<CSR>(recv_buffer.data(), np_recv, element_gid_to_lid, recv_element,
+                           recv_particle);
+
+    /********** Set particles that were sent to non existent on this process *********/
+    removeSentParticles(this, new_element, new_process, comm_rank);
+
+    /********** Add new particles to the migrated particles *********/
+    kkLidView new_ptcl_map("new_ptcl_map", new_ptcls);
+    addNewParticles<CSR>(np_recv, new_particle_elements, new_particle_info, new_ptcl_map,
+                         recv_element, recv_particle);
+
+    /********** Combine and shift particles to their new destination **********/
+    rebuild(new_element, recv_element, recv_particle);
+
+    //Cleanup
+    PS_Comm_Waitall<device_type>(send_requests.size(), send_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+    destroyViews<DataTypes, memory_space>(recv_particle);
+
+    RecordTime(name +" particle migration", timer.seconds(), btime);
+
+    Kokkos::Profiling::popRegion();
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <psMemberType.h>
+namespace pumipic {
+
+  template <class DataTypes, typename MemSpace>
+  void CSR<DataTypes, MemSpace>::rebuild(kkLidView new_element,
+                                         kkLidView new_particle_elements,
+                                         MTVs new_particles) {
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("csr_rebuild");
+    Kokkos::Timer timer;
+
+    //Count particles including new and leaving
+    kkLidView new_particles_per_elem("new_particles_per_elem", numRows() + 1);
+    auto countNewParticles = PS_LAMBDA(lid_t element_id, lid_t particle_id, bool mask) {
+      const lid_t new_elem = new_element(particle_id);
+      if (new_elem != -1)
+        Kokkos::atomic_fetch_add(&(new_particles_per_elem(new_elem)), mask);
+    };
+    parallel_for(countNewParticles, "countNewParticles");
+    // Add new particles to counts
+    Kokkos::parallel_for("rebuild_count", new_particle_elements.size(),
+                         KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t new_elem = new_particle_elements(i);
+      Kokkos::atomic_fetch_add(&(new_particles_per_elem(new_elem)), 1);
+    });
+
+    //Scan the counts into the new offsets, the last entry is the new number of particles
+    kkLidView new_offsets("new_offsets", numRows() + 1);
+    exclusive_scan(new_particles_per_elem, new_offsets);
+    lid_t new_num_ptcls = getLastValue<lid_t>(new_offsets);
+
+    //Allocate the swap space
+    if (swap_size < static_cast<std::size_t>(new_num_ptcls)) {
+      destroyViews<DataTypes, memory_space>(ptcl_data_swap);
+      swap_size = new_num_ptcls * (1 + extra_padding);
+      CreateViews<device_type, DataTypes>(ptcl_data_swap, swap_size);
+    }
+
+    //Assign each particle a slot within the segment of its new element
+    kkLidView element_index("element_index", numRows() + 1);
+    Kokkos::deep_copy(element_index, new_offsets);
+    kkLidView new_indices("new_csr_index", capacity());
+    auto setNewIndices = PS_LAMBDA(lid_t element_id, lid_t particle_id, bool mask) {
+      const lid_t new_elem = new_element(particle_id);
+      if (mask && new_elem != -1)
+        new_indices(particle_id) = Kokkos::atomic_fetch_add(&element_index(new_elem), 1);
+    };
+    parallel_for(setNewIndices, "setNewIndices");
+
+    CopyPSToPS<CSR<DataTypes, MemSpace>, DataTypes>(this, ptcl_data_swap, ptcl_data,
+                                                    new_element, new_indices);
+
+    //Add new particles
+    lid_t num_new_ptcls = new_particle_elements.size();
+    kkLidView new_particle_indices("new_particle_csr_indices", num_new_ptcls);
+    Kokkos::parallel_for("set_new_particle", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t new_elem = new_particle_elements(i);
+      new_particle_indices(i) = Kokkos::atomic_fetch_add(&element_index(new_elem), 1);
+    });
+
+    if (num_new_ptcls > 0)
+      CopyViewsToViews<kkLidView, DataTypes>(ptcl_data_swap, new_particles,
+                                             new_particle_indices);
+
+    //set csr to point to new values
+    num_ptcls = new_num_ptcls;
+    capacity_ = new_num_ptcls;
+    offsets = new_offsets;
+    MTVs tmp = ptcl_data;
+    ptcl_data = ptcl_data_swap;
+    ptcl_data_swap = tmp;
+    std::size_t tmp_size = current_size;
+    current_size = swap_size;
+    swap_size = tmp_size;
+
+    RecordTime(name + " rebuild", timer.seconds(), btime);
+    Kokkos::Profiling::popRegion();
+  }
+}
@@ -6,16 +6,21 @@
 #include <psDistributor.hpp>
 namespace pumipic {
 
-  template <class DataTypes, typename Space = DefaultMemSpace>
+  /* DataTypes - the MemberTypes of each particle
+     Space - the memory space the particles are stored in
+     Storage - the layout of the particle data, SoA or AoSoA<TileSize> (see MemberTypeAoSoA.h)
+  */
+  template <class DataTypes, typename Space = DefaultMemSpace, typename Storage = SoA>
   class ParticleStructure {
   public:
     typedef DataTypes Types;
+    typedef Storage storage_type;
     typedef typename Space::memory_space memory_space;
     typedef typename Space::execution_space execution_space;
     typedef typename Space::device_type device_type;
     typedef typename Kokkos::ViewTraits<void, Space>::HostMirrorSpace HostMirrorSpace;
-    typedef ParticleStructure<DataTypes, HostMirrorSpace> HostMirror;
-    template <typename Space2> using Mirror = ParticleStructure<DataTypes, Space2>;
+    typedef ParticleStructure<DataTypes, HostMirrorSpace, Storage> HostMirror;
+    template <typename Space2> using Mirror = ParticleStructure<DataTypes, Space2, Storage>;
 
     template <class T> using View = Kokkos::View<T*, device_type>;
     typedef View<lid_t> kkLidView;
@@ -24,9 +29,13 @@ namespace pumipic {
     typedef typename kkGidView::HostMirror kkGidHostMirror;
 
     template <std::size_t N> using DataType = typename MemberTypeAtIndex<N, DataTypes>::type;
+    //The Nth member as declared in DataTypes including its layout options
+    template <std::size_t N> using MemberDecl =
+      typename MemberTypeAtIndex<N, DataTypes>::member;
     typedef MemberTypeViews MTVs;
-    template <std::size_t N> using MTV = MemberTypeView<DataType<N>, device_type>;
-    template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
+    template <std::size_t N> using MTV =
+      typename StorageView<Storage, MemberDecl<N>, device_type>::type;
+    template <std::size_t N> using Slice = Segment<DataType<N>, device_type, MTV<N> >;
 
     ParticleStructure();
     ParticleStructure(const std::string& name_);
@@ -76,7 +85,8 @@ namespace pumipic {
 
     /*
       Copy a particle structure to another memory space
-      Note: if the same memory space is used then a the data is not duplicated
+      Note: the data is always duplicated so that each structure owns (and destroys) its own
+            member views, even if the same memory space is used
     */
     template <class Space2>
     void copy(Mirror<Space2>* old) {
@@ -84,26 +94,24 @@ namespace pumipic {
       num_ptcls = old->num_ptcls;
       capacity_ = old->capacity_;
       num_rows = old->num_rows;
-      if (std::is_same<memory_space, typename Space2::memory_space>::value) {
-        ptcl_data = old->ptcl_data;
-      }
-      else {
-        auto first_data_view = static_cast<MTV<0>*>(old->ptcl_data[0]);
-        int s = first_data_view->size() / BaseType<DataType<0> >::size;
-        ptcl_data = createMemberViews<DataTypes, Space>(s);
-        CopyMemSpaceToMemSpace<Space, Space2, DataTypes>(ptcl_data, old->ptcl_data);
-      }
+      typedef typename Space2::device_type OldDevice;
+      typedef typename StorageView<Storage, MemberDecl<0>, OldDevice>::type OldMTV;
+      auto first_data_view = static_cast<OldMTV*>(old->ptcl_data[0]);
+      int s = first_data_view->size() / BaseType<DataType<0> >::size;
+      StorageViews<Storage, device_type, DataTypes>::create(ptcl_data, s);
+      StorageViews<Storage, device_type, DataTypes>::template copy<OldDevice>(ptcl_data,
+                                                                              old->ptcl_data);
     }
-    template <typename DT, typename Space2> friend class ParticleStructure;
+    template <typename DT, typename Space2, typename Storage2> friend class ParticleStructure;
   };
 
-  template <class DataTypes, typename Space>
-  ParticleStructure<DataTypes, Space>::ParticleStructure() : name("ptcls"), num_elems(0), num_ptcls(0),
+  template <class DataTypes, typename Space, typename Storage>
+  ParticleStructure<DataTypes, Space, Storage>::ParticleStructure() : name("ptcls"), num_elems(0), num_ptcls(0),
                                                              capacity_(0), num_rows(0) {
   }
 
-  template <class DataTypes, typename Space>
-  ParticleStructure<DataTypes, Space>::ParticleStructure(const std::string& name_) : name(name_), num_elems(0), num_ptcls(0),
+  template <class DataTypes, typename Space, typename Storage>
+  ParticleStructure<DataTypes, Space, Storage>::ParticleStructure(const std::string& name_) : name(name_), num_elems(0), num_ptcls(0),
                                                              capacity_(0), num_rows(0) {
   }
 
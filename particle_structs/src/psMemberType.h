@@ -1,5 +1,7 @@
 #pragma once
-#include "ps_for.hpp"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 #include <MemberTypeLibraries.h>
 namespace pumipic {
 /* CopyParticleToSend<ParticleStructure, DataTypes> - copies particle info to send arrays
@@ -10,6 +12,16 @@ namespace pumipic {
                                                               MapFromPSToSendArray);
 */
   template <typename PS, typename... Types> struct CopyParticlesToSend;
+/* PackParticles<ParticleStructure, DataTypes> - packs the members of the particles being
+                                                 sent into records of a buffer
+                                                 (see MemberTypePack.h)
+     Usage: PackParticles<ParticleStructure, DataTypes>(ParticleStructure, RecordBuffer,
+                                                        SourceMemberTypeViews,
+                                                        NewProcessPerParticle,
+                                                        RecordIndexPerParticle, CommRank);
+     The elements of the records are not written.
+*/
+  template <typename PS, typename... Types> struct PackParticles;
 /* CopyPSToPS<ParticleStructure, DataTypes> - copies particle info from ps to ps
      Usage: CopyPSToPS<ParticleStructure, MemberTypes>(ParticleStructure,
                                                        DestionationMemberTypeViews,
@@ -18,7 +30,37 @@ namespace pumipic {
                                                        DestinationIndexForParticle);
 */
   template <typename PS, typename... Types> struct CopyPSToPS;
+/* PermuteInPlace<ParticleStructure, DataTypes> - moves particles between slots of the same
+                                                  member views
+     Usage: PermuteInPlace<ParticleStructure, MemberTypes>(MemberTypeViews,
+                                                           StagingMemberTypeViews,
+                                                           SourceSlotPerSlot,
+                                                           PermuteStatePerSlot,
+                                                           CycleLeaders, NumCycleLeaders,
+                                                           StagingSize);
+     The slot each slot is filled from (-1 for none) must form paths starting at the slots
+       marked PERMUTE_PATH_HEAD and cycles each with one slot listed in CycleLeaders.
+*/
+  template <typename PS, typename... Types> struct PermuteInPlace;
+/* FillSortKeys<ParticleStructure, DataTypes> - sets the sort key of each particle from one
+                                                arithmetic member
+     Usage: FillSortKeys<ParticleStructure, MemberTypes>(ParticleStructure, MemberTypeViews,
+                                                         MemberIndex, KeyPerSlot);
+     valid is false if the member does not exist or is not a single arithmetic value.
+*/
+  template <typename PS, typename... Types> struct FillSortKeys;
+  enum PermuteState {
+    PERMUTE_NONE,
+    //The first slot of a path, its particle does not stay in the structure
+    PERMUTE_PATH_HEAD,
+    PERMUTE_PATH,
+    PERMUTE_CYCLE
+  };
+}
 
+//Included after the declarations above so that structures included by ps_for.hpp can use them
+#include "ps_for.hpp"
+namespace pumipic {
 //Copy Particles To Send Templated Struct
   template <typename PS, typename... Types> struct CopyParticlesToSendImpl;
   template <typename PS> struct CopyParticlesToSendImpl<PS> {
@@ -29,6 +71,7 @@ namespace pumipic {
   };
   template <typename PS, typename T, typename... Types> struct CopyParticlesToSendImpl<PS, T,Types...> {
     typedef typename PS::device_type Device;
+    typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
     CopyParticlesToSendImpl(PS* ps, MemberTypeViewsConst dsts,
                             MemberTypeViewsConst srcs,
                             typename PS::kkLidView ps_to_array,
@@ -42,12 +85,12 @@ namespace pumipic {
       int comm_rank;
       MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
       MemberTypeView<T, Device> dst = *static_cast<MemberTypeView<T, Device> const*>(dsts[0]);
-      MemberTypeView<T, Device> src = *static_cast<MemberTypeView<T, Device> const*>(srcs[0]);
+      PSView src = *static_cast<PSView const*>(srcs[0]);
       auto copyPSToArray = PS_LAMBDA(int elm_id, int ptcl_id, bool mask) {
         const int arr_index = ps_to_array(ptcl_id);
         if (mask && arr_index != comm_rank) {
           const int index = array_indices(ptcl_id);
-          CopyViewToView<T,Device>(dst, index, src, ptcl_id);
+          CopyMember<T>(dst, index, src, ptcl_id);
         }
       };
       parallel_for(ps, copyPSToArray);
@@ -66,6 +109,46 @@ namespace pumipic {
     }
   };
 
+  template <typename PS, typename Offsets, typename... Types> struct PackParticlesImpl;
+  template <typename PS, typename Offsets> struct PackParticlesImpl<PS, Offsets> {
+    PackParticlesImpl(PS*, char*, std::size_t, MemberTypeViewsConst, typename PS::kkLidView,
+                      typename PS::kkLidView, int) {}
+  };
+  template <typename PS, typename Offsets, typename T, typename... Types>
+  struct PackParticlesImpl<PS, Offsets, T, Types...> {
+    typedef typename PS::device_type Device;
+    typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
+    PackParticlesImpl(PS* ps, char* buffer, std::size_t record_size, MemberTypeViewsConst srcs,
+                      typename PS::kkLidView new_process, typename PS::kkLidView record_index,
+                      int comm_rank) {
+      enclose(ps, buffer, record_size, srcs, new_process, record_index, comm_rank);
+      PackParticlesImpl<PS, typename Offsets::Next, Types...>(ps, buffer, record_size, srcs + 1,
+                                                               new_process, record_index,
+                                                               comm_rank);
+    }
+    void enclose(PS* ps, char* buffer, std::size_t record_size, MemberTypeViewsConst srcs,
+                 typename PS::kkLidView new_process, typename PS::kkLidView record_index,
+                 int comm_rank) {
+      PackedMember<T> dst(buffer, Offsets::offset, record_size);
+      PSView src = *static_cast<PSView const*>(srcs[0]);
+      auto packPSToRecords = PS_LAMBDA(int elm_id, int ptcl_id, bool mask) {
+        if (mask && new_process(ptcl_id) != comm_rank)
+          CopyMember<T>(dst, record_index(ptcl_id), src, ptcl_id);
+      };
+      parallel_for(ps, packPSToRecords, "packParticles");
+    }
+  };
+  template <typename PS,typename... Types> struct PackParticles<PS, MemberTypes<Types...> > {
+    typedef PackedLayout<MemberTypes<Types...> > Layout;
+    PackParticles(PS* ps, char* buffer, MemberTypeViewsConst srcs,
+                  typename PS::kkLidView new_process, typename PS::kkLidView record_index,
+                  int comm_rank) {
+      PackParticlesImpl<PS, typename Layout::Members, Types...>(ps, buffer, Layout::size, srcs,
+                                                                new_process, record_index,
+                                                                comm_rank);
+    }
+  };
+
   template <typename PS, typename... Types> struct CopyPSToPSImpl;
   template <typename PS> struct CopyPSToPSImpl<PS> {
     typedef typename PS::device_type Device;
@@ -75,6 +158,7 @@ namespace pumipic {
   };
   template <typename PS, typename T, typename... Types> struct CopyPSToPSImpl<PS, T,Types...> {
     typedef typename PS::device_type Device;
+    typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
     CopyPSToPSImpl(PS* ps, MemberTypeViewsConst dsts,
                    MemberTypeViewsConst srcs,
                    typename PS::kkLidView new_element,
@@ -85,13 +169,13 @@ namespace pumipic {
                  MemberTypeViewsConst srcs,
                  typename PS::kkLidView new_element,
                  typename PS::kkLidView ps_indices) {
-      MemberTypeView<T, Device> dst = *static_cast<MemberTypeView<T, Device> const*>(dsts[0]);
-      MemberTypeView<T, Device> src = *static_cast<MemberTypeView<T, Device> const*>(srcs[0]);
+      PSView dst = *static_cast<PSView const*>(dsts[0]);
+      PSView src = *static_cast<PSView const*>(srcs[0]);
       auto copyPSToPS = PS_LAMBDA(int elm_id, int ptcl_id, bool mask) {
         const lid_t new_elem = new_element(ptcl_id);
         if (mask && new_elem != -1) {
           const int index = ps_indices(ptcl_id);
-          CopyViewToView<T,Device>(dst, index, src, ptcl_id);
+          CopyMember<T>(dst, index, src, ptcl_id);
         }
       };
       parallel_for(ps, copyPSToPS);
@@ -108,4 +192,135 @@ namespace pumipic {
       CopyPSToPSImpl<PS, Types...>(ps, dsts, srcs, new_element, ps_indices);
     }
   };
+
+  template <typename PS, typename... Types> struct PermuteInPlaceImpl;
+  template <typename PS> struct PermuteInPlaceImpl<PS> {
+    PermuteInPlaceImpl(MemberTypeViews, MemberTypeViews, typename PS::kkLidView,
+                       typename PS::kkLidView, typename PS::kkLidView, lid_t, lid_t) {}
+  };
+  template <typename PS, typename T, typename... Types> struct PermuteInPlaceImpl<PS, T,Types...> {
+    typedef typename PS::device_type Device;
+    typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
+    PermuteInPlaceImpl(MemberTypeViews views, MemberTypeViews staging,
+                       typename PS::kkLidView source, typename PS::kkLidView state,
+                       typename PS::kkLidView leaders, lid_t num_leaders,
+                       lid_t staging_size) {
+      enclose(views, staging, source, state, leaders, num_leaders, staging_size);
+      PermuteInPlaceImpl<PS, Types...>(views+1, staging+1, source, state, leaders, num_leaders,
+                                       staging_size);
+    }
+    void enclose(MemberTypeViews views, MemberTypeViews staging,
+                 typename PS::kkLidView source, typename PS::kkLidView state,
+                 typename PS::kkLidView leaders, lid_t num_leaders, lid_t staging_size) {
+      PSView view = *static_cast<PSView*>(views[0]);
+      PSView stage = *static_cast<PSView*>(staging[0]);
+      const lid_t num_slots = source.size();
+      //Each path pulls every particle into the slot freed before it
+      Kokkos::parallel_for("permute_paths", num_slots, KOKKOS_LAMBDA(const lid_t& slot) {
+        if (state(slot) == PERMUTE_PATH_HEAD) {
+          lid_t cur = slot;
+          lid_t src = source(cur);
+          while (src != -1) {
+            CopyMember<T>(view, cur, view, src);
+            cur = src;
+            src = cur < num_slots ? source(cur) : -1;
+          }
+        }
+      });
+      //Each cycle stages the particle of its leader to free the first slot
+      for (lid_t start = 0; start < num_leaders; start += staging_size) {
+        const lid_t batch = num_leaders - start < staging_size ? num_leaders - start :
+          staging_size;
+        Kokkos::parallel_for("permute_cycles", batch, KOKKOS_LAMBDA(const lid_t& i) {
+          const lid_t leader = leaders(start + i);
+          CopyMember<T>(stage, i, view, leader);
+          lid_t cur = leader;
+          lid_t src = source(cur);
+          while (src != leader) {
+            CopyMember<T>(view, cur, view, src);
+            cur = src;
+            src = source(cur);
+          }
+          CopyMember<T>(view, cur, stage, i);
+        });
+      }
+    }
+  };
+  template <typename PS,typename... Types> struct PermuteInPlace<PS, MemberTypes<Types...> > {
+    PermuteInPlace(MemberTypeViews views, MemberTypeViews staging,
+                   typename PS::kkLidView source, typename PS::kkLidView state,
+                   typename PS::kkLidView leaders, lid_t num_leaders, lid_t staging_size) {
+      PermuteInPlaceImpl<PS, Types...>(views, staging, source, state, leaders, num_leaders,
+                                       staging_size);
+    }
+  };
+
+  /* OrderedKey<T>::get(value) - unsigned 64 bit key that sorts in the order of value
+       Negative integers and floats have their sign bit flipped (and the rest of the bits of
+       negative floats) so the keys can be radix sorted
+  */
+  template <typename T, bool IsFloat = std::is_floating_point<T>::value> struct OrderedKey {
+    PP_INLINE static uint64_t get(T value) {
+      const uint64_t key = static_cast<uint64_t>(static_cast<int64_t>(value));
+      return std::is_signed<T>::value ? key ^ (1ull << 63) : key;
+    }
+  };
+  template <typename T> struct OrderedKey<T, true> {
+    PP_INLINE static uint64_t get(T value) {
+      const double d = value;
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      return (bits >> 63) ? ~bits : bits | (1ull << 63);
+    }
+  };
+
+  template <typename PS, typename T,
+            bool IsKey = std::is_arithmetic<typename MemberTraits<T>::type>::value>
+  struct FillSortKeysMember {
+    FillSortKeysMember(PS*, void*, Kokkos::View<uint64_t*, typename PS::device_type>,
+                       bool& valid) {
+      valid = false;
+    }
+  };
+  template <typename PS, typename T> struct FillSortKeysMember<PS, T, true> {
+    typedef typename PS::device_type Device;
+    typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
+    typedef typename MemberTraits<T>::type Type;
+    FillSortKeysMember(PS* ps, void* view_ptr, Kokkos::View<uint64_t*, Device> keys,
+                       bool& valid) {
+      PSView view = *static_cast<PSView*>(view_ptr);
+      auto fillKeys = PS_LAMBDA(int elm_id, int ptcl_id, bool mask) {
+        if (mask)
+          keys(ptcl_id) = OrderedKey<Type>::get(view(ptcl_id));
+      };
+      parallel_for(ps, fillKeys, "fillSortKeys");
+      valid = true;
+    }
+  };
+
+  template <typename PS, typename... Types> struct FillSortKeysImpl;
+  template <typename PS> struct FillSortKeysImpl<PS> {
+    FillSortKeysImpl(PS*, MemberTypeViews, int,
+                     Kokkos::View<uint64_t*, typename PS::device_type>, bool& valid) {
+      valid = false;
+    }
+  };
+  template <typename PS, typename T, typename... Types> struct FillSortKeysImpl<PS, T, Types...> {
+    FillSortKeysImpl(PS* ps, MemberTypeViews views, int member,
+                     Kokkos::View<uint64_t*, typename PS::device_type> keys, bool& valid) {
+      if (member == 0)
+        FillSortKeysMember<PS, T>(ps, views[0], keys, valid);
+      else
+        FillSortKeysImpl<PS, Types...>(ps, views + 1, member - 1, keys, valid);
+    }
+  };
+  template <typename PS,typename... Types> struct FillSortKeys<PS, MemberTypes<Types...> > {
+    bool valid;
+    FillSortKeys(PS* ps, MemberTypeViews views, int member,
+                 Kokkos::View<uint64_t*, typename PS::device_type> keys) {
+      valid = false;
+      if (member >= 0)
+        FillSortKeysImpl<PS, Types...>(ps, views, member, keys, valid);
+    }
+  };
 }
@@ -0,0 +1,211 @@
+#pragma once
+#include <vector>
+#include <mpi.h>
+#include <psDistributor.hpp>
+#include <psMemberType.h>
+namespace pumipic {
+/* Steps of migrate shared by the particle structures
+
+   The particles sent to each process are packed into records (see MemberTypePack.h) so that
+     every process is sent a single message. The structure allocates the count, offset and
+     record views, chooses how the counts are exchanged and rebuilds itself from the received
+     particles.
+     Usage: countSendingParticles(ParticleStructure, NewProcessPerParticle, Distributor,
+                                  CommRank, NumSendPerIndex);
+            postCountExchange<ParticleStructure>(Distributor, CommRank, NumSendPerIndex,
+                                                 NumRecvPerIndex, SendRequests, RecvRequests);
+            countMigratingRanks<ParticleStructure>(NumRanks, NumSendPerIndex, NumRecvPerIndex,
+                                                   NumSendingTo, NumReceivingFrom);
+            gatherSendRecords(ParticleStructure, NewElementPerParticle, NewProcessPerParticle,
+                              Distributor, CommRank, ElementToGid, OffsetPerIndex,
+                              RecordIndexPerParticle, RecordBuffer);
+            postRecordExchange<ParticleStructure>(Distributor, CommRank, SendOffsetsHost,
+                                                  RecvOffsetsHost, SendBuffer, RecvBuffer,
+                                                  SendRequests, RecvRequests);
+            unpackRecvRecords<ParticleStructure>(RecordBuffer, NumRecv, ElementGidToLid,
+                                                 RecvElements, RecvMemberTypeViews);
+            addNewParticles<ParticleStructure>(NumRecv, NewParticleElements, NewParticleInfo,
+                                               NewParticleMap, RecvElements,
+                                               RecvMemberTypeViews);
+            removeSentParticles(ParticleStructure, NewElementPerParticle, NewProcessPerParticle,
+                                CommRank);
+*/
+
+  //Counts the particles sent to each index of dist into num_send_particles
+  template <class PS, typename Space>
+  void countSendingParticles(PS* ps, typename PS::kkLidView new_process,
+                             const Distributor<Space>& dist, int comm_rank,
+                             typename PS::kkLidView num_send_particles) {
+    auto count_sending_particles = PS_LAMBDA(lid_t element_id, lid_t particle_id, bool mask) {
+      const lid_t process = new_process(particle_id);
+      const lid_t process_index = dist.index(process);
+      Kokkos::atomic_fetch_add(&(num_send_particles(process_index)),
+                               mask * (process != comm_rank));
+    };
+    parallel_for(ps, count_sending_particles, "count_sending_particles");
+  }
+
+  /* Posts the exchange of the particle counts, one alltoall for a world Distributor and
+       otherwise a send and a receive with every other rank of dist
+     The counts are received once recv_requests complete
+  */
+  template <class PS, typename Space>
+  void postCountExchange(const Distributor<Space>& dist, int comm_rank,
+                         typename PS::kkLidView num_send_particles,
+                         typename PS::kkLidView num_recv_particles,
+                         std::vector<MPI_Request>& send_requests,
+                         std::vector<MPI_Request>& recv_requests) {
+    const int comm_size = dist.num_ranks();
+    send_requests.resize(dist.isWorld() ? 0 : comm_size - 1);
+    recv_requests.resize(dist.isWorld() ? 1 : comm_size - 1);
+    if (dist.isWorld()) {
+      PS_Comm_Ialltoall(num_send_particles, 1, num_recv_particles, 1,
+                        dist.mpi_comm(), recv_requests.data());
+      return;
+    }
+    int request_index = 0;
+    for (int i = 0; i < comm_size; ++i) {
+      int rank = dist.rank_host(i);
+      if (rank != comm_rank) {
+        PS_Comm_Isend(num_send_particles, i, 1, rank, 0, dist.mpi_comm(),
+                      send_requests.data() + request_index);
+        PS_Comm_Irecv(num_recv_particles, i, 1, rank, 0, dist.mpi_comm(),
+                      recv_requests.data() + request_index);
+        ++request_index;
+      }
+    }
+  }
+
+  //Counts the number of processes being sent to and received from
+  template <class PS>
+  void countMigratingRanks(int comm_size, typename PS::kkLidView num_send_particles,
+                           typename PS::kkLidView num_recv_particles, lid_t& num_sending_to,
+                           lid_t& num_receiving_from) {
+    num_sending_to = 0;
+    num_receiving_from = 0;
+    Kokkos::parallel_reduce("sum_senders", comm_size,
+                            KOKKOS_LAMBDA (const lid_t& i, lid_t& lsum ) {
+      lsum += (num_send_particles(i) > 0);
+    }, num_sending_to);
+    Kokkos::parallel_reduce("sum_receivers", comm_size,
+                            KOKKOS_LAMBDA (const lid_t& i, lid_t& lsum ) {
+      lsum += (num_recv_particles(i) > 0);
+    }, num_receiving_from);
+  }
+
+  /* Assigns each particle being sent the next record of its process starting from
+       offset_send_particles, which is advanced, and writes the element gid of the record
+     The members are packed afterwards by PackParticles with the same send_index
+  */
+  template <class PS, typename Space>
+  void gatherSendRecords(PS* ps, typename PS::kkLidView new_element,
+                         typename PS::kkLidView new_process, const Distributor<Space>& dist,
+                         int comm_rank, typename PS::kkGidView element_to_gid,
+                         typename PS::kkLidView offset_send_particles,
+                         typename PS::kkLidView send_index, char* send_records) {
+    typedef PackedLayout<typename PS::Types> Layout;
+    auto gatherParticlesToSend = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
+      const lid_t process = new_process(particle_id);
+      const lid_t process_index = dist.index(process);
+      if (mask && process != comm_rank) {
+        send_index(particle_id) =
+          Kokkos::atomic_fetch_add(&(offset_send_particles(process_index)),1);
+        const lid_t index = send_index(particle_id);
+        Layout::element(send_records, index) = element_to_gid(new_element(particle_id));
+      }
+    };
+    parallel_for(ps, gatherParticlesToSend, "gatherParticlesToSend");
+  }
+
+  /* Posts one message of records to and from each other rank of dist with particles to
+       exchange
+     The requests are sized before posting since the requests of the device buffers are
+       tracked by their address
+  */
+  template <class PS, typename Space>
+  void postRecordExchange(const Distributor<Space>& dist, int comm_rank,
+                          typename PS::kkLidHostMirror offset_send_particles_host,
+                          typename PS::kkLidHostMirror offset_recv_particles_host,
+                          Kokkos::View<char*, typename PS::device_type> send_buffer,
+                          Kokkos::View<char*, typename PS::device_type> recv_buffer,
+                          std::vector<MPI_Request>& send_requests,
+                          std::vector<MPI_Request>& recv_requests) {
+    typedef PackedLayout<typename PS::Types> Layout;
+    const std::size_t record_size = Layout::size;
+    const int comm_size = dist.num_ranks();
+    int num_sending_to = 0, num_receiving_from = 0;
+    for (int i = 0; i < comm_size; ++i) {
+      if (dist.rank_host(i) == comm_rank)
+        continue;
+      num_sending_to += offset_send_particles_host(i + 1) > offset_send_particles_host(i);
+      num_receiving_from += offset_recv_particles_host(i + 1) > offset_recv_particles_host(i);
+    }
+    send_requests.resize(num_sending_to);
+    recv_requests.resize(num_receiving_from);
+    lid_t send_num = 0, recv_num = 0;
+    for (int i = 0; i < comm_size; ++i) {
+      int rank = dist.rank_host(i);
+      if (rank == comm_rank)
+        continue;
+
+      //Sending
+      lid_t num_send = offset_send_particles_host(i+1) - offset_send_particles_host(i);
+      if (num_send > 0) {
+        lid_t start_index = offset_send_particles_host(i);
+        PS_Comm_Isend(send_buffer, start_index * record_size, num_send * record_size,
+                      rank, 0, dist.mpi_comm(), send_requests.data() + send_num);
+        send_num++;
+      }
+      //Receiving
+      lid_t num_recv = offset_recv_particles_host(i+1) - offset_recv_particles_host(i);
+      if (num_recv > 0) {
+        lid_t start_index = offset_recv_particles_host(i);
+        PS_Comm_Irecv(recv_buffer, start_index * record_size, num_recv * record_size,
+                      rank, 0, dist.mpi_comm(), recv_requests.data() + recv_num);
+        recv_num++;
+      }
+    }
+  }
+
+  //Unpacks the first np_recv records and converts their element gid to element lid
+  template <class PS, typename GidMapping>
+  void unpackRecvRecords(char* recv_records, lid_t np_recv, GidMapping element_gid_to_lid,
+                         typename PS::kkLidView recv_element,
+                         typename PS::MTVs recv_particle) {
+    typedef PackedLayout<typename PS::Types> Layout;
+    Kokkos::parallel_for(np_recv, KOKKOS_LAMBDA(const lid_t& i) {
+        const gid_t gid = Layout::element(recv_records, i);
+        const lid_t index = element_gid_to_lid.find(gid);
+        recv_element(i) = element_gid_to_lid.value_at(index);
+      });
+    UnpackParticles<typename PS::device_type, typename PS::Types>(recv_particle, recv_records,
+                                                                  np_recv);
+  }
+
+  //Appends the new particles after the np_recv received particles
+  template <class PS>
+  void addNewParticles(lid_t np_recv, typename PS::kkLidView new_particle_elements,
+                       typename PS::MTVs new_particle_info, typename PS::kkLidView new_ptcl_map,
+                       typename PS::kkLidView recv_element, typename PS::MTVs recv_particle) {
+    Kokkos::parallel_for(new_particle_elements.size(), KOKKOS_LAMBDA(const lid_t& i) {
+        recv_element(np_recv + i) = new_particle_elements(i);
+        new_ptcl_map(i) = np_recv + i;
+    });
+    CopyViewsToViews<typename PS::kkLidView, typename PS::Types>(recv_particle,
+                                                                 new_particle_info,
+                                                                 new_ptcl_map);
+  }
+
+  //Sets the new element of the particles sent to other processes to -1
+  template <class PS>
+  void removeSentParticles(PS* ps, typename PS::kkLidView new_element,
+                           typename PS::kkLidView new_process, int comm_rank) {
+    auto removeSentParticles = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
+      const bool sent = new_process(particle_id) != comm_rank;
+      const lid_t elm = new_element(particle_id);
+      //Subtract (its value + 1) to get to -1 if it was sent, 0 otherwise
+      new_element(particle_id) -= (elm + 1) * sent;
+    };
+    parallel_for(ps, removeSentParticles, "removeSentParticles");
+  }
+}
@@ -4,10 +4,11 @@
 #include <SellCSigma.h>
 #include <CSR.hpp>
 namespace pumipic {
-  template <typename FunctionType, typename DataTypes, typename MemSpace>
-  void parallel_for(ParticleStructure<DataTypes, MemSpace>* ps, FunctionType& fn,
+  template <typename FunctionType, typename DataTypes, typename MemSpace, typename Storage>
+  void parallel_for(ParticleStructure<DataTypes, MemSpace, Storage>* ps, FunctionType& fn,
                     std::string s="") {
-    SellCSigma<DataTypes, MemSpace>* scs = dynamic_cast<SellCSigma<DataTypes, MemSpace>*>(ps);
+    typedef SellCSigma<DataTypes, MemSpace, Storage> SCS;
+    SCS* scs = dynamic_cast<SCS*>(ps);
     if (scs) {
       scs->parallel_for(fn, s);
       return;
@@ -22,6 +23,28 @@ namespace pumipic {
     throw 1;
   }
 
+  /* Performs a parallel for over only the active particles of the structure
+     Structures without padding (CSR) use their parallel_for
+  */
+  template <typename FunctionType, typename DataTypes, typename MemSpace, typename Storage>
+  void parallel_for_active(ParticleStructure<DataTypes, MemSpace, Storage>* ps,
+                           FunctionType& fn, std::string s="") {
+    typedef SellCSigma<DataTypes, MemSpace, Storage> SCS;
+    SCS* scs = dynamic_cast<SCS*>(ps);
+    if (scs) {
+      scs->parallel_for_active(fn, s);
+      return;
+    }
+    CSR<DataTypes, MemSpace>* csr = dynamic_cast<CSR<DataTypes, MemSpace>*>(ps);
+    if (csr) {
+      csr->parallel_for(fn, s);
+      return;
+    }
+    fprintf(stderr, "[ERROR] Structure does not support parallel for active used on kernel %s\n",
+            s.c_str());
+    throw 1;
+  }
+
   template <typename MSpace, typename DataTypes, typename MemSpace>
   ParticleStructure<DataTypes, MSpace>* copy(ParticleStructure<DataTypes, MemSpace>* old) {
     SellCSigma<DataTypes, MemSpace>* scs = dynamic_cast<SellCSigma<DataTypes, MemSpace>*>(old);
@@ -30,7 +53,21 @@ namespace pumipic {
     }
     CSR<DataTypes, MemSpace>* csr = dynamic_cast<CSR<DataTypes, MemSpace>*>(old);
     if (csr) {
-      //return csr->template copy<MSpace>();
+      return csr->template copy<MSpace>();
+    }
+    fprintf(stderr, "[ERROR] Structure does not support copy\n");
+    throw 1;
+    return NULL;
+  }
+
+  //Only the SellCSigma supports the AoSoA storage
+  template <typename MSpace, typename DataTypes, typename MemSpace, int TileSize>
+  ParticleStructure<DataTypes, MSpace, AoSoA<TileSize> >*
+  copy(ParticleStructure<DataTypes, MemSpace, AoSoA<TileSize> >* old) {
+    typedef SellCSigma<DataTypes, MemSpace, AoSoA<TileSize> > SCS;
+    SCS* scs = dynamic_cast<SCS*>(old);
+    if (scs) {
+      return scs->template copy<MSpace>();
     }
     fprintf(stderr, "[ERROR] Structure does not support copy\n");
     throw 1;
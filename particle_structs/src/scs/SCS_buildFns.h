@@ -1,8 +1,8 @@
 #pragma once
 namespace pumipic {
-  template<class DataTypes, typename MemSpace>
-  int SellCSigma<DataTypes, MemSpace>::chooseChunkHeight(int maxC,
-                                                         kkLidView ptcls_per_elem) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+  int SellCSigma<DataTypes, MemSpace, Storage>::chooseChunkHeight(int maxC,
+                                                                  kkLidView ptcls_per_elem) {
     lid_t num_elems_with_ptcls = 0;
     Kokkos::parallel_reduce("count_elems", ptcls_per_elem.size(),
                             KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
@@ -15,12 +15,87 @@ namespace pumipic {
     return maxC;
   }
 
-  template<class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes, MemSpace>::constructChunks(PairView ptcls,
-                                                          lid_t& nchunks,
-                                                          kkLidView& chunk_widths,
-                                                          kkLidView& row_element,
-                                                          kkLidView& element_row) {
+  /* Chooses the chunk height (C) and vertical slice size (V) for the sorted particles
+     CHUNK_TEAM_SIZE - C from chooseChunkHeight and the V given to the structure
+     CHUNK_ADAPTIVE - C and V are halved from those values and the pair with the lowest
+                      estimated time of a launch over the structure is chosen
+
+     The estimate is the larger of the work per lane and the longest slice in units of slots:
+       work = (cells + SLICE_COST * C * slices) / concurrency
+       span = min(V, widest chunk) + SLICE_COST
+     where cells includes the padding of each chunk. Device teams are kept at the team size
+     so their warps stay full and only V is adapted.
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::chooseChunkSizes(PairView ptcls,
+                                                                  kkLidView ptcls_per_elem) {
+    //Cost of scheduling a slice relative to visiting one slot
+    const double SLICE_COST = 4;
+    const lid_t maxC = chooseChunkHeight(C_max, ptcls_per_elem);
+    C_ = maxC;
+    V_ = V_max;
+    chunk_cost = 0;
+    chunk_candidates = 1;
+    if (chunk_strat != CHUNK_ADAPTIVE)
+      return;
+
+    const bool on_host = std::is_same<memory_space, Kokkos::HostSpace>::value;
+    const lid_t minC = on_host ? 1 : maxC;
+    const double lanes = std::max(1, static_cast<int>(execution_space().concurrency()));
+    const lid_t num_elems_local = num_elems;
+    chunk_candidates = 0;
+    for (lid_t c = maxC; c >= minC && c > 0; c /= 2) {
+      //Widths of the chunks for this chunk height
+      const lid_t nchunks = num_elems / c + (num_elems % c != 0);
+      kkLidView widths = scratch.get(SCRATCH_CHUNK_WIDTHS, nchunks, false);
+      Kokkos::parallel_for("candidate_chunk_widths", nchunks, KOKKOS_LAMBDA(const lid_t& i) {
+        lid_t width = 0;
+        for (lid_t r = i * c; r < (i + 1) * c && r < num_elems_local; ++r)
+          if (ptcls(r).first > width)
+            width = ptcls(r).first;
+        widths(i) = width;
+      });
+      lid_t cells = 0;
+      Kokkos::parallel_reduce("candidate_cells", nchunks,
+                              KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+        sum += widths(i) * c;
+      }, cells);
+      lid_t widest = 0;
+      Kokkos::parallel_reduce("candidate_widest", nchunks,
+                              KOKKOS_LAMBDA(const lid_t& i, lid_t& wmax) {
+        if (widths(i) > wmax)
+          wmax = widths(i);
+      }, Kokkos::Max<lid_t>(widest));
+
+      for (lid_t v = V_max; v > 0; v /= 2) {
+        //Slices wider than the widest chunk are equivalent to V_max
+        if (v != V_max && v > widest)
+          continue;
+        lid_t slices = 0;
+        Kokkos::parallel_reduce("candidate_slices", nchunks,
+                                KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+          sum += widths(i) / v + (widths(i) % v != 0);
+        }, slices);
+        const double work = (cells + SLICE_COST * c * slices) / lanes;
+        const double span = std::min(v, widest) + SLICE_COST;
+        const double cost = std::max(work, span);
+        //Ties keep the larger sizes
+        if (chunk_candidates == 0 || cost < chunk_cost) {
+          chunk_cost = cost;
+          C_ = c;
+          V_ = v;
+        }
+        ++chunk_candidates;
+      }
+    }
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::constructChunks(PairView ptcls,
+                                                                   lid_t& nchunks,
+                                                                   kkLidView& chunk_widths,
+                                                                   kkLidView& row_element,
+                                                                   kkLidView& element_row) {
     nchunks = num_elems / C_ + (num_elems % C_ != 0);
     chunk_widths = kkLidView("chunk_widths", nchunks);
     row_element = kkLidView("row_element", nchunks * C_);
@@ -89,13 +164,46 @@ namespace pumipic {
               if (chunk_widths[i] != 0)
                 chunk_widths[i] += cw_sum2 / chunk_widths[i];
             });
+        else if (pad_strat == PAD_ADAPTIVE) {
+          //A chunk needs room for the largest expected inflow of its rows
+          Kokkos::View<double*, device_type> chunk_need("chunk_need", nchunks);
+          auto inflow = element_inflow;
+          const lid_t num_inflow = element_inflow.size();
+          Kokkos::parallel_for(nchunks, KOKKOS_LAMBDA(const lid_t& i) {
+              double need = 0;
+              for (lid_t r = i * C_local; r < (i + 1) * C_local; ++r) {
+                const lid_t elem = row_element(r);
+                if (elem < num_inflow && inflow(elem) > need)
+                  need = inflow(elem);
+              }
+              chunk_need(i) = need;
+            });
+          double need_sum = 0;
+          Kokkos::parallel_reduce("sum_chunk_need", nchunks,
+                                  KOKKOS_LAMBDA(const lid_t& i, double& sum) {
+            sum += chunk_need(i);
+          }, need_sum);
+          if (need_sum > 0) {
+            //Split the padding by the inflow, chunks that particles only leave get none
+            const double scale = cw_sum * shuffle_padding / need_sum;
+            Kokkos::parallel_for(nchunks, KOKKOS_LAMBDA(const lid_t& i) {
+                chunk_widths[i] += ceil(chunk_need(i) * scale);
+              });
+          }
+          else
+            //No inflow has been seen yet
+            Kokkos::parallel_for(nchunks, KOKKOS_LAMBDA(const lid_t& i) {
+                if (chunk_widths[i] > 0)
+                  chunk_widths[i] += avg_pad;
+              });
+        }
       }
     }
   }
 
-  template<class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes, MemSpace>::createGlobalMapping(kkGidView elmGid,kkGidView& elm2Gid,
-                                                              GID_Mapping& elmGid2Lid) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::createGlobalMapping(kkGidView elmGid,kkGidView& elm2Gid,
+                                                                       GID_Mapping& elmGid2Lid) {
     elm2Gid = kkGidView("row to element gid", numRows());
     Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
       const gid_t gid = elmGid(i);
@@ -107,11 +215,11 @@ namespace pumipic {
     });
   }
 
-  template<class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes, MemSpace>::constructOffsets(lid_t nChunks, lid_t& nSlices,
-                                                           kkLidView chunk_widths,
-                                                           kkLidView& offs,
-                                                           kkLidView& s2c, lid_t& cap) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::constructOffsets(lid_t nChunks, lid_t& nSlices,
+                                                                    kkLidView chunk_widths,
+                                                                    kkLidView& offs,
+                                                                    kkLidView& s2c, lid_t& cap) {
     kkLidView slices_per_chunk("slices_per_chunk", nChunks + 1);
     const lid_t V_local = V_;
     Kokkos::parallel_for(nChunks, KOKKOS_LAMBDA(const lid_t& i) {
@@ -146,18 +254,112 @@ namespace pumipic {
     exclusive_scan(slice_size, offs);
     cap = getLastValue<lid_t>(offs);
   }
-  template<class DataTypes, typename MemSpace>
-  void SellCSigma<DataTypes, MemSpace>::setupParticleMask(kkLidView mask,
-                                                          PairView ptcls,
-                                                          kkLidView chunk_widths,
-                                                          kkLidView& chunk_starts) {
+  /* Grows the chunks that have rows without enough holes for their incoming particles
+     The extra width for each chunk is appended as new slices after the existing slices so
+       particles that do not move keep their index. Returns false if the new slices do not
+       fit in the current allocation (a full rebuild is needed).
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  bool SellCSigma<DataTypes, MemSpace, Storage>::growChunks(kkLidView new_particles_per_row,
+                                                            kkLidView num_holes_per_row) {
+    //Find the width each chunk needs to fit its most overflowing row
+    kkLidView chunk_growth("chunk_growth", num_chunks);
+    const lid_t C_local = C_;
+    const double padding = shuffle_padding;
+    auto inflow = element_inflow;
+    auto row_to_element_local = row_to_element;
+    const lid_t num_inflow = element_inflow.size();
+    Kokkos::parallel_for("set_chunk_growth", num_chunks, KOKKOS_LAMBDA(const lid_t& i) {
+      lid_t growth = 0;
+      double need = 0;
+      for (lid_t r = i * C_local; r < (i + 1) * C_local; ++r) {
+        const lid_t overflow = new_particles_per_row(r) - num_holes_per_row(r);
+        if (overflow > growth)
+          growth = overflow;
+        const lid_t elem = row_to_element_local(r);
+        if (elem < num_inflow && inflow(elem) > need)
+          need = inflow(elem);
+      }
+      //Pad the growth so the same rows do not overflow again on the next shuffle
+      //  PAD_ADAPTIVE pads at least the inflow expected in the chunk
+      double pad = growth * padding;
+      if (growth > 0 && pad < need)
+        pad = ceil(need);
+      chunk_growth(i) = growth + pad;
+    });
+
+    lid_t grown_slices;
+    lid_t grown_capacity;
+    kkLidView grown_offsets;
+    kkLidView grown_slice_to_chunk;
+    constructOffsets(num_chunks, grown_slices, chunk_growth, grown_offsets,
+                     grown_slice_to_chunk, grown_capacity);
+    const lid_t new_capacity = capacity_ + grown_capacity;
+    if (static_cast<std::size_t>(new_capacity) > current_size)
+      return false;
+
+    //Append the new slices to the end of the offsets/slice_to_chunk
+    const lid_t old_num_slices = num_slices;
+    const lid_t new_num_slices = num_slices + grown_slices;
+    const lid_t old_capacity = capacity_;
+    kkLidView new_offsets("SCS offset", new_num_slices + 1);
+    kkLidView new_slice_to_chunk("slice to chunk", new_num_slices);
+    auto offsets_cpy = offsets;
+    auto slice_to_chunk_cpy = slice_to_chunk;
+    Kokkos::parallel_for("append_slices", new_num_slices + 1, KOKKOS_LAMBDA(const lid_t& i) {
+      if (i < old_num_slices) {
+        new_offsets(i) = offsets_cpy(i);
+        new_slice_to_chunk(i) = slice_to_chunk_cpy(i);
+      }
+      else {
+        new_offsets(i) = old_capacity + grown_offsets(i - old_num_slices);
+        if (i < new_num_slices)
+          new_slice_to_chunk(i) = grown_slice_to_chunk(i - old_num_slices);
+      }
+    });
+
+    //The new cells of the mask are zero initialized (empty)
+    Kokkos::resize(particle_mask, new_capacity);
+    offsets = new_offsets;
+    slice_to_chunk = new_slice_to_chunk;
+    num_slices = new_num_slices;
+    capacity_ = new_capacity;
+    return true;
+  }
+
+  /* Updates the moving average of the net inflow of particles to each element (PAD_ADAPTIVE)
+     The net inflow of a row is the number of particles arriving minus the number leaving in
+       one reshuffle. The history is kept per element since full rebuilds reorder the rows.
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::recordInflow(kkLidView arrivals_per_row,
+                                                              kkLidView departures_per_row) {
+    auto inflow = element_inflow;
+    auto row_to_element_local = row_to_element;
+    const lid_t num_inflow = element_inflow.size();
+    const double weight = padding_history;
+    Kokkos::parallel_for("record_inflow", numRows(), KOKKOS_LAMBDA(const lid_t& r) {
+      const lid_t elem = row_to_element_local(r);
+      if (elem < num_inflow) {
+        const double net = arrivals_per_row(r) - departures_per_row(r);
+        inflow(elem) += weight * (net - inflow(elem));
+      }
+    });
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::setupParticleMask(kkLidView mask,
+                                                                   PairView ptcls,
+                                                                   kkLidView chunk_widths,
+                                                                   kkLidView& chunk_starts) {
     //Get start of each chunk
     auto offsets_cpy = offsets;
     auto slice_to_chunk_cpy = slice_to_chunk;
     chunk_starts = kkLidView("chunk_starts", num_chunks);
     lid_t cap_local = capacity_;
     Kokkos::parallel_for(Kokkos::RangePolicy<>(1,num_chunks), KOKKOS_LAMBDA(const lid_t& i) {
-      chunk_starts[i] = cap_local;
+      //Empty chunks before the first slice start at the beginning
+      chunk_starts[i] = (i <= slice_to_chunk_cpy(0)) ? 0 : cap_local;
     });
     Kokkos::parallel_for(num_slices-1, KOKKOS_LAMBDA(const lid_t& i) {
       const lid_t my_chunk = slice_to_chunk_cpy(i);
@@ -176,13 +378,12 @@ namespace pumipic {
     auto row_to_element_cpy = row_to_element;
     Kokkos::parallel_for(policy, KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
       const lid_t chunk = thread.league_rank();
-      const lid_t chunk_row = thread.team_rank();
       const lid_t rowLen = chunk_widths(chunk);
-      const lid_t start = chunk_starts(chunk) + chunk_row;
-      Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, team_size), [=] (lid_t& j) {
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, team_size), [=] (const lid_t& chunk_row) {
+          const lid_t start = chunk_starts(chunk) + chunk_row;
           const lid_t row = chunk * team_size + chunk_row;
           const lid_t element_id = row_to_element_cpy(row);
-          Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, rowLen), [&] (lid_t& p) {
+          Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, rowLen), [&] (const lid_t& p) {
               const lid_t particle_id = start+(p*team_size);
               if (element_id < ne)
                 mask(particle_id) =  p < ptcls(row).first;
@@ -191,10 +392,10 @@ namespace pumipic {
     });
   }
 
-  template<class DataTypes, typename MemSpace>
-  void SellCSigma<DataTypes, MemSpace>::initSCSData(kkLidView chunk_starts,
-                                                    kkLidView particle_elements,
-                                                    MTVs particle_info) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::initSCSData(kkLidView chunk_starts,
+                                                             kkLidView particle_elements,
+                                                             MTVs particle_info) {
     lid_t given_particles = particle_elements.size();
     assert(given_particles == num_ptcls);
     kkLidView element_to_row_local = element_to_row;
@@ -210,12 +411,30 @@ namespace pumipic {
     });
 
     kkLidView particle_indices("new_particle_scs_indices", given_particles);
-    Kokkos::parallel_for(given_particles, KOKKOS_LAMBDA(const lid_t& i) {
-      lid_t new_elem = particle_elements(i);
-      lid_t new_row = element_to_row_local(new_elem);
-      particle_indices(i) = Kokkos::atomic_fetch_add(&row_index(new_row), C_local);
-    });
+    if (deterministic) {
+      //The particles of each row take its cells in the order they are given
+      kkLidView particle_rows("particle_rows", given_particles);
+      Kokkos::parallel_for(given_particles, KOKKOS_LAMBDA(const lid_t& i) {
+        particle_rows(i) = element_to_row_local(particle_elements(i));
+      });
+      kkLidView particle_order("particle_order", given_particles);
+      kkLidView row_ptcl_start("row_ptcl_start", numRows() + 1);
+      stableGroup(particle_rows, numRows(), particle_order, row_ptcl_start);
+      Kokkos::parallel_for(given_particles, KOKKOS_LAMBDA(const lid_t& i) {
+        const lid_t ptcl = particle_order(i);
+        const lid_t row = particle_rows(ptcl);
+        particle_indices(ptcl) = row_index(row) + (i - row_ptcl_start(row)) * C_local;
+      });
+    }
+    else {
+      Kokkos::parallel_for(given_particles, KOKKOS_LAMBDA(const lid_t& i) {
+        lid_t new_elem = particle_elements(i);
+        lid_t new_row = element_to_row_local(new_elem);
+        particle_indices(i) = Kokkos::atomic_fetch_add(&row_index(new_row), C_local);
+      });
+    }
 
-    CopyViewsToViews<kkLidView, DataTypes>(ptcl_data, particle_info, particle_indices);
+    CopyViewsToPS<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(ptcl_data, particle_info,
+                                                                       particle_indices);
   }
 }
@@ -1,215 +1,454 @@
 #pragma once
-#include <psMemberType.h>
+#include <psMigrate.h>
 namespace pumipic {
 
-  template<class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes, MemSpace>::migrate(kkLidView new_element, kkLidView new_process,
-                                                  Distributor<MemSpace> dist,
-                                                  kkLidView new_particle_elements,
-                                                  MTVs new_particle_info) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::migrate(kkLidView new_element, kkLidView new_process,
+                                                           Distributor<MemSpace> dist,
+                                                           kkLidView new_particle_elements,
+                                                           MTVs new_particle_info) {
     const auto btime = prebarrier();
     Kokkos::Profiling::pushRegion("scs_migrate");
     Kokkos::Timer timer;
+    if (pending_migration.active) {
+      fprintf(stderr, "[ERROR] migrate called before migrate_end of the last migrate_begin\n");
+      migrate_end();
+    }
+    if (migrateStart(new_element, new_process, dist, new_particle_elements, new_particle_info))
+      migrateFinish(new_particle_elements, new_particle_info);
+    else
+      rebuild(new_element, new_particle_elements, new_particle_info);
+    RecordTime(name +" particle migration", timer.seconds(), btime);
+    Kokkos::Profiling::popRegion();
+  }
 
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::migrate_begin(kkLidView new_element,
+                                                               kkLidView new_process,
+                                                               Distributor<MemSpace> dist,
+                                                               kkLidView new_particle_elements,
+                                                               MTVs new_particle_info) {
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("scs_migrate_begin");
+    Kokkos::Timer timer;
+    if (pending_migration.active) {
+      fprintf(stderr, "[ERROR] migrate_begin called before migrate_end of the last "
+              "migrate_begin\n");
+      migrate_end();
+    }
+    PendingMigration& pending = pending_migration;
+    if (migrateStart(new_element, new_process, dist, new_particle_elements, new_particle_info)) {
+      //The particles leaving this process were removed from new_element, they are taken out
+      //  of the structure until migrate_end rebuilds it
+      kkLidView pending_element = pending.new_element;
+      auto particle_mask_local = particle_mask;
+      kkLidView num_left = scratch.get(SCRATCH_NUM_LEFT, 1);
+      auto removeLeaving = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id,
+                                     const bool& mask) {
+        if (mask && pending_element(particle_id) == -1) {
+          particle_mask_local(particle_id) = 0;
+          Kokkos::atomic_fetch_add(&(num_left(0)), 1);
+        }
+      };
+      parallel_for(removeLeaving, "removeLeaving");
+      num_ptcls -= getLastValue<lid_t>(num_left);
+      active_dirty = true;
+    }
+    else {
+      //Nothing is exchanged so migrate_end only rebuilds
+      pending.active = true;
+      pending.exchanging = false;
+      pending.np_recv = 0;
+      pending.new_element = new_element;
+      pending.send_requests.clear();
+      pending.recv_requests.clear();
+    }
+    pending.new_particle_elements = new_particle_elements;
+    pending.new_particle_info = new_particle_info;
+    RecordTime(name + " migrate_begin", timer.seconds(), btime);
+    Kokkos::Profiling::popRegion();
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::migrate_end() {
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("scs_migrate_end");
+    Kokkos::Timer timer;
+    PendingMigration& pending = pending_migration;
+    if (pending.active && pending.exchanging)
+      migrateFinish(pending.new_particle_elements, pending.new_particle_info);
+    else if (pending.active) {
+      rebuild(pending.new_element, pending.new_particle_elements, pending.new_particle_info);
+      pending.active = false;
+      pending.new_element = kkLidView();
+    }
+    pending.new_particle_elements = kkLidView();
+    pending.new_particle_info = NULL;
+    RecordTime(name + " migrate_end", timer.seconds(), btime);
+    Kokkos::Profiling::popRegion();
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  bool SellCSigma<DataTypes, MemSpace, Storage>::migrateStart(kkLidView new_element,
+                                                              kkLidView new_process,
+                                                              Distributor<MemSpace> dist,
+                                                              kkLidView new_particle_elements,
+                                                              MTVs new_particle_info) {
     //Distributor size & rank for performing migration
     int comm_size = dist.num_ranks();
     int comm_rank;
     MPI_Comm_rank(dist.mpi_comm(), &comm_rank);
 
+    //Neighborhood collectives are called by every rank of the communicator, including the
+    //  ranks without other ranks in their Distributor
+    int mpi_size;
+    MPI_Comm_size(dist.mpi_comm(), &mpi_size);
+    const bool use_neighbor = migrate_strat == MIGRATE_NEIGHBOR && !dist.isWorld() &&
+      mpi_size > 1;
+    if (use_neighbor)
+      setupNeighborComm(dist, comm_rank);
+    const int num_neighbors = use_neighbor ? neighbor_ranks.size() : 0;
+    //Senders are discovered instead of exchanging the counts of every process
+    const bool use_nbx = migrate_strat == MIGRATE_NBX && dist.isWorld();
+
     //If serial, skip migration
-    if (comm_size == 1) {
-      rebuild(new_element, new_particle_elements, new_particle_info);
-      RecordTime(name + " particle migration", timer.seconds(), btime);
-      Kokkos::Profiling::popRegion();
-      return;
-    }
+    if (comm_size == 1 && !use_neighbor)
+      return false;
 
     //Count number of particles to send to each process
-    kkLidView num_send_particles("num_send_particles", comm_size + 1);
-    auto count_sending_particles = PS_LAMBDA(lid_t element_id, lid_t particle_id, bool mask) {
-      const lid_t process = new_process(particle_id);
-      const lid_t process_index = dist.index(process);
-      Kokkos::atomic_fetch_add(&(num_send_particles(process_index)),
-                               mask * (process != comm_rank));
-    };
-    parallel_for(count_sending_particles);
+    kkLidView num_send_particles = scratch.get(SCRATCH_NUM_SEND, comm_size + 1);
+    countSendingParticles(this, new_process, dist, comm_rank, num_send_particles);
 
     /********* Send # of particles being sent to each process *********/
-    kkLidView num_recv_particles("num_recv_particles", comm_size + 1);
-    int num_send_ranks = dist.isWorld() ? 0 : comm_size - 1;
-    MPI_Request* count_send_requests = NULL;
-    if (num_send_ranks > 0)
-      count_send_requests = new MPI_Request[num_send_ranks];
-    int num_recv_ranks = dist.isWorld() ? 1 : comm_size - 1;
-    MPI_Request* count_recv_requests = new MPI_Request[num_recv_ranks];
-    if (dist.isWorld())
-      PS_Comm_Ialltoall(num_send_particles, 1, num_recv_particles, 1,
-                        dist.mpi_comm(), count_recv_requests);
-    else {
-      int request_index = 0;
+    kkLidView num_recv_particles = scratch.get(SCRATCH_NUM_RECV, comm_size + 1);
+    //Point to point counts are exchanged by the persistent requests of count_exchange
+    const bool use_exchange = !dist.isWorld() && !use_neighbor;
+    count_recv_requests.resize(use_neighbor ? 1 : 0);
+    //Counts of the neighbors of the graph communicator in the order of its ranks
+    std::vector<int> neighbor_send_counts(num_neighbors), neighbor_recv_counts(num_neighbors);
+    //Nonzero counts sent synchronously to the ranks being sent particles
+    std::vector<int> nbx_send_counts;
+    std::vector<MPI_Request> nbx_requests;
+    //Consecutive consensus rounds alternate tags so a process that finished a round early
+    //  cannot match the counts of the next one
+    const int nbx_tag = 1 + nbx_round % 2;
+    if (use_nbx) {
+      //Every process of a world Distributor migrates so the duplicate is made collectively
+      if (nbx_comm == MPI_COMM_NULL || nbx_parent != dist.mpi_comm()) {
+        if (nbx_comm != MPI_COMM_NULL)
+          MPI_Comm_free(&nbx_comm);
+        nbx_parent = dist.mpi_comm();
+        MPI_Comm_dup(nbx_parent, &nbx_comm);
+      }
+      ++nbx_round;
+      kkLidHostMirror num_send_particles_host = deviceToHost(num_send_particles);
+      std::vector<int> nbx_dests;
       for (int i = 0; i < comm_size; ++i) {
-        int rank = dist.rank_host(i);
-        if (rank != comm_rank) {
-          PS_Comm_Isend(num_send_particles, i, 1, rank, 0, dist.mpi_comm(),
-                        count_send_requests + request_index);
-          PS_Comm_Irecv(num_recv_particles, i, 1, rank, 0, dist.mpi_comm(),
-                        count_recv_requests + request_index);
-          ++request_index;
+        if (num_send_particles_host(i) > 0) {
+          nbx_dests.push_back(i);
+          nbx_send_counts.push_back(num_send_particles_host(i));
         }
       }
+      nbx_requests.resize(nbx_dests.size());
+      for (std::size_t i = 0; i < nbx_dests.size(); ++i)
+        MPI_Issend(&(nbx_send_counts[i]), 1, MPI_INT, nbx_dests[i], nbx_tag, nbx_comm,
+                   &(nbx_requests[i]));
+    }
+    else if (dist.isWorld()) {
+      //A world Distributor has no point to point counts to send
+      std::vector<MPI_Request> no_send_requests;
+      postCountExchange<SellCSigma>(dist, comm_rank, num_send_particles, num_recv_particles,
+                                    no_send_requests, count_recv_requests);
+    }
+    else if (use_neighbor) {
+      kkLidHostMirror num_send_particles_host = deviceToHost(num_send_particles);
+      for (int i = 0, k = 0; i < comm_size; ++i)
+        if (dist.rank_host(i) != comm_rank)
+          neighbor_send_counts[k++] = num_send_particles_host(i);
+      MPI_Ineighbor_alltoall(neighbor_send_counts.data(), 1, MPI_INT,
+                             neighbor_recv_counts.data(), 1, MPI_INT, neighbor_comm,
+                             count_recv_requests.data());
+    }
+    else {
+      setupCountExchange(dist, comm_rank);
+      CountExchange& exchange = count_exchange;
+      Kokkos::deep_copy(exchange.send_counts, num_send_particles);
+      MPI_Startall(exchange.requests.size(), exchange.requests.data());
     }
 
     //Gather sending particle data
     //Perform an ex-sum on num_send_particles & num_recv_particles
-    kkLidView offset_send_particles("offset_send_particles", comm_size+1);
-    kkLidView offset_send_particles_temp("offset_send_particles_temp", comm_size + 1);
+    kkLidView offset_send_particles = scratch.get(SCRATCH_OFFSET_SEND, comm_size + 1, false);
+    kkLidView offset_send_particles_temp = scratch.get(SCRATCH_OFFSET_SEND_TEMP, comm_size + 1,
+                                                       false);
     exclusive_scan(num_send_particles, offset_send_particles);
     Kokkos::deep_copy(offset_send_particles_temp, offset_send_particles);
     kkLidHostMirror offset_send_particles_host = deviceToHost(offset_send_particles);
 
     //Create arrays for particles being sent
     lid_t np_send = offset_send_particles_host(comm_size);
-    kkLidView send_element("send_element", np_send);
-    MTVs send_particle;
-    //Allocate views for each data type into send_particle[type]
-    CreateViews<device_type, DataTypes>(send_particle, np_send);
-    kkLidView send_index("send_particle_index", capacity());
-    auto element_to_gid_local = element_to_gid;
-    auto gatherParticlesToSend = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
-      const lid_t process = new_process(particle_id);
-      const lid_t process_index = dist.index(process);
-      if (mask && process != comm_rank) {
-        send_index(particle_id) =
-          Kokkos::atomic_fetch_add(&(offset_send_particles_temp(process_index)),1);
-        const lid_t index = send_index(particle_id);
-        send_element(index) = element_to_gid_local(new_element(particle_id));
-      }
-    };
-    parallel_for(gatherParticlesToSend);
-    //Copy the values from ptcl_data[type][particle_id] into send_particle[type](index) for each data type
-    CopyParticlesToSend<SellCSigma<DataTypes, MemSpace>, DataTypes>(this, send_particle,
-                                                                    ptcl_data,
-                                                                    new_process,
-                                                                    send_index);
+    //Each particle is packed into one record so every process is sent a single message
+    typedef PackedLayout<DataTypes> Layout;
+    const std::size_t record_size = Layout::size;
+    Kokkos::View<char*, device_type> send_buffer(
+      Kokkos::ViewAllocateWithoutInitializing("send_buffer"), np_send * record_size);
+    char* send_records = send_buffer.data();
+    kkLidView send_index = scratch.get(SCRATCH_SEND_INDEX, capacity(), false);
+    if (deterministic) {
+      //The particles sent to each process are packed in slot order
+      kkLidView send_group = scratch.get(SCRATCH_GROUPS, capacity(), false);
+      Kokkos::deep_copy(send_group, -1);
+      auto groupSending = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
+        const lid_t process = new_process(particle_id);
+        if (mask && process != comm_rank)
+          send_group(particle_id) = dist.index(process);
+      };
+      parallel_for(groupSending);
+      kkLidView send_order = scratch.get(SCRATCH_GROUP_ORDER, capacity(), false);
+      kkLidView send_start = scratch.get(SCRATCH_GROUP_START, comm_size + 1, false);
+      stableGroup(send_group, comm_size, send_order, send_start);
+      auto element_to_gid_local = element_to_gid;
+      Kokkos::parallel_for("set_send_index", np_send, KOKKOS_LAMBDA(const lid_t& i) {
+        const lid_t particle_id = send_order(i);
+        send_index(particle_id) = i;
+        Layout::element(send_records, i) = element_to_gid_local(new_element(particle_id));
+      });
+    }
+    else
+      gatherSendRecords(this, new_element, new_process, dist, comm_rank, element_to_gid,
+                        offset_send_particles_temp, send_index, send_records);
+    //Pack the values from ptcl_data[type][particle_id] into the record send_index(particle_id)
+    PackParticles<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(this, send_records,
+                                                                       ptcl_data, new_process,
+                                                                       send_index, comm_rank);
 
     //Wait until all counts are received
-    PS_Comm_Waitall<device_type>(num_recv_ranks, count_recv_requests, MPI_STATUSES_IGNORE);
-    delete [] count_recv_requests;
+    PS_Comm_Waitall<device_type>(count_recv_requests.size(), count_recv_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+    if (use_nbx)
+      receiveSparseCounts(nbx_requests, num_recv_particles, nbx_comm, nbx_tag);
+    if (use_exchange) {
+      CountExchange& exchange = count_exchange;
+      MPI_Waitall(exchange.requests.size(), exchange.requests.data(), MPI_STATUSES_IGNORE);
+      Kokkos::deep_copy(num_recv_particles, exchange.recv_counts);
+    }
+    if (use_neighbor) {
+      kkLidHostMirror num_recv_particles_host = deviceToHost(num_recv_particles);
+      for (int i = 0, k = 0; i < comm_size; ++i)
+        if (dist.rank_host(i) != comm_rank)
+          num_recv_particles_host(i) = neighbor_recv_counts[k++];
+      Kokkos::deep_copy(num_recv_particles, num_recv_particles_host);
+    }
 
     //Count the number of processes being sent to and recv from
-    lid_t num_sending_to = 0, num_receiving_from = 0;
-    Kokkos::parallel_reduce("sum_senders", comm_size,
-                            KOKKOS_LAMBDA (const lid_t& i, lid_t& lsum ) {
-      lsum += (num_send_particles(i) > 0);
-    }, num_sending_to);
-    Kokkos::parallel_reduce("sum_receivers", comm_size,
-                            KOKKOS_LAMBDA (const lid_t& i, lid_t& lsum ) {
-      lsum += (num_recv_particles(i) > 0);
-    }, num_receiving_from);
-
-    //If no particles are being sent or received, perform rebuild
-    if (num_sending_to == 0 && num_receiving_from == 0) {
-      rebuild(new_element, new_particle_elements, new_particle_info);
-      RecordTime(name +" particle migration", timer.seconds(), btime);
-      Kokkos::Profiling::popRegion();
-      return;
-    }
+    lid_t num_sending_to, num_receiving_from;
+    countMigratingRanks<SellCSigma>(comm_size, num_send_particles, num_recv_particles,
+                                    num_sending_to, num_receiving_from);
+
+    //If no particles are being sent or received, only a rebuild is needed
+    //  (the neighborhood collectives are still called when other ranks exchange particles)
+    if (num_sending_to == 0 && num_receiving_from == 0 && !use_neighbor)
+      return false;
 
     //Offset the recv particles
-    kkLidView offset_recv_particles("offset_recv_particles", comm_size+1);
+    kkLidView offset_recv_particles = scratch.get(SCRATCH_OFFSET_RECV, comm_size + 1, false);
     exclusive_scan(num_recv_particles, offset_recv_particles);
     kkLidHostMirror offset_recv_particles_host = deviceToHost(offset_recv_particles);
-    int np_recv = offset_recv_particles_host(comm_size);
 
-    //wait for send requests if there are any
-    if (count_send_requests) {
-      PS_Comm_Waitall<device_type>(num_send_ranks, count_send_requests, MPI_STATUSES_IGNORE);
-      delete [] count_send_requests;
+    PendingMigration& pending = pending_migration;
+    pending.active = true;
+    pending.exchanging = true;
+    pending.np_recv = offset_recv_particles_host(comm_size);
+    pending.new_element = new_element;
+    pending.send_buffer = send_buffer;
+    pending.recv_buffer = Kokkos::View<char*, device_type>(
+      Kokkos::ViewAllocateWithoutInitializing("recv_buffer"), pending.np_recv * record_size);
+
+    //One message of records is sent to and received from each process
+    if (use_neighbor) {
+      pending.send_requests.clear();
+      pending.recv_requests.resize(1);
+      pending.send_counts.resize(num_neighbors);
+      pending.send_displs.resize(num_neighbors);
+      pending.recv_counts.resize(num_neighbors);
+      pending.recv_displs.resize(num_neighbors);
+      for (int i = 0, k = 0; i < comm_size; ++i) {
+        if (dist.rank_host(i) == comm_rank)
+          continue;
+        pending.send_displs[k] = offset_send_particles_host(i) * record_size;
+        pending.send_counts[k] = (offset_send_particles_host(i + 1) -
+                                  offset_send_particles_host(i)) * record_size;
+        pending.recv_displs[k] = offset_recv_particles_host(i) * record_size;
+        pending.recv_counts[k] = (offset_recv_particles_host(i + 1) -
+                                  offset_recv_particles_host(i)) * record_size;
+        ++k;
+      }
+      PS_Comm_Ineighbor_alltoallv(pending.send_buffer, pending.send_counts.data(),
+                                  pending.send_displs.data(), pending.recv_buffer,
+                                  pending.recv_counts.data(), pending.recv_displs.data(),
+                                  neighbor_comm, pending.recv_requests.data());
     }
+    else
+      postRecordExchange<SellCSigma>(dist, comm_rank, offset_send_particles_host,
+                                     offset_recv_particles_host, pending.send_buffer,
+                                     pending.recv_buffer, pending.send_requests,
+                                     pending.recv_requests);
+
+    /********** Set particles that were sent to non existent on this process *********/
+    removeSentParticles(this, new_element, new_process, comm_rank);
+    return true;
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::migrateFinish(kkLidView new_particle_elements,
+                                                               MTVs new_particle_info) {
+    PendingMigration& pending = pending_migration;
+    PS_Comm_Waitall<device_type>(pending.recv_requests.size(), pending.recv_requests.data(),
+                                 MPI_STATUSES_IGNORE);
 
     //Create arrays for particles being received
+    const lid_t np_recv = pending.np_recv;
     lid_t new_ptcls = new_particle_elements.size();
-    kkLidView recv_element("recv_element", np_recv + new_ptcls);
+    kkLidView recv_element = scratch.get(SCRATCH_RECV_ELEMENT, np_recv + new_ptcls, false);
     MTVs recv_particle;
     //Allocate views for each data type into recv_particle[type]
     CreateViews<device_type, DataTypes>(recv_particle, np_recv + new_ptcls);
 
-    //Get pointers to the data for MPI calls
-    lid_t send_num = 0, recv_num = 0;
-    lid_t num_sends = num_sending_to * (num_types + 1);
-    lid_t num_recvs = num_receiving_from * (num_types + 1);
-    MPI_Request* send_requests = new MPI_Request[num_sends];
-    MPI_Request* recv_requests = new MPI_Request[num_recvs];
-    //Send the particles to each neighbor
-    for (lid_t i = 0; i < comm_size; ++i) {
-      int rank = dist.rank_host(i);
-      if (rank == comm_rank)
-        continue;
-
-      //Sending
-      lid_t num_send = offset_send_particles_host(i+1) - offset_send_particles_host(i);
-      if (num_send > 0) {
-        lid_t start_index = offset_send_particles_host(i);
-        PS_Comm_Isend(send_element, start_index, num_send, rank, 0, dist.mpi_comm(),
-                      send_requests +send_num);
-        send_num++;
-        SendViews<device_type, DataTypes>(send_particle, start_index, num_send, rank, 1,
-                                          dist.mpi_comm(), send_requests + send_num);
-        send_num+=num_types;
-      }
-      //Receiving
-      lid_t num_recv = offset_recv_particles_host(i+1) - offset_recv_particles_host(i);
-      if (num_recv > 0) {
-        lid_t start_index = offset_recv_particles_host(i);
-        PS_Comm_Irecv(recv_element, start_index, num_recv, rank, 0, dist.mpi_comm(),
-                      recv_requests + recv_num);
-        recv_num++;
-        RecvViews<device_type, DataTypes>(recv_particle,start_index, num_recv, rank, 1,
-                                          dist.mpi_comm(), recv_requests + recv_num);
-        recv_num+=num_types;
-      }
-    }
-
-    PS_Comm_Waitall<device_type>(num_recvs, recv_requests, MPI_STATUSES_IGNORE);
-    delete [] recv_requests;
-
-    /********** Convert the received element from element gid to element lid *********/
-    auto element_gid_to_lid_local = element_gid_to_lid;
-    Kokkos::parallel_for(np_recv, KOKKOS_LAMBDA(const lid_t& i) {
-        const gid_t gid = recv_element(i);
-        const lid_t index = element_gid_to_lid_local.find(gid);
-        recv_element(i) = element_gid_to_lid_local.value_at(index);
-      });
-
-    /********** Set particles that were sent to non existent on this process *********/
-    auto removeSentParticles = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
-      const bool sent = new_process(particle_id) != comm_rank;
-      const lid_t elm = new_element(particle_id);
-      //Subtract (its value + 1) to get to -1 if it was sent, 0 otherwise
-      new_element(particle_id) -= (elm + 1) * sent;
-    };
-    parallel_for(removeSentParticles);
+    /********** Unpack the received records and convert the element gid to element lid *****/
+    unpackRecvRecords<SellCSigma>(pending.recv_buffer.data(), np_recv, element_gid_to_lid,
+                                  recv_element, recv_particle);
 
     /********** Add new particles to the migrated particles *********/
-    kkLidView new_ptcl_map("new_ptcl_map", new_ptcls);
-    Kokkos::parallel_for(new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
-        recv_element(np_recv + i) = new_particle_elements(i);
-        new_ptcl_map(i) = np_recv + i;
-    });
-    CopyViewsToViews<kkLidView, DataTypes>(recv_particle, new_particle_info, new_ptcl_map);
-
+    kkLidView new_ptcl_map = scratch.get(SCRATCH_NEW_PTCL_MAP, new_ptcls, false);
+    addNewParticles<SellCSigma>(np_recv, new_particle_elements, new_particle_info, new_ptcl_map,
+                                recv_element, recv_particle);
 
     /********** Combine and shift particles to their new destination **********/
-    rebuild(new_element, recv_element, recv_particle);
+    rebuild(pending.new_element, recv_element, recv_particle);
 
     //Cleanup
-    PS_Comm_Waitall<device_type>(num_sends, send_requests, MPI_STATUSES_IGNORE);
-    delete [] send_requests;
-    destroyViews<DataTypes, memory_space>(send_particle);
+    PS_Comm_Waitall<device_type>(pending.send_requests.size(), pending.send_requests.data(),
+                                 MPI_STATUSES_IGNORE);
     destroyViews<DataTypes, memory_space>(recv_particle);
+    pending.active = false;
+    pending.new_element = kkLidView();
+    pending.send_buffer = Kokkos::View<char*, device_type>();
+    pending.recv_buffer = Kokkos::View<char*, device_type>();
+  }
 
-    RecordTime(name +" particle migration", timer.seconds(), btime);
+  /* Receives the particle counts of a world Distributor with a nonblocking consensus (NBX)
+     Counts from unknown senders are probed for until the synchronous sends of this process
+       are matched and then until every process has entered the nonblocking barrier
+     Only the processes exchanging particles send messages
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::receiveSparseCounts(
+      std::vector<MPI_Request>& send_requests, kkLidView num_recv_particles, MPI_Comm comm,
+      int tag) {
+    std::vector<int> sources, counts;
+    MPI_Request barrier_request;
+    bool in_barrier = false;
+    int done = 0;
+    while (!done) {
+      int flag;
+      MPI_Status status;
+      MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+      if (flag) {
+        int count;
+        MPI_Recv(&count, 1, MPI_INT, status.MPI_SOURCE, tag, comm, MPI_STATUS_IGNORE);
+        sources.push_back(status.MPI_SOURCE);
+        counts.push_back(count);
+      }
+      if (in_barrier)
+        MPI_Test(&barrier_request, &done, MPI_STATUS_IGNORE);
+      else {
+        int sent;
+        MPI_Testall(send_requests.size(), send_requests.data(), &sent, MPI_STATUSES_IGNORE);
+        if (sent) {
+          MPI_Ibarrier(comm, &barrier_request);
+          in_barrier = true;
+        }
+      }
+    }
+    //The rank of a world Distributor is its index
+    kkLidHostMirror num_recv_particles_host = deviceToHost(num_recv_particles);
+    for (std::size_t i = 0; i < sources.size(); ++i)
+      num_recv_particles_host(sources[i]) = counts[i];
+    Kokkos::deep_copy(num_recv_particles, num_recv_particles_host);
+  }
 
-    Kokkos::Profiling::popRegion();
+  /* Creates the persistent requests of the point to point count exchange with the ranks of
+       dist, one send and one receive of a count with every other rank
+     The requests are kept until the communicator or the ranks of the Distributor change
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::setupCountExchange(
+      const Distributor<MemSpace>& dist, int comm_rank) {
+    CountExchange& exchange = count_exchange;
+    std::vector<int> ranks(dist.num_ranks());
+    for (int i = 0; i < dist.num_ranks(); ++i)
+      ranks[i] = dist.rank_host(i);
+    if (exchange.comm == dist.mpi_comm() && ranks == exchange.ranks)
+      return;
+    freeCountExchange();
+    exchange.comm = dist.mpi_comm();
+    exchange.ranks = ranks;
+    //Sized like the scratch counts so they are copied whole, the entry of this rank stays 0
+    exchange.send_counts = Kokkos::View<lid_t*, Kokkos::HostSpace>("send_counts",
+                                                                   ranks.size() + 1);
+    exchange.recv_counts = Kokkos::View<lid_t*, Kokkos::HostSpace>("recv_counts",
+                                                                   ranks.size() + 1);
+    for (std::size_t i = 0; i < ranks.size(); ++i) {
+      if (ranks[i] == comm_rank)
+        continue;
+      MPI_Request request;
+      MPI_Send_init(&(exchange.send_counts(i)), 1, MpiType<lid_t>::mpitype(), ranks[i], 0,
+                    exchange.comm, &request);
+      exchange.requests.push_back(request);
+      MPI_Recv_init(&(exchange.recv_counts(i)), 1, MpiType<lid_t>::mpitype(), ranks[i], 0,
+                    exchange.comm, &request);
+      exchange.requests.push_back(request);
+    }
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::freeCountExchange() {
+    CountExchange& exchange = count_exchange;
+    for (std::size_t i = 0; i < exchange.requests.size(); ++i)
+      MPI_Request_free(&(exchange.requests[i]));
+    exchange.requests.clear();
+    exchange.ranks.clear();
+    exchange.comm = MPI_COMM_NULL;
+  }
+
+  /* Builds the distributed graph communicator over the ranks of dist for MIGRATE_NEIGHBOR
+     The communicator is kept until markNeighborsStale is called, creating it is collective
+       so every process decides to rebuild it without communicating
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::setupNeighborComm(
+      const Distributor<MemSpace>& dist, int comm_rank) {
+    std::vector<int> ranks;
+    for (int i = 0; i < dist.num_ranks(); ++i)
+      if (dist.rank_host(i) != comm_rank)
+        ranks.push_back(dist.rank_host(i));
+    const bool changed = neighbor_comm == MPI_COMM_NULL || neighbor_parent != dist.mpi_comm() ||
+      ranks != neighbor_ranks;
+    if (neighbor_comm != MPI_COMM_NULL && !neighbor_stale) {
+      if (!changed)
+        return;
+      //The graph is still rebuilt, which only completes if every process changed its ranks
+      fprintf(stderr, "[ERROR] The Distributor ranks of rank %d changed without "
+              "markNeighborsStale\n", comm_rank);
+    }
+    neighbor_stale = false;
+    if (neighbor_comm != MPI_COMM_NULL)
+      MPI_Comm_free(&neighbor_comm);
+    //The Distributors are symmetric so the sources and destinations are the same ranks
+    neighbor_ranks = ranks;
+    neighbor_parent = dist.mpi_comm();
+    MPI_Dist_graph_create_adjacent(dist.mpi_comm(), ranks.size(), ranks.data(), MPI_UNWEIGHTED,
+                                   ranks.size(), ranks.data(), MPI_UNWEIGHTED, MPI_INFO_NULL,
+                                   0, &neighbor_comm);
   }
 }
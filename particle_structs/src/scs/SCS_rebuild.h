@@ -1,17 +1,25 @@
 #pragma once
 #include <psMemberType.h>
 namespace pumipic {
-  template<class DataTypes, typename MemSpace>
-    bool SellCSigma<DataTypes,MemSpace>::reshuffle(kkLidView new_element,
-                                                   kkLidView new_particle_elements,
-                                                   MTVs new_particles) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+    bool SellCSigma<DataTypes, MemSpace, Storage>::reshuffle(kkLidView new_element,
+                                                             kkLidView new_particle_elements,
+                                                             MTVs new_particles) {
+    active_dirty = true;
     //Count current/new particles per row
-    kkLidView new_particles_per_row("new_particles_per_row", numRows()+1);
-    kkLidView num_holes_per_row("num_holes_per_row", numRows());
+    kkLidView new_particles_per_row = scratch.get(SCRATCH_NEW_PER_ROW, numRows()+1);
+    kkLidView num_holes_per_row = scratch.get(SCRATCH_HOLES_PER_ROW, numRows());
+    //PAD_ADAPTIVE also counts the particles leaving each row
+    const bool track_inflow = pad_strat == PAD_ADAPTIVE;
+    kkLidView departures_per_row;
+    if (track_inflow)
+      departures_per_row = scratch.get(SCRATCH_DEPARTURES_PER_ROW, numRows());
     kkLidView element_to_row_local = element_to_row;
     auto particle_mask_local = particle_mask;
+    //An empty new_element keeps every particle in its element (only adds particles)
+    const bool stay = new_element.size() == 0;
     auto countNewParticles = PS_LAMBDA(lid_t element_id,lid_t particle_id, bool mask){
-      const lid_t new_elem = new_element(particle_id);
+      const lid_t new_elem = stay ? element_id : new_element(particle_id);
 
       const lid_t row = element_to_row_local(element_id);
       const bool is_particle = mask & new_elem != -1;
@@ -20,6 +28,8 @@ namespace pumipic {
         const lid_t new_row = element_to_row_local(new_elem);
         Kokkos::atomic_fetch_add(&(new_particles_per_row(new_row)), mask);
       }
+      if (track_inflow && mask && (!is_particle || is_moving))
+        Kokkos::atomic_fetch_add(&(departures_per_row(row)), 1);
       particle_mask_local(particle_id) = is_particle;
       Kokkos::atomic_fetch_add(&(num_holes_per_row(row)), !is_particle);
     };
@@ -30,71 +40,84 @@ namespace pumipic {
         const lid_t new_row = element_to_row_local(new_elem);
         Kokkos::atomic_fetch_add(&(new_particles_per_row(new_row)), 1);
       });
+    //Record the inflow before checking for overflow so a failed reshuffle still informs the
+    //  padding of the full rebuild
+    if (track_inflow)
+      recordInflow(new_particles_per_row, departures_per_row);
 
-    //Check if the particles will fit in current structure
-    kkLidView fail("fail",1);
-    Kokkos::parallel_for(numRows(), KOKKOS_LAMBDA(const lid_t& i) {
+    //Check if the particles will fit in current structure and count the holes
+    kkLidView fail = scratch.get(SCRATCH_FAIL, 1);
+    lid_t num_holes = 0;
+    Kokkos::parallel_reduce("reshuffle_check", numRows(),
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
         if( new_particles_per_row(i) > num_holes_per_row(i))
           fail(0) = 1;
-      });
+        sum += num_holes_per_row(i);
+      }, num_holes);
+    //Particles that stay on the process keep a slot, the rest of the new count is arithmetic
+    const lid_t num_remaining_ptcls = capacity() - num_holes;
+    const lid_t num_new_ptcls = new_particle_elements.size();
 
     if (getLastValue<lid_t>(fail)) {
-      //Reshuffle fails
-      return false;
+      //Grow only the chunks with overflowing rows, otherwise reshuffle fails
+      if (!growChunks(new_particles_per_row, num_holes_per_row))
+        return false;
+      particle_mask_local = particle_mask;
     }
 
     //Offset moving particles
-    kkLidView offset_new_particles("offset_new_particles", numRows() + 1);
-    kkLidView counting_offset_index("counting_offset_index", numRows() + 1);
+    kkLidView offset_new_particles = scratch.get(SCRATCH_OFFSET_NEW, numRows() + 1, false);
+    kkLidView counting_offset_index = scratch.get(SCRATCH_COUNTING_OFFSET, numRows() + 1,
+                                                  false);
     exclusive_scan(new_particles_per_row, offset_new_particles);
     Kokkos::deep_copy(counting_offset_index, offset_new_particles);
 
     int num_moving_ptcls = getLastValue<lid_t>(offset_new_particles);
     if (num_moving_ptcls == 0) {
-      Kokkos::parallel_reduce(capacity(), KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
-          sum += particle_mask_local(i);
-        }, num_ptcls);
+      num_ptcls = num_remaining_ptcls;
       return true;
     }
-    kkLidView movingPtclIndices("movingPtclIndices", num_moving_ptcls);
-    kkLidView isFromSCS("isFromSCS", num_moving_ptcls);
-    //Gather moving particle list
-    auto gatherMovingPtcls = PS_LAMBDA(const lid_t& element_id,const lid_t& particle_id, const bool& mask){
-      const lid_t new_elem = new_element(particle_id);
-
-      const lid_t row = element_to_row_local(element_id);
-      const bool is_moving = new_elem != -1 & new_elem != element_id & mask;
-      if (is_moving) {
-        const lid_t new_row = element_to_row_local(new_elem);
-        const lid_t index = Kokkos::atomic_fetch_add(&(counting_offset_index(new_row)), 1);
-        movingPtclIndices(index) = particle_id;
-        isFromSCS(index) = 1;
-      }
-    };
-    parallel_for(gatherMovingPtcls, "gatherMovingPtcls");
-
-    //Gather new particles in list
-    Kokkos::parallel_for("reshuffle_count", new_particle_elements.size(), KOKKOS_LAMBDA(const lid_t& i) {
-        const lid_t new_elem = new_particle_elements(i);
-        const lid_t new_row = element_to_row_local(new_elem);
-        const lid_t index = Kokkos::atomic_fetch_add(&(counting_offset_index(new_row)), 1);
-        movingPtclIndices(index) = i;
-        isFromSCS(index) = 0;
-      });
-
-    //Assign hole index for moving particles
-    kkLidView holes("holeIndex", num_moving_ptcls);
-    auto assignPtclsToHoles = PS_LAMBDA(const lid_t& element_id,const lid_t& particle_id, const bool& mask){
-      const lid_t row = element_to_row_local(element_id);
-      if (!mask) {
-        const lid_t moving_index = Kokkos::atomic_fetch_add(&(offset_new_particles(row)),1);
-        const lid_t max_index = counting_offset_index(row);
-        if (moving_index < max_index) {
-          holes(moving_index) = particle_id;
+    kkLidView movingPtclIndices = scratch.get(SCRATCH_MOVING_INDICES, num_moving_ptcls, false);
+    kkLidView isFromSCS = scratch.get(SCRATCH_FROM_SCS, num_moving_ptcls, false);
+    kkLidView holes = scratch.get(SCRATCH_HOLES, num_moving_ptcls, false);
+    if (deterministic)
+      orderShuffle(new_element, new_particle_elements, offset_new_particles,
+                   new_particles_per_row, movingPtclIndices, isFromSCS, holes);
+    else {
+      //The hole counts are reused as the number of holes claimed in each row
+      Kokkos::deep_copy(num_holes_per_row, 0);
+      kkLidView claimed_holes_per_row = num_holes_per_row;
+      //Gather the moving particles and assign holes to them in a single pass
+      auto gatherMovingPtcls = PS_LAMBDA(const lid_t& element_id,const lid_t& particle_id, const bool& mask){
+        const lid_t row = element_to_row_local(element_id);
+        if (mask) {
+          const lid_t new_elem = stay ? element_id : new_element(particle_id);
+          const bool is_moving = new_elem != -1 & new_elem != element_id;
+          if (is_moving) {
+            const lid_t new_row = element_to_row_local(new_elem);
+            const lid_t index = Kokkos::atomic_fetch_add(&(counting_offset_index(new_row)), 1);
+            movingPtclIndices(index) = particle_id;
+            isFromSCS(index) = 1;
+          }
         }
-      }
-    };
-    parallel_for(assignPtclsToHoles, "assignPtclsToHoles");
+        else {
+          //Cells added by growChunks are empty and beyond the size of new_element
+          const lid_t hole_index = Kokkos::atomic_fetch_add(&(claimed_holes_per_row(row)), 1);
+          if (hole_index < new_particles_per_row(row))
+            holes(offset_new_particles(row) + hole_index) = particle_id;
+        }
+      };
+      parallel_for(gatherMovingPtcls, "gatherMovingPtcls");
+
+      //Gather new particles in list
+      Kokkos::parallel_for("reshuffle_count", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+          const lid_t new_elem = new_particle_elements(i);
+          const lid_t new_row = element_to_row_local(new_elem);
+          const lid_t index = Kokkos::atomic_fetch_add(&(counting_offset_index(new_row)), 1);
+          movingPtclIndices(index) = i;
+          isFromSCS(index) = 0;
+        });
+    }
 
     //Update particle mask
     Kokkos::parallel_for(num_moving_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
@@ -107,31 +130,30 @@ namespace pumipic {
       });
 
     //Shift SCS values
-    ShuffleParticles<SellCSigma<DataTypes, MemSpace>, DataTypes>(ptcl_data,
+    ShuffleParticles<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(ptcl_data,
                                                                  new_particles,
                                                                  movingPtclIndices, holes,
                                                                  isFromSCS);
 
-    //Count number of active particles
-    Kokkos::parallel_reduce(capacity(), KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
-        sum += particle_mask_local(i);
-      }, num_ptcls);
+    //Moving particles only change slots so the count changes by the new particles
+    num_ptcls = num_remaining_ptcls + num_new_ptcls;
     return true;
   }
 
-  template<class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes,MemSpace>::rebuild(kkLidView new_element,
-                                                 kkLidView new_particle_elements,
-                                                 MTVs new_particles) {
+  template<class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::rebuild(kkLidView new_element,
+                                                           kkLidView new_particle_elements,
+                                                           MTVs new_particles) {
     const auto btime = prebarrier();
     Kokkos::Profiling::pushRegion("scs_rebuild");
     Kokkos::Timer timer;
+    active_dirty = true;
     int comm_rank, comm_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
 
     //Count particles including new and leaving
-    kkLidView new_particles_per_elem("new_particles_per_elem", numRows());
+    kkLidView new_particles_per_elem = scratch.get(SCRATCH_NEW_PER_ELEM, numRows());
     auto countNewParticles = PS_LAMBDA(lid_t element_id,lid_t particle_id, bool mask){
       const lid_t new_elem = new_element(particle_id);
       if (new_elem != -1)
@@ -152,12 +174,9 @@ namespace pumipic {
 
     //If there are no particles left, then destroy the structure
     if(activePtcls == 0) {
+      //parallel_for skips structures without particles so the mask is cleared directly
       num_ptcls = 0;
-      auto local_mask = particle_mask;
-      auto resetMask = PS_LAMBDA(lid_t e, lid_t p, bool mask) {
-        local_mask(p) = false;
-      };
-      parallel_for(resetMask, "resetMask");
+      Kokkos::deep_copy(particle_mask, 0);
 
       RecordTime(name +" rebuild", timer.seconds(), btime);
       Kokkos::Profiling::popRegion();
@@ -166,23 +185,30 @@ namespace pumipic {
     }
 
     //If tryShuffling is on and shuffling works then rebuild is complete
-    if (tryShuffling && reshuffle(new_element, new_particle_elements, new_particles)) {
-      RecordTime(name + " rebuild", timer.seconds(), btime);
-      Kokkos::Profiling::popRegion();
-      return;
+    //  (the holes of a structure without particles are not visited by parallel_for)
+    if (tryShuffling && num_ptcls > 0) {
+      ++num_reshuffles;
+      if (reshuffle(new_element, new_particle_elements, new_particles)) {
+        sortRowsByMember();
+        RecordTime(name + " rebuild", timer.seconds(), btime);
+        Kokkos::Profiling::popRegion();
+        return;
+      }
+      ++num_failed_reshuffles;
     }
 
     lid_t new_num_ptcls = activePtcls;
 
-    int new_C = chooseChunkHeight(C_max, new_particles_per_elem);
-    int old_C = C_;
-    C_ = new_C;
     //Perform sorting
     Kokkos::Profiling::pushRegion("Sorting");
     PairView ptcls;
     sigmaSort(ptcls,num_elems,new_particles_per_elem, sigma);
     Kokkos::Profiling::popRegion();
 
+    int old_C = C_;
+    chooseChunkSizes(ptcls, new_particles_per_elem);
+    int new_C = C_;
+
     // Number of chunks without vertical slicing
     kkLidView chunk_widths;
     lid_t new_nchunks;
@@ -201,15 +227,24 @@ namespace pumipic {
     //Allocate the SCS
     lid_t new_cap = getLastValue<lid_t>(new_offsets);
     kkLidView new_particle_mask("new_particle_mask", new_cap);
-    if (swap_size < new_cap) {
-      destroyViews<DataTypes, memory_space>(scs_data_swap);
-      CreateViews<device_type, DataTypes>(scs_data_swap, new_cap*1.1);
+    //REBUILD_IN_PLACE moves the particles within the current allocation unless the new
+    //  capacity does not fit or the allocation should shrink
+    const bool in_place = rebuild_strat == REBUILD_IN_PLACE &&
+      static_cast<std::size_t>(new_cap) <= current_size &&
+      !(shrink_threshold > 0 && new_cap < current_size * shrink_threshold);
+    //Grow the swap if it is too small and shrink it if the new capacity uses less than
+    //  shrink_threshold of it, the gap between the two keeps sizes near the limits stable
+    const bool shrink = shrink_threshold > 0 && new_cap < swap_size * shrink_threshold;
+    if (!in_place && (swap_size < static_cast<std::size_t>(new_cap) || shrink)) {
+      if (scs_data_swap)
+        StorageViews<Storage, device_type, DataTypes>::destroy(scs_data_swap);
+      StorageViews<Storage, device_type, DataTypes>::create(scs_data_swap, new_cap*1.1);
       swap_size = new_cap * 1.1;
     }
 
 
     /* //Fill the SCS */
-    kkLidView interior_slice_of_chunk("interior_slice_of_chunk", new_num_slices);
+    kkLidView interior_slice_of_chunk = scratch.get(SCRATCH_INTERIOR_SLICE, new_num_slices);
     Kokkos::parallel_for("set_interior_slice_of_chunk", Kokkos::RangePolicy<>(1,new_num_slices),
                          KOKKOS_LAMBDA(const lid_t& i) {
                            const lid_t my_chunk = new_slice_to_chunk(i);
@@ -217,7 +252,7 @@ namespace pumipic {
                            interior_slice_of_chunk(i) = my_chunk == prev_chunk;
                          });
     lid_t C_local = C_;
-    kkLidView element_index("element_index", new_nchunks * C_local);
+    kkLidView element_index = scratch.get(SCRATCH_ELEMENT_INDEX, new_nchunks * C_local);
     Kokkos::parallel_for("set_element_index", new_num_slices, KOKKOS_LAMBDA(const lid_t& i) {
         const lid_t chunk = new_slice_to_chunk(i);
         for (lid_t e = 0; e < C_local; ++e) {
@@ -226,35 +261,53 @@ namespace pumipic {
         }
       });
     C_ = old_C;
-    kkLidView new_indices("new_scs_index", capacity());
-    auto copySCS = PS_LAMBDA(lid_t elm_id, lid_t ptcl_id, bool mask) {
-      const lid_t new_elem = new_element(ptcl_id);
-      //TODO remove conditional
-      if (mask && new_elem != -1) {
-        const lid_t new_row = new_element_to_row(new_elem);
-        new_indices(ptcl_id) = Kokkos::atomic_fetch_add(&element_index(new_row), new_C);
-        const lid_t new_index = new_indices(ptcl_id);
-        new_particle_mask(new_index) = 1;
-      }
-    };
-    parallel_for(copySCS);
-
-    CopyPSToPS<SellCSigma<DataTypes, MemSpace>, DataTypes>(this, scs_data_swap, ptcl_data,
-                                                           new_element, new_indices);
-    //Add new particles
+    kkLidView new_indices = scratch.get(SCRATCH_NEW_INDICES, capacity(), false);
     lid_t num_new_ptcls = new_particle_elements.size();
-    kkLidView new_particle_indices("new_particle_scs_indices", num_new_ptcls);
-
-    Kokkos::parallel_for("set_new_particle", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
-        lid_t new_elem = new_particle_elements(i);
-        lid_t new_row = new_element_to_row(new_elem);
-        new_particle_indices(i) = Kokkos::atomic_fetch_add(&element_index(new_row), new_C);
-        lid_t new_index = new_particle_indices(i);
-        new_particle_mask(new_index) = 1;
-      });
+    kkLidView new_particle_indices = scratch.get(SCRATCH_NEW_PTCL_INDICES, num_new_ptcls,
+                                                 false);
+    if (deterministic)
+      orderRebuild(new_element, new_particle_elements, new_element_to_row, element_index,
+                   new_nchunks * new_C, new_C, new_indices, new_particle_indices,
+                   new_particle_mask);
+    else {
+      auto copySCS = PS_LAMBDA(lid_t elm_id, lid_t ptcl_id, bool mask) {
+        const lid_t new_elem = new_element(ptcl_id);
+        //TODO remove conditional
+        if (mask && new_elem != -1) {
+          const lid_t new_row = new_element_to_row(new_elem);
+          new_indices(ptcl_id) = Kokkos::atomic_fetch_add(&element_index(new_row), new_C);
+          const lid_t new_index = new_indices(ptcl_id);
+          new_particle_mask(new_index) = 1;
+        }
+        else
+          new_indices(ptcl_id) = -1;
+      };
+      parallel_for(copySCS);
+      //New particles are placed after the particles already in the structure
+      Kokkos::parallel_for("set_new_particle", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+          lid_t new_elem = new_particle_elements(i);
+          lid_t new_row = new_element_to_row(new_elem);
+          new_particle_indices(i) = Kokkos::atomic_fetch_add(&element_index(new_row), new_C);
+          lid_t new_index = new_particle_indices(i);
+          new_particle_mask(new_index) = 1;
+        });
+    }
 
+    if (in_place) {
+      //copySCS does not run without particles so there is nothing to move
+      if (num_ptcls > 0)
+        permuteInPlace(new_indices, new_cap);
+    }
+    else
+      CopyPSToPS<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(this, scs_data_swap,
+                                                                      ptcl_data, new_element,
+                                                                      new_indices);
+    MTVs new_data = in_place ? ptcl_data : scs_data_swap;
+    //Add new particles
     if (new_particle_elements.size() > 0)
-      CopyViewsToViews<kkLidView, DataTypes>(scs_data_swap, new_particles, new_particle_indices);
+      CopyViewsToPS<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(new_data,
+                                                                         new_particles,
+                                                                         new_particle_indices);
 
     //set scs to point to new values
     C_ = new_C;
@@ -268,15 +321,314 @@ namespace pumipic {
     offsets = new_offsets;
     slice_to_chunk = new_slice_to_chunk;
     particle_mask = new_particle_mask;
-    MTVs tmp = ptcl_data;
-    ptcl_data = scs_data_swap;
-    scs_data_swap = tmp;
-    std::size_t tmp_size = current_size;
-    current_size = swap_size;
-    swap_size = tmp_size;
+    if (!in_place) {
+      MTVs tmp = ptcl_data;
+      ptcl_data = scs_data_swap;
+      scs_data_swap = tmp;
+      std::size_t tmp_size = current_size;
+      current_size = swap_size;
+      swap_size = tmp_size;
+    }
+    if (!keep_swap && scs_data_swap) {
+      StorageViews<Storage, device_type, DataTypes>::destroy(scs_data_swap);
+      scs_data_swap = NULL;
+      swap_size = 0;
+    }
+    sortRowsByMember();
 
     RecordTime(name +" rebuild", timer.seconds(), btime);
     Kokkos::Profiling::popRegion();
   }
 
+  /* Moves each particle to new_indices within ptcl_data (REBUILD_IN_PLACE and sortRows)
+     Particles with a new index of -1 do not stay in the structure.
+     The slot each new slot is filled from forms paths and cycles. A path starts at a slot
+       whose particle leaves or that was empty and is followed by one thread pulling each
+       particle into the slot freed before it. A cycle is broken by staging the particle of
+       its lowest slot, found by pointer jumping, with at most staging_size cycles at a time.
+     Paths and cycles are walked serially by one thread each so the time of the move is
+       bounded by the longest path or cycle rather than the number of particles.
+     The temporaries are not pooled so at most five new_cap arrays are held during the move
+       and none are kept after it.
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::permuteInPlace(kkLidView new_indices,
+                                                                lid_t new_cap) {
+    Kokkos::Profiling::pushRegion("scs_permuteInPlace");
+    kkLidView source(Kokkos::ViewAllocateWithoutInitializing("permute_source"), new_cap);
+    Kokkos::deep_copy(source, -1);
+    kkLidView state("permute_state", new_cap);
+    const lid_t old_cap = capacity_;
+    Kokkos::parallel_for("set_permute_source", old_cap, KOKKOS_LAMBDA(const lid_t& i) {
+      if (new_indices(i) != -1)
+        source(new_indices(i)) = i;
+    });
+    Kokkos::parallel_for("set_permute_heads", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+      const lid_t src = source(slot);
+      const bool stays = slot < old_cap && new_indices(slot) != -1;
+      if (src != -1 && src != slot && !stays)
+        state(slot) = PERMUTE_PATH_HEAD;
+    });
+    Kokkos::parallel_for("mark_permute_paths", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+      if (state(slot) == PERMUTE_PATH_HEAD) {
+        lid_t cur = source(slot);
+        while (cur < new_cap && source(cur) != -1) {
+          state(cur) = PERMUTE_PATH;
+          cur = source(cur);
+        }
+      }
+    });
+    //The remaining slots that are filled by another slot are on cycles
+    lid_t num_cycle_slots = 0;
+    Kokkos::parallel_reduce("count_permute_cycles", new_cap,
+                            KOKKOS_LAMBDA(const lid_t& slot, lid_t& sum) {
+      const lid_t src = source(slot);
+      if (state(slot) == PERMUTE_NONE && src != -1 && src != slot) {
+        state(slot) = PERMUTE_CYCLE;
+        ++sum;
+      }
+    }, num_cycle_slots);
+
+    lid_t num_leaders = 0;
+    kkLidView leaders;
+    if (num_cycle_slots > 0) {
+      //After each round the label of a slot is the lowest of twice as many slots after it
+      //  label and jump are updated in separate kernels so one spare array is enough
+      kkLidView label(Kokkos::ViewAllocateWithoutInitializing("permute_label"), new_cap + 1);
+      kkLidView jump(Kokkos::ViewAllocateWithoutInitializing("permute_jump"), new_cap + 1);
+      kkLidView next(Kokkos::ViewAllocateWithoutInitializing("permute_next"), new_cap + 1);
+      Kokkos::parallel_for("init_permute_labels", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+        label(slot) = slot;
+        jump(slot) = state(slot) == PERMUTE_CYCLE ? source(slot) : slot;
+      });
+      for (lid_t span = 1; span < num_cycle_slots; span *= 2) {
+        Kokkos::parallel_for("jump_permute_labels", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+          const lid_t other = label(jump(slot));
+          next(slot) = other < label(slot) ? other : label(slot);
+        });
+        kkLidView tmp = label;
+        label = next;
+        next = tmp;
+        Kokkos::parallel_for("jump_permute_jumps", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+          next(slot) = jump(jump(slot));
+        });
+        tmp = jump;
+        jump = next;
+        next = tmp;
+      }
+      //The spare and jump arrays are reused to flag and count the lowest slot of each cycle
+      kkLidView is_leader = next;
+      kkLidView leader_offset = jump;
+      Kokkos::parallel_for("set_permute_leaders", new_cap + 1, KOKKOS_LAMBDA(const lid_t& slot) {
+        is_leader(slot) = slot < new_cap && state(slot) == PERMUTE_CYCLE && label(slot) == slot;
+      });
+      exclusive_scan(is_leader, leader_offset);
+      num_leaders = getLastValue<lid_t>(leader_offset);
+      //The flags are no longer read once they are scanned so they hold the leader list
+      leaders = is_leader;
+      Kokkos::parallel_for("list_permute_leaders", new_cap, KOKKOS_LAMBDA(const lid_t& slot) {
+        if (leader_offset(slot) != leader_offset(slot + 1))
+          leaders(leader_offset(slot)) = slot;
+      });
+    }
+    MTVs staging;
+    const lid_t num_staged = num_leaders < staging_size ? num_leaders : staging_size;
+    StorageViews<Storage, device_type, DataTypes>::create(staging, num_staged);
+    PermuteInPlace<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(ptcl_data, staging,
+                                                                        source, state, leaders,
+                                                                        num_leaders,
+                                                                        staging_size);
+    StorageViews<Storage, device_type, DataTypes>::destroy(staging);
+    Kokkos::Profiling::popRegion();
+  }
+
+  /* Assigns the moving particles and holes of reshuffle without atomics (deterministic)
+     The particles moving to a row, in slot order followed by the new particles, fill the
+       holes of the row in slot order.
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::orderShuffle(kkLidView new_element,
+                                                              kkLidView new_particle_elements,
+                                                              kkLidView offset_new_particles,
+                                                              kkLidView new_particles_per_row,
+                                                              kkLidView moving_indices,
+                                                              kkLidView is_from_scs,
+                                                              kkLidView holes) {
+    const lid_t cap = capacity();
+    const lid_t num_new_ptcls = new_particle_elements.size();
+    const lid_t nrows = numRows();
+    kkLidView moving_row = scratch.get(SCRATCH_GROUPS, cap + num_new_ptcls, false);
+    kkLidView hole_row = scratch.get(SCRATCH_HOLE_GROUPS, cap, false);
+    //parallel_for skips structures without particles
+    Kokkos::deep_copy(moving_row, -1);
+    Kokkos::deep_copy(hole_row, -1);
+    kkLidView element_to_row_local = element_to_row;
+    const bool stay = new_element.size() == 0;
+    auto groupSlots = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id,
+                                const bool& mask) {
+      if (mask) {
+        const lid_t new_elem = stay ? element_id : new_element(particle_id);
+        if (new_elem != -1 && new_elem != element_id)
+          moving_row(particle_id) = element_to_row_local(new_elem);
+      }
+      else
+        hole_row(particle_id) = element_to_row_local(element_id);
+    };
+    parallel_for(groupSlots, "groupSlots");
+    Kokkos::parallel_for("group_new_particles", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      moving_row(cap + i) = element_to_row_local(new_particle_elements(i));
+    });
+
+    //The moving particles grouped by row are in the order of offset_new_particles
+    kkLidView moving_order = scratch.get(SCRATCH_GROUP_ORDER, cap + num_new_ptcls, false);
+    kkLidView moving_start = scratch.get(SCRATCH_GROUP_START, nrows + 1, false);
+    stableGroup(moving_row, nrows, moving_order, moving_start);
+    const lid_t num_moving = getLastValue<lid_t>(moving_start);
+    Kokkos::parallel_for("set_moving_particles", num_moving, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t item = moving_order(i);
+      const bool from_scs = item < cap;
+      moving_indices(i) = from_scs ? item : item - cap;
+      is_from_scs(i) = from_scs;
+    });
+
+    kkLidView hole_order = scratch.get(SCRATCH_HOLE_ORDER, cap, false);
+    kkLidView hole_start = scratch.get(SCRATCH_HOLE_START, nrows + 1, false);
+    stableGroup(hole_row, nrows, hole_order, hole_start);
+    const lid_t num_holes = getLastValue<lid_t>(hole_start);
+    Kokkos::parallel_for("set_holes", num_holes, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t slot = hole_order(i);
+      const lid_t row = hole_row(slot);
+      const lid_t hole_index = i - hole_start(row);
+      if (hole_index < new_particles_per_row(row))
+        holes(offset_new_particles(row) + hole_index) = slot;
+    });
+  }
+
+  /* Assigns the slots of the particles in a full rebuild without atomics (deterministic)
+     The particles of each new row, in slot order followed by the new particles, take the
+       cells of the row in order starting from row_index.
+  */
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::orderRebuild(kkLidView new_element,
+                                                              kkLidView new_particle_elements,
+                                                              kkLidView new_element_to_row,
+                                                              kkLidView row_index,
+                                                              lid_t new_num_rows, lid_t new_C,
+                                                              kkLidView new_indices,
+                                                              kkLidView new_particle_indices,
+                                                              kkLidView new_particle_mask) {
+    const lid_t cap = capacity();
+    const lid_t num_new_ptcls = new_particle_elements.size();
+    kkLidView ptcl_row = scratch.get(SCRATCH_GROUPS, cap + num_new_ptcls, false);
+    //parallel_for skips structures without particles
+    Kokkos::deep_copy(ptcl_row, -1);
+    Kokkos::deep_copy(new_indices, -1);
+    auto groupParticles = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id,
+                                    const bool& mask) {
+      const lid_t new_elem = new_element(particle_id);
+      if (mask && new_elem != -1)
+        ptcl_row(particle_id) = new_element_to_row(new_elem);
+    };
+    parallel_for(groupParticles, "groupParticles");
+    Kokkos::parallel_for("group_new_particles", num_new_ptcls, KOKKOS_LAMBDA(const lid_t& i) {
+      ptcl_row(cap + i) = new_element_to_row(new_particle_elements(i));
+    });
+
+    kkLidView ptcl_order = scratch.get(SCRATCH_GROUP_ORDER, cap + num_new_ptcls, false);
+    kkLidView row_start = scratch.get(SCRATCH_GROUP_START, new_num_rows + 1, false);
+    stableGroup(ptcl_row, new_num_rows, ptcl_order, row_start);
+    const lid_t num_placed = getLastValue<lid_t>(row_start);
+    Kokkos::parallel_for("set_rebuild_indices", num_placed, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t item = ptcl_order(i);
+      const lid_t row = ptcl_row(item);
+      const lid_t index = row_index(row) + (i - row_start(row)) * new_C;
+      new_particle_mask(index) = 1;
+      if (item < cap)
+        new_indices(item) = index;
+      else
+        new_particle_indices(item - cap) = index;
+    });
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::addParticles(kkLidView new_particle_elements,
+                                                              MTVs new_particles) {
+    if (new_particle_elements.size() == 0)
+      return;
+    const auto btime = prebarrier();
+    Kokkos::Profiling::pushRegion("scs_addParticles");
+    Kokkos::Timer timer;
+
+    //The holes of a structure without particles are not visited by parallel_for
+    if (num_ptcls > 0) {
+      ++num_reshuffles;
+      if (reshuffle(kkLidView(), new_particle_elements, new_particles)) {
+        sortRowsByMember();
+        RecordTime(name + " addParticles", timer.seconds(), btime);
+        Kokkos::Profiling::popRegion();
+        return;
+      }
+      ++num_failed_reshuffles;
+    }
+
+    //Fall back to a full rebuild where the existing particles stay in their elements
+    kkLidView new_element("new_element", capacity());
+    auto setElement = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id,
+                                const bool& mask) {
+      new_element(particle_id) = mask ? element_id : -1;
+    };
+    parallel_for(setElement, "setElement");
+    const bool shuffle = tryShuffling;
+    tryShuffling = false;
+    rebuild(new_element, new_particle_elements, new_particles);
+    tryShuffling = shuffle;
+    RecordTime(name + " addParticles", timer.seconds(), btime);
+    Kokkos::Profiling::popRegion();
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::removeParticles(kkLidView ptcl_ids) {
+    const lid_t num_ids = ptcl_ids.size();
+    if (num_ids == 0)
+      return;
+    active_dirty = true;
+    //The particles are only counted once if an index is repeated
+    const lid_t cap = capacity();
+    auto particle_mask_local = particle_mask;
+    lid_t num_removed = 0;
+    Kokkos::parallel_reduce("remove_particles", num_ids,
+                            KOKKOS_LAMBDA(const lid_t& i, lid_t& sum) {
+      const lid_t ptcl = ptcl_ids(i);
+      if (ptcl >= 0 && ptcl < cap)
+        sum += Kokkos::atomic_compare_exchange(&(particle_mask_local(ptcl)), 1, 0);
+    }, num_removed);
+    num_ptcls -= num_removed;
+  }
+
+  template<class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::shrinkToFit() {
+    Kokkos::Profiling::pushRegion("scs_shrinkToFit");
+    if (static_cast<std::size_t>(capacity_) < current_size) {
+      //Particles keep their index so each slot maps to itself
+      kkLidView identity = scratch.get(SCRATCH_NEW_INDICES, capacity_, false);
+      Kokkos::parallel_for("set_identity", capacity_, KOKKOS_LAMBDA(const lid_t& i) {
+        identity(i) = i;
+      });
+      MTVs fit_data;
+      StorageViews<Storage, device_type, DataTypes>::create(fit_data, capacity_);
+      CopyPSToPS<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes>(this, fit_data, ptcl_data,
+                                                                      identity, identity);
+      StorageViews<Storage, device_type, DataTypes>::destroy(ptcl_data);
+      ptcl_data = fit_data;
+      current_size = capacity_;
+    }
+    if (scs_data_swap)
+      StorageViews<Storage, device_type, DataTypes>::destroy(scs_data_swap);
+    scs_data_swap = NULL;
+    swap_size = 0;
+    //The scratch arrays are sized by the old allocation
+    scratch.clear();
+    Kokkos::Profiling::popRegion();
+  }
+
 }
@@ -1,50 +1,302 @@
 #pragma once
+#include <cstdint>
+#include <psSpaceFillingCurve.hpp>
+#include <psMemberType.h>
 namespace pumipic {
-  template <class DataTypes, typename MemSpace>
-    void SellCSigma<DataTypes, MemSpace>::sigmaSort(PairView& ptcl_pairs,
-                                                    lid_t num_elems,
-                                                    kkLidView ptcls_per_elem,
-                                                    lid_t sigma){
+  //Number of low bits needed to hold keys up to max_key
+  inline int radixBits(uint64_t max_key) {
+    int num_bits = 0;
+    while (num_bits < 64 && (max_key >> num_bits) > 0)
+      ++num_bits;
+    return num_bits;
+  }
+
+  /* Stable parallel LSD radix sort of vals by keys
+     Each pass counts the digits of fixed size tiles, scans the counts (digit major, tile minor)
+       and scatters each tile in order so ties keep their relative order.
+     keys - keys to sort by (overwritten with the sorted keys)
+     vals - values moved along with the keys
+     num_bits - number of low bits that can be set in the keys
+  */
+  template <typename Device>
+  void radixSortByKey(Kokkos::View<uint64_t*, Device> keys, Kokkos::View<lid_t*, Device> vals,
+                      int num_bits) {
+    const int RADIX_BITS = 8;
+    const lid_t NUM_DIGITS = 1 << RADIX_BITS;
+    const lid_t TILE_SIZE = 4096;
+    const lid_t n = keys.size();
+    const lid_t num_tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+    if (n <= 1 || num_bits <= 0)
+      return;
+    Kokkos::View<uint64_t*, Device> keys_in = keys;
+    Kokkos::View<lid_t*, Device> vals_in = vals;
+    Kokkos::View<uint64_t*, Device> keys_out("radix_keys", n);
+    Kokkos::View<lid_t*, Device> vals_out("radix_vals", n);
+    Kokkos::View<lid_t*, Device> digit_counts("digit_counts", NUM_DIGITS * num_tiles + 1);
+    Kokkos::View<lid_t*, Device> digit_offsets("digit_offsets", NUM_DIGITS * num_tiles + 1);
+    for (int shift = 0; shift < num_bits; shift += RADIX_BITS) {
+      Kokkos::deep_copy(digit_counts, 0);
+      Kokkos::parallel_for("radix_count", num_tiles, KOKKOS_LAMBDA(const lid_t& t) {
+        const lid_t end = (t + 1) * TILE_SIZE < n ? (t + 1) * TILE_SIZE : n;
+        for (lid_t i = t * TILE_SIZE; i < end; ++i) {
+          const lid_t digit = (keys_in(i) >> shift) & (NUM_DIGITS - 1);
+          ++digit_counts(digit * num_tiles + t);
+        }
+      });
+      exclusive_scan(digit_counts, digit_offsets);
+      Kokkos::parallel_for("radix_scatter", num_tiles, KOKKOS_LAMBDA(const lid_t& t) {
+        const lid_t end = (t + 1) * TILE_SIZE < n ? (t + 1) * TILE_SIZE : n;
+        for (lid_t i = t * TILE_SIZE; i < end; ++i) {
+          const lid_t digit = (keys_in(i) >> shift) & (NUM_DIGITS - 1);
+          const lid_t index = digit_offsets(digit * num_tiles + t)++;
+          keys_out(index) = keys_in(i);
+          vals_out(index) = vals_in(i);
+        }
+      });
+      Kokkos::View<uint64_t*, Device> keys_tmp = keys_in;
+      keys_in = keys_out;
+      keys_out = keys_tmp;
+      Kokkos::View<lid_t*, Device> vals_tmp = vals_in;
+      vals_in = vals_out;
+      vals_out = vals_tmp;
+    }
+    //After an odd number of passes the result is in the temporary views
+    if (keys_in.data() != keys.data()) {
+      Kokkos::deep_copy(keys, keys_in);
+      Kokkos::deep_copy(vals, vals_in);
+    }
+  }
+
+  /* Lists items by group, within a group in increasing item order
+     The positions come from a stable sort instead of atomic counters, so the result only
+       depends on the input (used by the deterministic mode of SellCSigma)
+     groups - group of each item, items outside [0, num_groups) are listed last
+     order - (output) item at each position of the list, sized as groups
+     group_start - (output) position of the first item of each group and the number of
+                   grouped items at num_groups, sized num_groups + 1
+  */
+  template <typename Device>
+  void stableGroup(Kokkos::View<lid_t*, Device> groups, lid_t num_groups,
+                   Kokkos::View<lid_t*, Device> order, Kokkos::View<lid_t*, Device> group_start) {
+    const lid_t n = groups.size();
+    Kokkos::View<uint64_t*, Device> keys("group_keys", n);
+    Kokkos::parallel_for("set_group_keys", n, KOKKOS_LAMBDA(const lid_t& i) {
+      const lid_t group = groups(i);
+      keys(i) = group >= 0 && group < num_groups ? group : num_groups;
+      order(i) = i;
+    });
+    radixSortByKey(keys, order, radixBits(num_groups));
+    Kokkos::parallel_for("set_group_starts", num_groups + 1, KOKKOS_LAMBDA(const lid_t& group) {
+      lid_t lo = 0, hi = n;
+      while (lo < hi) {
+        const lid_t mid = (lo + hi) / 2;
+        if (keys(mid) < static_cast<uint64_t>(group))
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      group_start(group) = lo;
+    });
+  }
+
+  /* Orders the elements along the space filling curve of elem_order through their centroids
+     Sigma sorting is applied in windows of this order so the rows of a chunk hold elements
+       that are near each other in the mesh
+  */
+  template <class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::orderElements(CentroidView centroids) {
+    element_sfc_order = kkLidView();
+    if (elem_order == ORDER_NONE || num_elems == 0)
+      return;
+    if (centroids.extent(0) != static_cast<std::size_t>(num_elems)) {
+      fprintf(stderr, "[ERROR] %lu element centroids given for %d elements, the elements "
+              "are not ordered\n", (unsigned long)centroids.extent(0), num_elems);
+      return;
+    }
+    //Map the bounding box of the centroids onto the grid of the curve
+    double lo[3], scale[3];
+    const double max_cell = (1u << SFC_BITS) - 1;
+    for (int d = 0; d < 3; ++d) {
+      double hi;
+      Kokkos::parallel_reduce("centroid_min", num_elems, KOKKOS_LAMBDA(const lid_t& i, double& mn) {
+        if (centroids(i, d) < mn)
+          mn = centroids(i, d);
+      }, Kokkos::Min<double>(lo[d]));
+      Kokkos::parallel_reduce("centroid_max", num_elems, KOKKOS_LAMBDA(const lid_t& i, double& mx) {
+        if (centroids(i, d) > mx)
+          mx = centroids(i, d);
+      }, Kokkos::Max<double>(hi));
+      scale[d] = hi > lo[d] ? max_cell / (hi - lo[d]) : 0;
+    }
+    const double lo_x = lo[0], lo_y = lo[1], lo_z = lo[2];
+    const double scale_x = scale[0], scale_y = scale[1], scale_z = scale[2];
+    const bool hilbert = elem_order == ORDER_HILBERT;
+    Kokkos::View<uint64_t*, device_type> keys("sfc_keys", num_elems);
+    kkLidView order("element_sfc_order", num_elems);
+    Kokkos::parallel_for("set_sfc_keys", num_elems, KOKKOS_LAMBDA(const lid_t& i) {
+      const uint32_t x = (centroids(i, 0) - lo_x) * scale_x;
+      const uint32_t y = (centroids(i, 1) - lo_y) * scale_y;
+      const uint32_t z = (centroids(i, 2) - lo_z) * scale_z;
+      keys(i) = hilbert ? hilbertKey(x, y, z) : mortonKey(x, y, z);
+      order(i) = i;
+    });
+    radixSortByKey(keys, order, 3 * SFC_BITS);
+    element_sfc_order = order;
+  }
+
+  template <class DataTypes, typename MemSpace, typename Storage>
+    void SellCSigma<DataTypes, MemSpace, Storage>::sigmaSort(PairView& ptcl_pairs,
+                                                             lid_t num_elems,
+                                                             kkLidView ptcls_per_elem,
+                                                             lid_t sigma){
     //Make temporary copy of the particle counts for sorting
     ptcl_pairs = PairView("ptcl_pairs", num_elems);
+    //The element at each position of the order the windows are taken from
+    kkLidView order = element_sfc_order;
+    const bool ordered = order.size() > 0;
     if (sigma > 1) {
-      lid_t i;
 #ifdef PP_USE_CUDA
+      lid_t i;
       Kokkos::View<lid_t*, typename MemSpace::device_type> elem_ids("elem_ids", num_elems);
       Kokkos::View<lid_t*, typename MemSpace::device_type> temp_ppe("temp_ppe", num_elems);
       Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
-          temp_ppe(i) = -ptcls_per_elem(i);
-          elem_ids(i) = i;
+          const lid_t elem = ordered ? order(i) : i;
+          temp_ppe(i) = -ptcls_per_elem(elem);
+          elem_ids(i) = elem;
         });
       thrust::device_ptr<lid_t> ptcls_t(temp_ppe.data());
       thrust::device_ptr<lid_t> elem_ids_t(elem_ids.data());
+      //Stable so elements with the same count keep their order
       for (i = 0; i < num_elems - sigma; i+=sigma) {
-        thrust::sort_by_key(thrust::device, ptcls_t + i, ptcls_t + i + sigma, elem_ids_t + i);
+        thrust::stable_sort_by_key(thrust::device, ptcls_t + i, ptcls_t + i + sigma,
+                                   elem_ids_t + i);
       }
-      thrust::sort_by_key(thrust::device, ptcls_t + i, ptcls_t + num_elems, elem_ids_t + i);
+      thrust::stable_sort_by_key(thrust::device, ptcls_t + i, ptcls_t + num_elems,
+                                 elem_ids_t + i);
       Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
           ptcl_pairs(i).first = -temp_ppe(i);
           ptcl_pairs(i).second = elem_ids(i);
         });
 #else
+      //Sort each sigma sized block by descending particle count (ties by position in the
+      //  order) in one radix sort on the key (block, max count - count) so the sort stays on
+      //  the device
+      lid_t max_ppe = 0;
+      Kokkos::parallel_reduce("max_ppe", num_elems, KOKKOS_LAMBDA(const lid_t& i, lid_t& mx) {
+        if (ptcls_per_elem(i) > mx)
+          mx = ptcls_per_elem(i);
+      }, Kokkos::Max<lid_t>(max_ppe));
+      const uint64_t count_range = static_cast<uint64_t>(max_ppe) + 1;
+      const uint64_t max_key = (num_elems - 1) / sigma * count_range + max_ppe;
+      const int num_bits = radixBits(max_key);
+      Kokkos::View<uint64_t*, typename MemSpace::device_type> sort_keys("sort_keys", num_elems);
+      Kokkos::View<lid_t*, typename MemSpace::device_type> elem_ids("elem_ids", num_elems);
+      const lid_t sigma_local = sigma;
       Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
-        ptcl_pairs(i).first = ptcls_per_elem(i);
-        ptcl_pairs(i).second = i;
+        const uint64_t block = i / sigma_local;
+        const lid_t elem = ordered ? order(i) : i;
+        sort_keys(i) = block * count_range + (max_ppe - ptcls_per_elem(elem));
+        elem_ids(i) = elem;
+      });
+      radixSortByKey(sort_keys, elem_ids, num_bits);
+      Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
+        const lid_t elem = elem_ids(i);
+        ptcl_pairs(i).first = ptcls_per_elem(elem);
+        ptcl_pairs(i).second = elem;
       });
-      typename PairView::HostMirror ptcl_pairs_host = deviceToHost(ptcl_pairs);
-      MyPair* ptcl_pair_data = ptcl_pairs_host.data();
-      for (i = 0; i < num_elems - sigma; i+=sigma) {
-        std::sort(ptcl_pair_data + i, ptcl_pair_data + i + sigma);
-      }
-      std::sort(ptcl_pair_data + i, ptcl_pair_data + num_elems);
-      hostToDevice(ptcl_pairs,  ptcl_pair_data);
 #endif
     }
     else {
       Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const lid_t& i) {
-        ptcl_pairs(i).first = ptcls_per_elem(i);
-        ptcl_pairs(i).second = i;
+        const lid_t elem = ordered ? order(i) : i;
+        ptcl_pairs(i).first = ptcls_per_elem(elem);
+        ptcl_pairs(i).second = elem;
       });
     }
   }
+
+  /* Orders the particles of each row by key with ties in slot order
+     Every row keeps the same occupied slots, its particles are assigned to them in order
+       of (key, slot) and moved by permuteInPlace so no second copy of the data is needed.
+  */
+  template <class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::sortRows(Kokkos::View<uint64_t*, device_type> keys) {
+    Kokkos::Profiling::pushRegion("scs_sortRows");
+    const lid_t cap = capacity_;
+    //List the particles in slot order with the row of each
+    kkLidView is_ptcl = scratch.get(SCRATCH_SORT_FLAG, cap + 1);
+    kkLidView ptcl_offset = scratch.get(SCRATCH_SORT_OFFSET, cap + 1, false);
+    kkLidView slot_row = scratch.get(SCRATCH_SORT_ROW, cap, false);
+    kkLidView element_to_row_local = element_to_row;
+    auto setSlotRows = PS_LAMBDA(const lid_t& element_id, const lid_t& particle_id,
+                                 const bool& mask) {
+      is_ptcl(particle_id) = mask;
+      slot_row(particle_id) = element_to_row_local(element_id);
+    };
+    parallel_for(setSlotRows, "setSlotRows");
+    exclusive_scan(is_ptcl, ptcl_offset);
+    const lid_t n = getLastValue<lid_t>(ptcl_offset);
+    if (n <= 1) {
+      Kokkos::Profiling::popRegion();
+      return;
+    }
+    //Only the bits that differ between the keys are sorted
+    uint64_t min_key, max_key;
+    Kokkos::parallel_reduce("sort_key_min", cap, KOKKOS_LAMBDA(const lid_t& i, uint64_t& mn) {
+      if (is_ptcl(i) && keys(i) < mn)
+        mn = keys(i);
+    }, Kokkos::Min<uint64_t>(min_key));
+    Kokkos::parallel_reduce("sort_key_max", cap, KOKKOS_LAMBDA(const lid_t& i, uint64_t& mx) {
+      if (is_ptcl(i) && keys(i) > mx)
+        mx = keys(i);
+    }, Kokkos::Max<uint64_t>(max_key));
+    Kokkos::View<uint64_t*, device_type> row_keys("row_keys", n);
+    Kokkos::View<uint64_t*, device_type> ptcl_keys("ptcl_keys", n);
+    kkLidView targets = scratch.get(SCRATCH_SORT_TARGETS, n, false);
+    kkLidView order = scratch.get(SCRATCH_SORT_ORDER, n, false);
+    Kokkos::parallel_for("list_sort_ptcls", cap, KOKKOS_LAMBDA(const lid_t& slot) {
+      if (is_ptcl(slot)) {
+        const lid_t index = ptcl_offset(slot);
+        row_keys(index) = slot_row(slot);
+        ptcl_keys(index) = keys(slot) - min_key;
+        targets(index) = slot;
+        order(index) = slot;
+      }
+    });
+    const int row_bits = radixBits(numRows() - 1);
+    //The occupied slots grouped by row in slot order are filled in turn
+    radixSortByKey(row_keys, targets, row_bits);
+    //Sorting by key and then stably by row orders each row by (key, slot)
+    radixSortByKey(ptcl_keys, order, radixBits(max_key - min_key));
+    Kokkos::parallel_for("set_sorted_rows", n, KOKKOS_LAMBDA(const lid_t& i) {
+      row_keys(i) = slot_row(order(i));
+    });
+    radixSortByKey(row_keys, order, row_bits);
+
+    kkLidView new_indices = scratch.get(SCRATCH_NEW_INDICES, cap, false);
+    Kokkos::deep_copy(new_indices, -1);
+    Kokkos::parallel_for("set_sorted_indices", n, KOKKOS_LAMBDA(const lid_t& i) {
+      new_indices(order(i)) = targets(i);
+    });
+    permuteInPlace(new_indices, cap);
+    active_dirty = true;
+    Kokkos::Profiling::popRegion();
+  }
+
+  //Sorts the rows by the member sort_key_member if it is set
+  template <class DataTypes, typename MemSpace, typename Storage>
+  void SellCSigma<DataTypes, MemSpace, Storage>::sortRowsByMember() {
+    if (sort_key_member < 0 || num_ptcls == 0)
+      return;
+    Kokkos::View<uint64_t*, device_type> keys("sort_keys", capacity_);
+    FillSortKeys<SellCSigma<DataTypes, MemSpace, Storage>, DataTypes> fill(this, ptcl_data,
+                                                                           sort_key_member,
+                                                                           keys);
+    if (!fill.valid) {
+      fprintf(stderr, "[ERROR] Member %d of %s is not a single arithmetic value, the particles "
+              "are not sorted within rows\n", sort_key_member, name.c_str());
+      return;
+    }
+    sortRows(keys);
+  }
 }
@@ -7,6 +7,9 @@
 #include <mpi.h>
 #include <unordered_map>
 #include <climits>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
 #include <particle_structure.hpp>
 #include <ppAssert.h>
 #include <Kokkos_UnorderedMap.hpp>
@@ -14,6 +17,7 @@
 #include <Kokkos_Sort.hpp>
 #include "SCSPair.h"
 #include "scs_input.hpp"
+#include <psScratch.hpp>
 #ifdef PP_USE_CUDA
 #include <thrust/sort.h>
 #include <thrust/device_ptr.h>
@@ -25,30 +29,35 @@ void enable_prebarrier();
 double prebarrier();
 
 
-template<class DataTypes, typename MemSpace = DefaultMemSpace>
-class SellCSigma : public ParticleStructure<DataTypes, MemSpace> {
+/* Storage selects the layout of the particle data, SoA or AoSoA<TileSize>
+     AoSoA tiles should match the team size of the policy (see MemberTypeAoSoA.h)
+*/
+template<class DataTypes, typename MemSpace = DefaultMemSpace, typename Storage = SoA>
+class SellCSigma : public ParticleStructure<DataTypes, MemSpace, Storage> {
  public:
 
-  template <typename MSpace> using Mirror = SellCSigma<DataTypes, MSpace>;
-  using typename ParticleStructure<DataTypes, MemSpace>::Types;
-  using typename ParticleStructure<DataTypes, MemSpace>::execution_space;
-  using typename ParticleStructure<DataTypes, MemSpace>::memory_space;
-  using typename ParticleStructure<DataTypes, MemSpace>::device_type;
-  using typename ParticleStructure<DataTypes, MemSpace>::kkLidView;
-  using typename ParticleStructure<DataTypes, MemSpace>::kkGidView;
-  using typename ParticleStructure<DataTypes, MemSpace>::kkLidHostMirror;
-  using typename ParticleStructure<DataTypes, MemSpace>::kkGidHostMirror;
-  using typename ParticleStructure<DataTypes, MemSpace>::MTVs;
+  template <typename MSpace> using Mirror = SellCSigma<DataTypes, MSpace, Storage>;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::Types;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::execution_space;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::memory_space;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::device_type;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::kkLidView;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::kkGidView;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::kkLidHostMirror;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::kkGidHostMirror;
+  using typename ParticleStructure<DataTypes, MemSpace, Storage>::MTVs;
 
 #ifdef PP_USE_CUDA
   template <std::size_t N>
-  using Slice = typename ParticleStructure<DataTypes, MemSpace>::Slice<N>;
+  using Slice = typename ParticleStructure<DataTypes, MemSpace, Storage>::Slice<N>;
 #else
   template <std::size_t N> using DataType = typename MemberTypeAtIndex<N, DataTypes>::type;
-template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
+template <std::size_t N> using Slice =
+  typename ParticleStructure<DataTypes, MemSpace, Storage>::template Slice<N>;
 #endif
   typedef Kokkos::TeamPolicy<execution_space> PolicyType;
   typedef Kokkos::View<MyPair*, device_type> PairView;
+  typedef Kokkos::View<double*[3], device_type> CentroidView;
   typedef Kokkos::UnorderedMap<gid_t, lid_t, device_type> GID_Mapping;
   typedef SCS_Input<DataTypes, MemSpace> Input_T;
 
@@ -71,27 +80,49 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
              kkLidView particles_per_element, kkGidView element_gids,
              kkLidView particle_elements = kkLidView(),
              MTVs particle_info = NULL);
-  SellCSigma(SCS_Input<DataTypes, MemSpace>&);
+  /* Constructor of SellCSigma from an SCS_Input
+     Parameters set in the environment override those of the input (see SCS_Input)
+  */
+  SellCSigma(const SCS_Input<DataTypes, MemSpace>&);
   ~SellCSigma();
 
   template <class MSpace>
   Mirror<MSpace>* copy();
 
   //Functions from ParticleStructure
-  using ParticleStructure<DataTypes, MemSpace>::nElems;
-  using ParticleStructure<DataTypes, MemSpace>::nPtcls;
-  using ParticleStructure<DataTypes, MemSpace>::capacity;
-  using ParticleStructure<DataTypes, MemSpace>::numRows;
-  using ParticleStructure<DataTypes, MemSpace>::copy;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::nElems;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::nPtcls;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::capacity;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::numRows;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::copy;
 
   //Returns the horizontal slicing(C)
   lid_t C() const {return C_;}
   //Returns the vertical slicing(V)
   lid_t V() const {return V_;}
+  //Returns the number of particles the member views are allocated for (including the swap)
+  std::size_t allocatedSize() const {return current_size + swap_size;}
+  //Returns the number of reshuffles tried by rebuild
+  lid_t numReshuffles() const {return num_reshuffles;}
+  //Returns the number of reshuffles that did not fit and fell back to a full rebuild
+  lid_t numFailedReshuffles() const {return num_failed_reshuffles;}
 
 
   //Change whether or not to try shuffling
   void setShuffling(bool newS) {tryShuffling = newS;}
+  //Change the member that orders the particles within each row after rebuilds (-1 for none)
+  void setSortKey(int member) {sort_key_member = member;}
+  //Change whether slots are assigned without atomics so the layout is reproducible
+  void setDeterministic(bool det) {deterministic = det;}
+  //Change the communication used by migrate (must be the same on every rank)
+  void setMigrateStrategy(MigrateStrategy strat) {migrate_strat = strat;}
+  //Rebuild the MIGRATE_NEIGHBOR graph communicator on the next migrate after the ranks of the
+  //  Distributor change (must be called on every rank)
+  void markNeighborsStale() {neighbor_stale = true;}
+  //Change the traversal used by parallel_for (TRAVERSE_DEFAULT picks one for the backend)
+  void setTraversal(TraversalStrategy strat) {traversal_strat = strat;}
+  //Returns the traversal used by parallel_for with TRAVERSE_DEFAULT resolved
+  TraversalStrategy traversal() const;
 
   /* Migrates each particle to new_process and to new_element
      Calls rebuild to recreate the SCS after migrating particles
@@ -102,11 +133,30 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
                Distributor<MemSpace> dist = Distributor<MemSpace>(),
                kkLidView new_particle_elements = kkLidView(),
                MTVs new_particle_info = NULL);
+  /*
+    Split-phase migrate, starts the exchange of the particles leaving this process and takes
+      them out of the structure. Work may be done on the staying particles, which keep their
+      elements, while the messages are in flight.
+    The arguments are the same as migrate. new_element, new_particle_elements and
+      new_particle_info are used by migrate_end and must not be changed before it.
+  */
+  void migrate_begin(kkLidView new_element, kkLidView new_process,
+                     Distributor<MemSpace> dist = Distributor<MemSpace>(),
+                     kkLidView new_particle_elements = kkLidView(),
+                     MTVs new_particle_info = NULL);
+  /*
+    Finishes the migration started by migrate_begin
+    Waits for the particles sent to this process and rebuilds once with the staying particles
+      moved to new_element, the received particles and the new particles
+  */
+  void migrate_end();
 
   /*
     Reshuffles the scs values to the element in new_element[i]
+    Chunks with rows that overflow are grown with new slices in the extra padding
     Calls rebuild if there is not enough space for the shuffle
     new_element - array sized scs->capacity with the new element for each particle
+      (empty to keep every particle in its element)
       Optional arguments when adding new particles to the structure
       new_particle_elements - the new element for each new particle
       new_particles - the data for the new particles
@@ -124,6 +174,35 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   void rebuild(kkLidView new_element, kkLidView new_particle_elements = kkLidView(),
                MTVs new_particles = NULL);
 
+  /*
+    Adds particles without moving the existing ones
+    New particles fill the holes of their rows, chunks with rows that overflow are grown with
+      new slices in the extra padding. Falls back to a full rebuild if they do not fit
+    new_particle_elements - the element for each new particle
+    new_particles - the data for the new particles
+  */
+  void addParticles(kkLidView new_particle_elements, MTVs new_particles);
+  /*
+    Removes particles by clearing their slots, the other particles do not move
+    ptcl_ids - array of the particle indices (ptcl_id of parallel_for) to remove
+      Indices of empty slots or out of the structure are ignored
+  */
+  void removeParticles(kkLidView ptcl_ids);
+
+  /*
+    Reallocates the particle data to the capacity of the structure and frees the swap buffer
+    The next reshuffle that needs to grow the structure falls back to a full rebuild, which
+      allocates the swap buffer again
+  */
+  void shrinkToFit();
+
+  /*
+    Orders the particles within each row by key, ties keep their slot order
+    The particles only move between the occupied slots of their row
+    keys - array sized scs->capacity with the key of each particle
+  */
+  void sortRows(Kokkos::View<uint64_t*, device_type> keys);
+
   /*
     Performs a parallel for over the elements/particles in the SCS
     The passed in functor/lambda should take in 3 arguments (int elm_id, int ptcl_id, bool mask)
@@ -132,10 +211,19 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
       do stuff...
     };
     ps::parallel_for(scs, lamb, name);
+    The slots are traversed with the strategy set by setTraversal
   */
   template <typename FunctionType>
   void parallel_for(FunctionType& fn, std::string s="");
 
+  /*
+    Performs a parallel for over only the active particles in the SCS (padding is skipped)
+    The functor/lambda takes the same arguments as parallel_for, mask is always true
+    The list of active particles is compacted on the first call after the SCS changes
+  */
+  template <typename FunctionType>
+  void parallel_for_active(FunctionType& fn, std::string s="");
+
   //Prints the format of the SCS labeled by prefix
   void printFormat(const char* prefix = "") const;
 
@@ -144,6 +232,8 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
 
   //Do not call these functions:
   int chooseChunkHeight(int maxC, kkLidView ptcls_per_elem);
+  void chooseChunkSizes(PairView ptcls, kkLidView ptcls_per_elem);
+  void orderElements(CentroidView centroids);
   void sigmaSort(PairView& ptcl_pairs, lid_t num_elems,
                  kkLidView ptcls_per_elem, lid_t sigma);
   void constructChunks(PairView ptcls, lid_t& nchunks,
@@ -152,22 +242,34 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   void createGlobalMapping(kkGidView elmGid, kkGidView& elm2Gid, GID_Mapping& elmGid2Lid);
   void constructOffsets(lid_t nChunks, lid_t& nSlices, kkLidView chunk_widths,
                         kkLidView& offs, kkLidView& s2e, lid_t& capacity);
+  bool growChunks(kkLidView new_particles_per_row, kkLidView num_holes_per_row);
+  void recordInflow(kkLidView arrivals_per_row, kkLidView departures_per_row);
+  void permuteInPlace(kkLidView new_indices, lid_t new_cap);
+  void sortRowsByMember();
+  void orderShuffle(kkLidView new_element, kkLidView new_particle_elements,
+                    kkLidView offset_new_particles, kkLidView new_particles_per_row,
+                    kkLidView moving_indices, kkLidView is_from_scs, kkLidView holes);
+  void orderRebuild(kkLidView new_element, kkLidView new_particle_elements,
+                    kkLidView new_element_to_row, kkLidView row_index, lid_t new_num_rows,
+                    lid_t new_C, kkLidView new_indices, kkLidView new_particle_indices,
+                    kkLidView new_particle_mask);
   void setupParticleMask(kkLidView mask, PairView ptcls, kkLidView chunk_widths,
                          kkLidView& chunk_starts);
   void initSCSData(kkLidView chunk_widths, kkLidView particle_elements,
                    MTVs particle_info);
+  void setupActiveParticles();
 
-  template <typename DT, typename MSpace> friend class SellCSigma;
+  template <typename DT, typename MSpace, typename S> friend class SellCSigma;
  private:
 
   //Variables from ParticleStructure
-  using ParticleStructure<DataTypes, MemSpace>::name;
-  using ParticleStructure<DataTypes, MemSpace>::num_elems;
-  using ParticleStructure<DataTypes, MemSpace>::num_ptcls;
-  using ParticleStructure<DataTypes, MemSpace>::capacity_;
-  using ParticleStructure<DataTypes, MemSpace>::num_rows;
-  using ParticleStructure<DataTypes, MemSpace>::ptcl_data;
-  using ParticleStructure<DataTypes, MemSpace>::num_types;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::name;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::num_elems;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::num_ptcls;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::capacity_;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::num_rows;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::ptcl_data;
+  using ParticleStructure<DataTypes, MemSpace, Storage>::num_types;
 
   //The User defined kokkos policy
   PolicyType policy;
@@ -177,8 +279,14 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   lid_t C_max;
   //Vertical slice size
   lid_t V_;
+  //Max vertical slice size given to the structure
+  lid_t V_max;
   //Sorting chunk size
   lid_t sigma;
+  //Order of the elements before sigma sorting, the element at each position of the order
+  //  (empty for the order of the element ids)
+  ElementOrder elem_order;
+  kkLidView element_sfc_order;
   //Number of chunks
   lid_t num_chunks;
   //Number of slices
@@ -204,15 +312,110 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
   //Pointers to the start of each SCS for each data type
   MTVs scs_data_swap;
   std::size_t current_size, swap_size;
+  //Fraction of the allocation below which full rebuilds shrink it (0 never shrinks)
+  double shrink_threshold;
+  //True - keep scs_data_swap between full rebuilds, false - free it after each one
+  bool keep_swap;
+  //Data movement of full rebuilds and the number of particles staged at once in place
+  RebuildStrategy rebuild_strat;
+  lid_t staging_size;
+  //Communication used by migrate, MIGRATE_NEIGHBOR keeps the distributed graph communicator
+  //  of the last Distributor and the ranks it was built for (MPI_COMM_NULL before the first)
+  //  until markNeighborsStale sets neighbor_stale
+  MigrateStrategy migrate_strat;
+  MPI_Comm neighbor_comm;
+  MPI_Comm neighbor_parent;
+  std::vector<int> neighbor_ranks;
+  bool neighbor_stale;
+  //Number of count exchanges done with MIGRATE_NBX
+  int nbx_round;
+  //Duplicate of the communicator of the world Distributor that MIGRATE_NBX sends its counts
+  //  on, so they cannot match other messages (MPI_COMM_NULL before the first NBX migrate)
+  MPI_Comm nbx_comm;
+  MPI_Comm nbx_parent;
+  //Migration started by migrate_begin (or posted by migrateStart for migrate)
+  struct PendingMigration {
+    bool active;
+    //False if no particles are exchanged and only the rebuild is left
+    bool exchanging;
+    lid_t np_recv;
+    //The arguments of migrate_begin used by the rebuild of migrate_end
+    kkLidView new_element;
+    kkLidView new_particle_elements;
+    MTVs new_particle_info;
+    //Packed records of the particles being sent and received (see MemberTypePack.h)
+    Kokkos::View<char*, device_type> send_buffer, recv_buffer;
+    std::vector<MPI_Request> send_requests, recv_requests;
+    //Counts and displacements in bytes of the neighborhood exchange
+    std::vector<int> send_counts, send_displs, recv_counts, recv_displs;
+  };
+  PendingMigration pending_migration;
+  //Persistent requests of the MIGRATE_POINT_TO_POINT count exchange for the ranks of the last
+  //  Distributor that is not the world (MPI_COMM_NULL before the first)
+  struct CountExchange {
+    MPI_Comm comm;
+    std::vector<int> ranks;
+    //Counts sent to and received from each index of the Distributor
+    Kokkos::View<lid_t*, Kokkos::HostSpace> send_counts, recv_counts;
+    std::vector<MPI_Request> requests;
+  };
+  CountExchange count_exchange;
+  //Requests of the world and neighborhood count exchanges, reused by each migrate
+  std::vector<MPI_Request> count_recv_requests;
 
   //Padding terms
   double extra_padding;
   double shuffle_padding;
   PaddingStrategy pad_strat;
+  //Moving average of the net inflow of particles to each element over reshuffles
+  //  (only allocated for PAD_ADAPTIVE) and the weight of the newest reshuffle
+  Kokkos::View<double*, device_type> element_inflow;
+  double padding_history;
+  //Traversal used by parallel_for
+  TraversalStrategy traversal_strat;
+  //Selection of C and V on construction and full rebuilds
+  ChunkStrategy chunk_strat;
+  //Estimated cost and number of candidates evaluated by the last selection of C and V
+  double chunk_cost;
+  lid_t chunk_candidates;
   //True - try shuffling every rebuild, false - only rebuild
   bool tryShuffling;
+  //Member ordering the particles within each row after rebuilds (-1 for none)
+  int sort_key_member;
+  //True - assign slots by scans and stable sorts, false - by atomics
+  bool deterministic;
   //Metric Info
   lid_t num_empty_elements;
+  lid_t num_reshuffles;
+  lid_t num_failed_reshuffles;
+
+  //Compacted particle/element ids of the active particles for parallel_for_active
+  kkLidView active_ptcls;
+  kkLidView active_elems;
+  //True if the active particles need to be compacted again
+  bool active_dirty;
+
+  //Scratch arrays reused by reshuffle, rebuild and migrate
+  ScratchPool<MemSpace> scratch;
+  enum ScratchId {
+    //reshuffle
+    SCRATCH_NEW_PER_ROW, SCRATCH_HOLES_PER_ROW, SCRATCH_FAIL, SCRATCH_OFFSET_NEW,
+    SCRATCH_COUNTING_OFFSET, SCRATCH_MOVING_INDICES, SCRATCH_FROM_SCS, SCRATCH_HOLES,
+    SCRATCH_DEPARTURES_PER_ROW,
+    //rebuild
+    SCRATCH_NEW_PER_ELEM, SCRATCH_INTERIOR_SLICE, SCRATCH_ELEMENT_INDEX,
+    SCRATCH_NEW_INDICES, SCRATCH_NEW_PTCL_INDICES, SCRATCH_CHUNK_WIDTHS,
+    //sortRows
+    SCRATCH_SORT_FLAG, SCRATCH_SORT_OFFSET, SCRATCH_SORT_ROW, SCRATCH_SORT_TARGETS,
+    SCRATCH_SORT_ORDER,
+    //deterministic slot assignment
+    SCRATCH_GROUPS, SCRATCH_GROUP_ORDER, SCRATCH_GROUP_START, SCRATCH_HOLE_GROUPS,
+    SCRATCH_HOLE_ORDER, SCRATCH_HOLE_START,
+    //migrate
+    SCRATCH_NUM_SEND, SCRATCH_NUM_RECV, SCRATCH_OFFSET_SEND, SCRATCH_OFFSET_SEND_TEMP,
+    SCRATCH_OFFSET_RECV, SCRATCH_SEND_INDEX, SCRATCH_RECV_ELEMENT,
+    SCRATCH_NEW_PTCL_MAP, SCRATCH_NUM_LEFT
+  };
 
   //Private construct function
   void construct(kkLidView ptcls_per_elem,
@@ -220,32 +423,60 @@ template <std::size_t N> using Slice = Segment<DataType<N>, device_type>;
                  kkLidView particle_elements,
                  MTVs particle_info);
   void destroy();
-
-  SellCSigma(lid_t Cmax) : ParticleStructure<DataTypes, MemSpace>(), policy(PolicyType(1000,Cmax)) {};
+  void setupNeighborComm(const Distributor<MemSpace>& dist, int comm_rank);
+  void setupCountExchange(const Distributor<MemSpace>& dist, int comm_rank);
+  void freeCountExchange();
+  void receiveSparseCounts(std::vector<MPI_Request>& send_requests,
+                           kkLidView num_recv_particles, MPI_Comm comm, int tag);
+  //Posts the exchange of a migration, returns false if no particles are exchanged and only a
+  //  rebuild with new_element is needed
+  bool migrateStart(kkLidView new_element, kkLidView new_process, Distributor<MemSpace> dist,
+                    kkLidView new_particle_elements, MTVs new_particle_info);
+  //Completes the posted exchange and rebuilds with the received and new particles, moving
+  //  the particles to the new_element given to migrateStart
+  void migrateFinish(kkLidView new_particle_elements, MTVs new_particle_info);
+
+  //Input of the constructor without an SCS_Input
+  static Input_T constructorInput(PolicyType& p, lid_t sigma, lid_t V, lid_t ne, lid_t np,
+                                  kkLidView ptcls_per_elem, kkGidView element_gids,
+                                  kkLidView particle_elements, MTVs particle_info);
+
+  SellCSigma(lid_t Cmax) : ParticleStructure<DataTypes, MemSpace, Storage>(), policy(PolicyType(1000,Cmax)) {};
 
 };
 
-template<class DataTypes, typename MemSpace>
-void SellCSigma<DataTypes, MemSpace>::construct(kkLidView ptcls_per_elem,
-                                                kkGidView element_gids,
-                                                kkLidView particle_elements,
-                                                MTVs particle_info) {
+template<class DataTypes, typename MemSpace, typename Storage>
+void SellCSigma<DataTypes, MemSpace, Storage>::construct(kkLidView ptcls_per_elem,
+                                                         kkGidView element_gids,
+                                                         kkLidView particle_elements,
+                                                         MTVs particle_info) {
   Kokkos::Profiling::pushRegion("scs_construction");
-  tryShuffling = true;
+  active_dirty = true;
   int comm_size;
   MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
   int comm_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
 
   C_max = policy.team_size();
-  C_ = chooseChunkHeight(C_max, ptcls_per_elem);
+  num_reshuffles = num_failed_reshuffles = 0;
+  neighbor_comm = MPI_COMM_NULL;
+  neighbor_stale = false;
+  nbx_round = 0;
+  nbx_comm = MPI_COMM_NULL;
+  pending_migration.active = false;
+  pending_migration.new_particle_info = NULL;
+  count_exchange.comm = MPI_COMM_NULL;
+  if (pad_strat == PAD_ADAPTIVE)
+    element_inflow = Kokkos::View<double*, device_type>("element_inflow", num_elems);
 
-  if(!comm_rank)
-    fprintf(stderr, "Building SCS with C: %d sigma: %d V: %d\n",C_,sigma,V_);
   //Perform sorting
   PairView ptcls;
   sigmaSort(ptcls, num_elems,ptcls_per_elem, sigma);
 
+  chooseChunkSizes(ptcls, ptcls_per_elem);
+  if(!comm_rank)
+    fprintf(stderr, "Building SCS with C: %d sigma: %d V: %d\n",C_,sigma,V_);
+
   // Number of chunks without vertical slicing
   kkLidView chunk_widths;
   constructChunks(ptcls, num_chunks, chunk_widths, row_to_element, element_to_row);
@@ -263,9 +494,14 @@ void SellCSigma<DataTypes, MemSpace>::construct(kkLidView ptcls_per_elem,
   particle_mask = kkLidView("particle_mask", cap);
   if (extra_padding > 0)
     cap *= (1 + extra_padding);
-  CreateViews<device_type, DataTypes>(ptcl_data, cap);
-  CreateViews<device_type, DataTypes>(scs_data_swap, cap);
-  swap_size = current_size = cap;
+  StorageViews<Storage, device_type, DataTypes>::create(ptcl_data, cap);
+  current_size = cap;
+  swap_size = 0;
+  scs_data_swap = NULL;
+  if (keep_swap) {
+    StorageViews<Storage, device_type, DataTypes>::create(scs_data_swap, cap);
+    swap_size = cap;
+  }
 
   if (num_ptcls > 0) {
     kkLidView chunk_starts;
@@ -281,61 +517,116 @@ void SellCSigma<DataTypes, MemSpace>::construct(kkLidView ptcls_per_elem,
 }
 
 
-template<class DataTypes, typename MemSpace>
-SellCSigma<DataTypes, MemSpace>::SellCSigma(PolicyType& p, lid_t sig, lid_t v, lid_t ne,
-                                            lid_t np, kkLidView ptcls_per_elem,
-                                            kkGidView element_gids,
-                                            kkLidView particle_elements,
-                                            MTVs particle_info) :
-  ParticleStructure<DataTypes, MemSpace>(), policy(p), element_gid_to_lid(ne) {
-  //Set variables
-  sigma = sig;
-  V_ = v;
-  num_elems = ne;
-  num_ptcls = np;
-  shuffle_padding = 0.0;
-  extra_padding = 0.1;
-  pad_strat = PAD_EVENLY;
-  construct(ptcls_per_elem, element_gids, particle_elements, particle_info);
+template<class DataTypes, typename MemSpace, typename Storage>
+SellCSigma<DataTypes, MemSpace, Storage>::SellCSigma(PolicyType& p, lid_t sig, lid_t v, lid_t ne,
+                                                     lid_t np, kkLidView ptcls_per_elem,
+                                                     kkGidView element_gids,
+                                                     kkLidView particle_elements,
+                                                     MTVs particle_info) :
+  SellCSigma(constructorInput(p, sig, v, ne, np, ptcls_per_elem, element_gids,
+                              particle_elements, particle_info)) {}
+
+template<class DataTypes, typename MemSpace, typename Storage>
+typename SellCSigma<DataTypes, MemSpace, Storage>::Input_T
+SellCSigma<DataTypes, MemSpace, Storage>::constructorInput(PolicyType& p, lid_t sig, lid_t v,
+                                                           lid_t ne, lid_t np,
+                                                           kkLidView ptcls_per_elem,
+                                                           kkGidView element_gids,
+                                                           kkLidView particle_elements,
+                                                           MTVs particle_info) {
+  Input_T input(p, sig, v, ne, np, ptcls_per_elem, element_gids, particle_elements,
+                particle_info);
+  //Defaults of the constructor without an SCS_Input
+  input.shuffle_padding = 0.0;
+  input.extra_padding = 0.1;
+  return input;
 }
 
-template<class DataTypes, typename MemSpace>
-SellCSigma<DataTypes, MemSpace>::SellCSigma(Input_T& input) :
-    ParticleStructure<DataTypes, MemSpace>(input.name), policy(input.policy),
-    element_gid_to_lid(input.ne) {
+template<class DataTypes, typename MemSpace, typename Storage>
+SellCSigma<DataTypes, MemSpace, Storage>::SellCSigma(const Input_T& given_input) :
+    ParticleStructure<DataTypes, MemSpace, Storage>(given_input.name),
+    policy(given_input.policy), element_gid_to_lid(given_input.ne) {
+  Input_T input = given_input;
+  //Invalid settings are reported by setParameter and leave the given values unchanged
+  if (!input.readEnvironment())
+    fprintf(stderr, "[ERROR] Ignoring the invalid PS_SCS settings of %s\n", input.name.c_str());
+  name = input.name;
+  policy = input.policy;
   sigma = input.sig;
   V_ = input.V;
+  V_max = input.V;
   num_elems = input.ne;
   num_ptcls = input.np;
   shuffle_padding = input.shuffle_padding;
   extra_padding = input.extra_padding;
+  shrink_threshold = input.shrink_threshold;
+  rebuild_strat = input.rebuild_strat;
+  staging_size = input.staging_size;
+  migrate_strat = input.migrate_strat;
+  //Rebuilding in place never needs the swap buffer between rebuilds
+  keep_swap = input.keep_swap && rebuild_strat != REBUILD_IN_PLACE;
   pad_strat = input.padding_strat;
+  padding_history = input.padding_history;
+  traversal_strat = input.traversal_strat;
+  chunk_strat = input.chunk_strat;
+  tryShuffling = input.shuffling;
+  sort_key_member = input.sort_key_member;
+  deterministic = input.deterministic;
+  elem_order = input.element_order;
+  orderElements(input.element_centroids);
   construct(input.ppe, input.e_gids, input.particle_elms, input.p_info);
 }
 
-template<class DataTypes, typename MemSpace>
+template<class DataTypes, typename MemSpace, typename Storage>
 template <class MSpace>
-SellCSigma<DataTypes, MemSpace>::Mirror<MSpace>* SellCSigma<DataTypes, MemSpace>::copy() {
-  Mirror<MSpace>* mirror_copy = new SellCSigma<DataTypes, MSpace>(C_max);
+SellCSigma<DataTypes, MemSpace, Storage>::Mirror<MSpace>* SellCSigma<DataTypes, MemSpace, Storage>::copy() {
+  Mirror<MSpace>* mirror_copy = new SellCSigma<DataTypes, MSpace, Storage>(C_max);
   //Call Particle structures copy
   mirror_copy->copy(this);
   //Copy constants
   mirror_copy->C_ = C_;
   mirror_copy->C_max = C_max;
   mirror_copy->V_ = V_;
+  mirror_copy->V_max = V_max;
   mirror_copy->sigma = sigma;
+  mirror_copy->elem_order = elem_order;
   mirror_copy->num_chunks = num_chunks;
   mirror_copy->num_slices = num_slices;
   mirror_copy->current_size = current_size;
   mirror_copy->swap_size = swap_size;
   mirror_copy->extra_padding = extra_padding;
+  mirror_copy->shrink_threshold = shrink_threshold;
+  mirror_copy->keep_swap = keep_swap;
+  mirror_copy->rebuild_strat = rebuild_strat;
+  mirror_copy->staging_size = staging_size;
+  mirror_copy->migrate_strat = migrate_strat;
+  mirror_copy->neighbor_comm = MPI_COMM_NULL;
+  mirror_copy->neighbor_stale = false;
+  mirror_copy->nbx_round = nbx_round;
+  mirror_copy->nbx_comm = MPI_COMM_NULL;
+  mirror_copy->pending_migration.active = false;
+  mirror_copy->pending_migration.new_particle_info = NULL;
+  mirror_copy->count_exchange.comm = MPI_COMM_NULL;
   mirror_copy->shuffle_padding = shuffle_padding;
   mirror_copy->pad_strat = pad_strat;
+  mirror_copy->padding_history = padding_history;
+  mirror_copy->traversal_strat = traversal_strat;
+  mirror_copy->chunk_strat = chunk_strat;
+  mirror_copy->chunk_cost = chunk_cost;
+  mirror_copy->chunk_candidates = chunk_candidates;
   mirror_copy->tryShuffling = tryShuffling;
+  mirror_copy->sort_key_member = sort_key_member;
+  mirror_copy->deterministic = deterministic;
   mirror_copy->num_empty_elements = num_empty_elements;
+  mirror_copy->num_reshuffles = num_reshuffles;
+  mirror_copy->num_failed_reshuffles = num_failed_reshuffles;
+  mirror_copy->active_dirty = true;
 
   //Create the swap space
-  mirror_copy->scs_data_swap = createMemberViews<DataTypes, memory_space>(swap_size);
+  mirror_copy->scs_data_swap = NULL;
+  if (scs_data_swap)
+    StorageViews<Storage, typename MSpace::device_type, DataTypes>::create(mirror_copy->scs_data_swap,
+                                                                          swap_size);
   //Deep copy each view
   mirror_copy->slice_to_chunk = typename Mirror<MSpace>::kkLidView("mirror slice_to_chunk",
                                                                    slice_to_chunk.size());
@@ -354,26 +645,50 @@ SellCSigma<DataTypes, MemSpace>::Mirror<MSpace>* SellCSigma<DataTypes, MemSpace>
   mirror_copy->element_to_gid = typename Mirror<MSpace>::kkGidView("mirror element_to_gid",
                                                                    element_to_gid.size());
   Kokkos::deep_copy(mirror_copy->element_to_gid, element_to_gid);
+  mirror_copy->element_sfc_order =
+    typename Mirror<MSpace>::kkLidView("mirror element_sfc_order", element_sfc_order.size());
+  Kokkos::deep_copy(mirror_copy->element_sfc_order, element_sfc_order);
+  mirror_copy->element_inflow =
+    Kokkos::View<double*, typename MSpace::device_type>("mirror element_inflow",
+                                                        element_inflow.size());
+  Kokkos::deep_copy(mirror_copy->element_inflow, element_inflow);
   //Deep copy the gid mapping
   mirror_copy->element_gid_to_lid.create_copy_view(element_gid_to_lid);
   return mirror_copy;
 }
 
 
-template<class DataTypes, typename MemSpace>
-void SellCSigma<DataTypes, MemSpace>::destroy() {
-  destroyViews<DataTypes, memory_space>(ptcl_data);
-  destroyViews<DataTypes, memory_space>(scs_data_swap);
+template<class DataTypes, typename MemSpace, typename Storage>
+void SellCSigma<DataTypes, MemSpace, Storage>::destroy() {
+  StorageViews<Storage, device_type, DataTypes>::destroy(ptcl_data);
+  if (scs_data_swap)
+    StorageViews<Storage, device_type, DataTypes>::destroy(scs_data_swap);
+  int finalized;
+  MPI_Finalized(&finalized);
+  //Complete the messages of a migration that was not ended
+  if (pending_migration.active && !finalized) {
+    PendingMigration& pending = pending_migration;
+    PS_Comm_Waitall<device_type>(pending.recv_requests.size(), pending.recv_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+    PS_Comm_Waitall<device_type>(pending.send_requests.size(), pending.send_requests.data(),
+                                 MPI_STATUSES_IGNORE);
+  }
+  if (neighbor_comm != MPI_COMM_NULL && !finalized)
+    MPI_Comm_free(&neighbor_comm);
+  if (nbx_comm != MPI_COMM_NULL && !finalized)
+    MPI_Comm_free(&nbx_comm);
+  if (!finalized)
+    freeCountExchange();
 }
-template<class DataTypes, typename MemSpace>
-SellCSigma<DataTypes, MemSpace>::~SellCSigma() {
+template<class DataTypes, typename MemSpace, typename Storage>
+SellCSigma<DataTypes, MemSpace, Storage>::~SellCSigma() {
   destroy();
 }
 
 
 
-template<class DataTypes, typename MemSpace>
-void SellCSigma<DataTypes,MemSpace>::printFormat(const char* prefix) const {
+template<class DataTypes, typename MemSpace, typename Storage>
+void SellCSigma<DataTypes, MemSpace, Storage>::printFormat(const char* prefix) const {
   //Transfer everything to the host
   kkLidHostMirror slice_to_chunk_host = deviceToHost(slice_to_chunk);
   kkGidHostMirror element_to_gid_host = deviceToHost(element_to_gid);
@@ -415,8 +730,8 @@ void SellCSigma<DataTypes,MemSpace>::printFormat(const char* prefix) const {
   printf("%s", message);
 }
 
-template <class DataTypes, typename MemSpace>
-void SellCSigma<DataTypes, MemSpace>::printMetrics() const {
+template <class DataTypes, typename MemSpace, typename Storage>
+void SellCSigma<DataTypes, MemSpace, Storage>::printMetrics() const {
 
   //Gather metrics
   kkLidView padded_cells("padded_cells", 1);
@@ -471,44 +786,149 @@ void SellCSigma<DataTypes, MemSpace>::printMetrics() const {
   //Empty Elements
   ptr += sprintf(ptr, "Empty Rows <Tot %%> %d %.3f\n", num_empty_elements,
                  num_empty_elements * 100.0 / numRows());
+  //Reshuffles
+  ptr += sprintf(ptr, "Reshuffles <Tot Failed> %d %d\n", num_reshuffles,
+                 num_failed_reshuffles);
+  //Selection of C and V
+  if (chunk_strat == CHUNK_ADAPTIVE)
+    ptr += sprintf(ptr, "Adaptive Chunks <Cmax Vmax Candidates Cost> %d %d %d %.1f\n", C_max,
+                   V_max, chunk_candidates, chunk_cost);
+  //Scratch memory
+  ptr += sprintf(ptr, "Scratch Bytes <Allocated High-water> %zu %zu\n", scratch.allocated(),
+                 scratch.highWater());
 
   printf("%s\n",buffer);
 }
 
-template <class DataTypes, typename MemSpace>
+template <class DataTypes, typename MemSpace, typename Storage>
+TraversalStrategy SellCSigma<DataTypes, MemSpace, Storage>::traversal() const {
+  if (traversal_strat != TRAVERSE_DEFAULT)
+    return traversal_strat;
+  //Host threads are best used over contiguous ranges of slots while device teams keep
+  //  a thread per row so the accesses of a team are coalesced
+  if (std::is_same<memory_space, Kokkos::HostSpace>::value)
+    return TRAVERSE_FLAT;
+  return TRAVERSE_ROW_PER_THREAD;
+}
+
+template <class DataTypes, typename MemSpace, typename Storage>
 template <typename FunctionType>
-void SellCSigma<DataTypes, MemSpace>::parallel_for(FunctionType& fn, std::string name) {
+void SellCSigma<DataTypes, MemSpace, Storage>::parallel_for(FunctionType& fn, std::string name) {
   if (nPtcls() == 0)
     return;
-  FunctionType* fn_d;
-#ifdef PP_USE_CUDA
-  cudaMalloc(&fn_d, sizeof(FunctionType));
-  cudaMemcpy(fn_d,&fn, sizeof(FunctionType), cudaMemcpyHostToDevice);
-#else
-  fn_d = &fn;
-#endif
-  const lid_t league_size = num_slices;
+  //The functor is captured by value so no device copy has to be allocated per launch
+  FunctionType fn_d = fn;
   const lid_t team_size = C_;
-  const PolicyType policy(league_size, team_size);
   auto offsets_cpy = offsets;
   auto slice_to_chunk_cpy = slice_to_chunk;
   auto row_to_element_cpy = row_to_element;
   auto particle_mask_cpy = particle_mask;
-  Kokkos::parallel_for(name, policy,
-                       KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
-    const lid_t slice = thread.league_rank();
-    const lid_t slice_row = thread.team_rank();
-    const lid_t rowLen = (offsets_cpy(slice+1)-offsets_cpy(slice))/team_size;
-    const lid_t start = offsets_cpy(slice) + slice_row;
-    Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, team_size), [=] (lid_t& j) {
-      const lid_t row = slice_to_chunk_cpy(slice) * team_size + slice_row;
+  const TraversalStrategy strat = traversal();
+  if (strat == TRAVERSE_FLAT) {
+    //Each slot finds its slice by a binary search over the offsets
+    const lid_t nSlices = num_slices;
+    Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(0, capacity_),
+                         KOKKOS_LAMBDA(const lid_t& particle_id) {
+      lid_t low = 0;
+      lid_t high = nSlices;
+      while (high - low > 1) {
+        const lid_t mid = (low + high) / 2;
+        if (offsets_cpy(mid) <= particle_id)
+          low = mid;
+        else
+          high = mid;
+      }
+      const lid_t slice_row = (particle_id - offsets_cpy(low)) % team_size;
+      const lid_t row = slice_to_chunk_cpy(low) * team_size + slice_row;
       const lid_t element_id = row_to_element_cpy(row);
-      Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, rowLen), [&] (lid_t& p) {
-        const lid_t particle_id = start+(p*team_size);
-        const lid_t mask = particle_mask_cpy[particle_id];
-        (*fn_d)(element_id, particle_id, mask);
+      const lid_t mask = particle_mask_cpy(particle_id);
+      fn_d(element_id, particle_id, mask);
+    });
+  }
+  else if (strat == TRAVERSE_ROW_PER_LANE) {
+    //One thread per slice with the rows spread over the vector lanes
+    lid_t vector_length = 1;
+    if (!std::is_same<memory_space, Kokkos::HostSpace>::value)
+      while (vector_length * 2 <= team_size && vector_length * 2 <= 32)
+        vector_length *= 2;
+    const PolicyType policy(num_slices, 1, vector_length);
+    Kokkos::parallel_for(name, policy,
+                         KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
+      const lid_t slice = thread.league_rank();
+      const lid_t rowLen = (offsets_cpy(slice+1)-offsets_cpy(slice))/team_size;
+      Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, team_size),
+                           [&] (const lid_t& slice_row) {
+        const lid_t start = offsets_cpy(slice) + slice_row;
+        const lid_t row = slice_to_chunk_cpy(slice) * team_size + slice_row;
+        const lid_t element_id = row_to_element_cpy(row);
+        for (lid_t p = 0; p < rowLen; ++p) {
+          const lid_t particle_id = start+(p*team_size);
+          const lid_t mask = particle_mask_cpy(particle_id);
+          fn_d(element_id, particle_id, mask);
+        }
       });
     });
+  }
+  else {
+    //A team per slice with each thread of the team owning one row
+    const PolicyType policy(num_slices, team_size);
+    Kokkos::parallel_for(name, policy,
+                         KOKKOS_LAMBDA(const typename PolicyType::member_type& thread) {
+      const lid_t slice = thread.league_rank();
+      const lid_t rowLen = (offsets_cpy(slice+1)-offsets_cpy(slice))/team_size;
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(thread, team_size),
+                           [&] (const lid_t& slice_row) {
+        const lid_t start = offsets_cpy(slice) + slice_row;
+        const lid_t row = slice_to_chunk_cpy(slice) * team_size + slice_row;
+        const lid_t element_id = row_to_element_cpy(row);
+        Kokkos::parallel_for(Kokkos::ThreadVectorRange(thread, rowLen), [&] (const lid_t& p) {
+          const lid_t particle_id = start+(p*team_size);
+          const lid_t mask = particle_mask_cpy(particle_id);
+          fn_d(element_id, particle_id, mask);
+        });
+      });
+    });
+  }
+}
+
+template <class DataTypes, typename MemSpace, typename Storage>
+void SellCSigma<DataTypes, MemSpace, Storage>::setupActiveParticles() {
+  Kokkos::Profiling::pushRegion("scs_setup_active_particles");
+  //Index of each active particle in the compacted list
+  kkLidView active_index("active_index", capacity());
+  exclusive_scan(particle_mask, active_index);
+  if (active_ptcls.size() < static_cast<std::size_t>(num_ptcls)) {
+    active_ptcls = kkLidView("active_ptcls", num_ptcls);
+    active_elems = kkLidView("active_elems", num_ptcls);
+  }
+  auto active_ptcls_cpy = active_ptcls;
+  auto active_elems_cpy = active_elems;
+  auto setActive = PS_LAMBDA(const lid_t& elm_id, const lid_t& ptcl_id, const lid_t& mask) {
+    if (mask) {
+      const lid_t index = active_index(ptcl_id);
+      active_ptcls_cpy(index) = ptcl_id;
+      active_elems_cpy(index) = elm_id;
+    }
+  };
+  parallel_for(setActive, "setActive");
+  active_dirty = false;
+  Kokkos::Profiling::popRegion();
+}
+
+template <class DataTypes, typename MemSpace, typename Storage>
+template <typename FunctionType>
+void SellCSigma<DataTypes, MemSpace, Storage>::parallel_for_active(FunctionType& fn, std::string name) {
+  if (nPtcls() == 0)
+    return;
+  if (active_dirty)
+    setupActiveParticles();
+  FunctionType fn_d = fn;
+  auto active_ptcls_cpy = active_ptcls;
+  auto active_elems_cpy = active_elems;
+  Kokkos::parallel_for(name, Kokkos::RangePolicy<execution_space>(0, nPtcls()),
+                       KOKKOS_LAMBDA(const lid_t& i) {
+    const lid_t mask = 1;
+    fn_d(active_elems_cpy(i), active_ptcls_cpy(i), mask);
   });
 }
 
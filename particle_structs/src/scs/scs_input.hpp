@@ -1,4 +1,10 @@
 #pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <climits>
+#include <string>
 #include <particle_structure.hpp>
 namespace pumipic {
     enum PaddingStrategy {
@@ -7,11 +13,90 @@ namespace pumipic {
       //Divide padding proportionally (more particles in element = more padding)
       PAD_PROPORTIONALLY,
       //Divide padding inverse-proportionally (more particles in element = less padding)
-      PAD_INVERSELY
+      PAD_INVERSELY,
+      //Divide padding by the net inflow of particles to each element seen by reshuffle
+      //  (rows particles keep arriving in get more padding, evenly until there is history)
+      PAD_ADAPTIVE
     };
-  template <class DataTypes, typename MemSpace>
+    enum TraversalStrategy {
+      //Choose the traversal based on the execution space of the structure [Default]
+      TRAVERSE_DEFAULT,
+      //A team per slice, a thread per row and vector lanes over the particles of the row
+      TRAVERSE_ROW_PER_THREAD,
+      //A team per slice with a vector lane per row
+      TRAVERSE_ROW_PER_LANE,
+      //A flat range over every slot of the structure
+      TRAVERSE_FLAT
+    };
+    enum ChunkStrategy {
+      //C is the team size of the policy (or the number of elements with particles) [Default]
+      CHUNK_TEAM_SIZE,
+      //C and V are chosen by a cost model over the particles per element
+      //  The team size and V given to the structure are the largest values tried
+      CHUNK_ADAPTIVE
+    };
+    enum ElementOrder {
+      //Rows are sigma sorted starting from the order of the element ids [Default]
+      ORDER_NONE,
+      //Elements are ordered along a Morton (Z-order) curve through their centroids
+      ORDER_MORTON,
+      //Elements are ordered along a Hilbert curve through their centroids
+      ORDER_HILBERT
+    };
+    enum RebuildStrategy {
+      //Full rebuilds copy the particles into a second allocation (scs_data_swap) [Default]
+      REBUILD_SWAP,
+      //Full rebuilds move the particles within the current allocation using a small staging
+      //  buffer, no swap buffer is kept (a rebuild that grows the structure still allocates
+      //  the new size before freeing the old). The move holds a few index arrays of the new
+      //  capacity until it finishes and walks each chain of moves on one thread, so it is
+      //  slower than REBUILD_SWAP when the chains are long, especially on GPUs
+      REBUILD_IN_PLACE
+    };
+    enum MigrateStrategy {
+      //Counts and particles are exchanged with point to point messages to each rank of the
+      //  Distributor [Default]
+      MIGRATE_POINT_TO_POINT,
+      //Counts and particles are exchanged with neighborhood collectives over a distributed
+      //  graph communicator of the Distributor ranks (a world Distributor uses point to point)
+      //  The communicator is rebuilt after SellCSigma::markNeighborsStale
+      MIGRATE_NEIGHBOR,
+      //With a world Distributor the processes sending to each process are discovered with a
+      //  nonblocking consensus (synchronous sends of the counts and a nonblocking barrier)
+      //  instead of an all to all of the counts, otherwise the same as point to point
+      MIGRATE_NBX
+    };
+  template <class DataTypes, typename MemSpace, typename Storage>
   class SellCSigma;
 
+  /* Runtime configuration of SCS_Input
+
+     The parameters can be read from a file of `key = value` lines (# starts a comment) with
+       input.readConfig(filename)
+     or from environment variables named PS_SCS_<KEY> (ex: PS_SCS_SHUFFLE_PADDING=0.2).
+     The environment is read by the SellCSigma constructor, first loading the file named by
+       PS_SCS_CONFIG, so runs can be tuned without changing the values set in code.
+
+     Keys:
+       sigma, V, team_size - the sorting parameter, vertical slice size and chunk height
+       shuffle_padding, extra_padding - padding amounts
+       shrink_threshold - fraction of the allocation below which full rebuilds shrink it
+       keep_swap - true/false to keep the swap buffer between rebuilds
+       rebuild_strat - REBUILD_SWAP or REBUILD_IN_PLACE
+       staging_size - number of particles staged at once by REBUILD_IN_PLACE
+       migrate_strat - MIGRATE_POINT_TO_POINT, MIGRATE_NEIGHBOR or MIGRATE_NBX
+       padding_strat - PAD_EVENLY, PAD_PROPORTIONALLY, PAD_INVERSELY or PAD_ADAPTIVE
+       padding_history - weight of the newest reshuffle in the inflow history of PAD_ADAPTIVE
+       traversal_strat - TRAVERSE_DEFAULT, TRAVERSE_ROW_PER_THREAD, TRAVERSE_ROW_PER_LANE
+                         or TRAVERSE_FLAT
+       chunk_strat - CHUNK_TEAM_SIZE or CHUNK_ADAPTIVE
+       element_order - ORDER_NONE, ORDER_MORTON or ORDER_HILBERT (needs element_centroids)
+       sort_key_member - index of the member particles are ordered by within rows (-1 for none)
+       deterministic - true/false to assign slots without atomics
+       shuffling - true/false to try reshuffling before rebuilding
+       name - string identification of the structure
+     sigma accepts INT_MAX for full sorting.
+  */
   template <class DataTypes, typename MemSpace = DefaultMemSpace>
   class SCS_Input {
   public:
@@ -19,6 +104,7 @@ namespace pumipic {
     typedef typename ParticleStructure<DataTypes, MemSpace>::kkGidView kkGidView;
     typedef typename ParticleStructure<DataTypes, MemSpace>::MTVs MTVs;
     typedef Kokkos::TeamPolicy<typename MemSpace::execution_space> PolicyType;
+    typedef Kokkos::View<double*[3], typename MemSpace::device_type> CentroidView;
     SCS_Input(PolicyType& p, lid_t sigma, lid_t vertical_chunk_size, lid_t num_elements,
               lid_t num_particles, kkLidView particles_per_elements, kkGidView element_gids,
               kkLidView particle_elements = kkLidView(), MTVs particle_info = NULL);
@@ -27,14 +113,62 @@ namespace pumipic {
     double shuffle_padding;
     //Extra padding at the end of the structure to allow growth [default = 0.05 (5%)]
     double extra_padding;
+    //Full rebuilds shrink the particle allocations when the new capacity uses less than this
+    //  fraction of them [default = 0 (never shrink)]
+    double shrink_threshold;
+    //Keep the swap buffer used by full rebuilds allocated between rebuilds [default = true]
+    //  When false the buffer is allocated by each full rebuild and freed after it
+    bool keep_swap;
+
+    //Data movement of full rebuilds [default = REBUILD_SWAP]
+    RebuildStrategy rebuild_strat;
+    //Number of particles REBUILD_IN_PLACE stages at once [default = 4096]
+    lid_t staging_size;
+
+    //Communication used by migrate [default = MIGRATE_POINT_TO_POINT]
+    MigrateStrategy migrate_strat;
 
     //Padding strategy
     PaddingStrategy padding_strat;
+    //Weight (0, 1] of the newest reshuffle in the moving average of the inflow of particles
+    //  to each element used by PAD_ADAPTIVE [default = 0.25]
+    double padding_history;
+
+    //Traversal strategy used by parallel_for [default = TRAVERSE_DEFAULT]
+    TraversalStrategy traversal_strat;
+
+    //Selection of the chunk height and vertical slice size [default = CHUNK_TEAM_SIZE]
+    ChunkStrategy chunk_strat;
+
+    //Order of the elements before sigma sorting [default = ORDER_NONE]
+    ElementOrder element_order;
+    //Centroid of each element for the space filling curve orders
+    CentroidView element_centroids;
+
+    //Index of the arithmetic member that orders the particles within each row after every
+    //  rebuild and reshuffle, ties keep their slot order [default = -1 (unordered)]
+    int sort_key_member;
+
+    //Assign the slots of particles in rebuild, reshuffle and migrate by scans and stable
+    //  sorts instead of atomics so the layout only depends on the input [default = false]
+    //  The radix grouping makes host rebuilds slower than the atomic default (about 8-15%
+    //  in ps_rebuild), the device cost has not been measured
+    bool deterministic;
+
+    //Try reshuffling particles before rebuilding [default = true]
+    bool shuffling;
 
     //String identification for the particle structure
     std::string name;
 
-    friend class SellCSigma<DataTypes, MemSpace>;
+    //Reads `key = value` parameters from a file, returns false if any line is invalid
+    bool readConfig(const std::string& filename);
+    //Reads the PS_SCS_<KEY> environment variables, returns false if any value is invalid
+    bool readEnvironment();
+    //Sets the parameter named key, returns false if the key or value is invalid
+    bool setParameter(const std::string& key, const std::string& value);
+
+    template <class DT, typename MSpace, typename S> friend class SellCSigma;
   protected:
     PolicyType policy;
     lid_t sig, V;
@@ -53,7 +187,209 @@ namespace pumipic {
     particle_elms(pes), p_info(info) {
     shuffle_padding = 0.1;
     extra_padding = 0.05;
+    shrink_threshold = 0;
+    keep_swap = true;
+    rebuild_strat = REBUILD_SWAP;
+    staging_size = 4096;
+    migrate_strat = MIGRATE_POINT_TO_POINT;
     padding_strat = PAD_EVENLY;
+    padding_history = 0.25;
+    traversal_strat = TRAVERSE_DEFAULT;
+    chunk_strat = CHUNK_TEAM_SIZE;
+    element_order = ORDER_NONE;
+    sort_key_member = -1;
+    deterministic = false;
+    shuffling = true;
     name = "ptcls";
   }
+
+  //Parsing helpers of SCS_Input::setParameter and readConfig
+  namespace detail {
+    //Removes leading and trailing whitespace
+    inline std::string trimConfig(const std::string& str) {
+      const char* ws = " \t\r\n";
+      const size_t start = str.find_first_not_of(ws);
+      if (start == std::string::npos)
+        return "";
+      return str.substr(start, str.find_last_not_of(ws) - start + 1);
+    }
+    inline bool parseConfigInt(const std::string& value, lid_t& result) {
+      if (value == "INT_MAX") {
+        result = INT_MAX;
+        return true;
+      }
+      char* end;
+      const long val = strtol(value.c_str(), &end, 10);
+      if (end == value.c_str() || *end != '\0' || val <= 0 || val > INT_MAX)
+        return false;
+      result = val;
+      return true;
+    }
+    inline bool parseConfigDouble(const std::string& value, double& result) {
+      char* end;
+      const double val = strtod(value.c_str(), &end);
+      if (end == value.c_str() || *end != '\0' || val < 0)
+        return false;
+      result = val;
+      return true;
+    }
+    inline bool parseConfigBool(const std::string& value, bool& result) {
+      if (value == "true" || value == "1" || value == "on") {
+        result = true;
+        return true;
+      }
+      if (value == "false" || value == "0" || value == "off") {
+        result = false;
+        return true;
+      }
+      return false;
+    }
+    //Finds value in names and sets the matching enumerator
+    template <typename Enum, int N>
+    inline bool parseConfigEnum(const std::string& value, const char* const (&names)[N],
+                         Enum& result) {
+      for (int i = 0; i < N; ++i) {
+        if (value == names[i]) {
+          result = static_cast<Enum>(i);
+          return true;
+        }
+      }
+      return false;
+    }
+  }
+
+  template <class DataTypes, typename MemSpace>
+  bool SCS_Input<DataTypes, MemSpace>::setParameter(const std::string& key,
+                                                    const std::string& value) {
+    static const char* const padding_names[] = {"PAD_EVENLY", "PAD_PROPORTIONALLY",
+                                                "PAD_INVERSELY", "PAD_ADAPTIVE"};
+    static const char* const traversal_names[] = {"TRAVERSE_DEFAULT", "TRAVERSE_ROW_PER_THREAD",
+                                                  "TRAVERSE_ROW_PER_LANE", "TRAVERSE_FLAT"};
+    static const char* const chunk_names[] = {"CHUNK_TEAM_SIZE", "CHUNK_ADAPTIVE"};
+    static const char* const rebuild_names[] = {"REBUILD_SWAP", "REBUILD_IN_PLACE"};
+    static const char* const order_names[] = {"ORDER_NONE", "ORDER_MORTON", "ORDER_HILBERT"};
+    static const char* const migrate_names[] = {"MIGRATE_POINT_TO_POINT", "MIGRATE_NEIGHBOR",
+                                                "MIGRATE_NBX"};
+    bool valid = true;
+    if (key == "sigma")
+      valid = detail::parseConfigInt(value, sig);
+    else if (key == "V")
+      valid = detail::parseConfigInt(value, V);
+    else if (key == "team_size") {
+      lid_t team_size;
+      valid = detail::parseConfigInt(value, team_size);
+      if (valid)
+        policy = PolicyType(policy.league_size(), team_size);
+    }
+    else if (key == "shuffle_padding")
+      valid = detail::parseConfigDouble(value, shuffle_padding);
+    else if (key == "extra_padding")
+      valid = detail::parseConfigDouble(value, extra_padding);
+    else if (key == "shrink_threshold") {
+      double threshold;
+      valid = detail::parseConfigDouble(value, threshold) && threshold < 1;
+      if (valid)
+        shrink_threshold = threshold;
+    }
+    else if (key == "keep_swap")
+      valid = detail::parseConfigBool(value, keep_swap);
+    else if (key == "rebuild_strat")
+      valid = detail::parseConfigEnum(value, rebuild_names, rebuild_strat);
+    else if (key == "staging_size")
+      valid = detail::parseConfigInt(value, staging_size);
+    else if (key == "migrate_strat")
+      valid = detail::parseConfigEnum(value, migrate_names, migrate_strat);
+    else if (key == "padding_strat")
+      valid = detail::parseConfigEnum(value, padding_names, padding_strat);
+    else if (key == "padding_history") {
+      double weight;
+      valid = detail::parseConfigDouble(value, weight) && weight > 0 && weight <= 1;
+      if (valid)
+        padding_history = weight;
+    }
+    else if (key == "traversal_strat")
+      valid = detail::parseConfigEnum(value, traversal_names, traversal_strat);
+    else if (key == "chunk_strat")
+      valid = detail::parseConfigEnum(value, chunk_names, chunk_strat);
+    else if (key == "element_order")
+      valid = detail::parseConfigEnum(value, order_names, element_order);
+    else if (key == "sort_key_member") {
+      //Member indices start at 0 and -1 turns the ordering off
+      char* end;
+      const long member = strtol(value.c_str(), &end, 10);
+      valid = end != value.c_str() && *end == '\0' && member >= -1 && member < INT_MAX;
+      if (valid)
+        sort_key_member = member;
+    }
+    else if (key == "deterministic")
+      valid = detail::parseConfigBool(value, deterministic);
+    else if (key == "shuffling")
+      valid = detail::parseConfigBool(value, shuffling);
+    else if (key == "name")
+      name = value;
+    else {
+      fprintf(stderr, "[ERROR] Unknown SCS_Input parameter \"%s\"\n", key.c_str());
+      return false;
+    }
+    if (!valid)
+      fprintf(stderr, "[ERROR] Invalid value \"%s\" for SCS_Input parameter %s\n",
+              value.c_str(), key.c_str());
+    return valid;
+  }
+
+  template <class DataTypes, typename MemSpace>
+  bool SCS_Input<DataTypes, MemSpace>::readConfig(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "r");
+    if (!file) {
+      fprintf(stderr, "[ERROR] Cannot open SCS_Input configuration %s\n", filename.c_str());
+      return false;
+    }
+    bool valid = true;
+    char buffer[1024];
+    int line_num = 0;
+    while (fgets(buffer, sizeof(buffer), file)) {
+      ++line_num;
+      std::string line(buffer);
+      const size_t comment = line.find('#');
+      if (comment != std::string::npos)
+        line = line.substr(0, comment);
+      line = detail::trimConfig(line);
+      if (line.empty())
+        continue;
+      const size_t equals = line.find('=');
+      if (equals == std::string::npos) {
+        fprintf(stderr, "[ERROR] Line %d of %s is not of the form key = value\n", line_num,
+                filename.c_str());
+        valid = false;
+        continue;
+      }
+      valid &= setParameter(detail::trimConfig(line.substr(0, equals)),
+                            detail::trimConfig(line.substr(equals + 1)));
+    }
+    fclose(file);
+    return valid;
+  }
+
+  template <class DataTypes, typename MemSpace>
+  bool SCS_Input<DataTypes, MemSpace>::readEnvironment() {
+    bool valid = true;
+    const char* config = getenv("PS_SCS_CONFIG");
+    if (config)
+      valid &= readConfig(config);
+    static const char* const keys[] = {"sigma", "V", "team_size", "shuffle_padding",
+                                       "extra_padding", "shrink_threshold", "keep_swap",
+                                       "rebuild_strat", "staging_size", "migrate_strat",
+                                       "padding_strat", "padding_history", "traversal_strat",
+                                       "chunk_strat", "element_order", "sort_key_member",
+                                       "deterministic", "shuffling", "name"};
+    for (const char* key : keys) {
+      std::string var = "PS_SCS_";
+      for (const char* c = key; *c; ++c)
+        var += toupper(*c);
+      const char* value = getenv(var.c_str());
+      if (value)
+        valid &= setParameter(key, detail::trimConfig(value));
+    }
+    return valid;
+  }
 }
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <type_traits>
+#include <Kokkos_Core.hpp>
+#include <ppMacros.h>
+#include <ppTypes.h>
+#include <ppView.h>
+#include "MemberTypeLayout.h"
+
+namespace pumipic {
+
+  /* Storage layouts of the particle data of a particle structure
+       SoA - each member is stored in its own view [Default]
+       AoSoA<TileSize> - the members are interleaved in tiles of TileSize particles
+         Each tile holds every member of TileSize particles with each component stored
+         contiguously across the tile. TileSize should match the chunk height (C) of a
+         SellCSigma so that the particles of a chunk share their tiles.
+         Cold members (see Member in MemberTypes.h) are stored in their own views so the
+         tiles only hold the members used by the particle push.
+  */
+  struct SoA {};
+  template <int TileSize> struct AoSoA {
+    static_assert(TileSize > 0, "AoSoA tile size must be positive");
+    static constexpr int tile_size = TileSize;
+  };
+
+  //Alignment in bytes of each member within a tile
+  constexpr std::size_t AOSOA_ALIGNMENT = 64;
+
+  /* View of one member of the particle data stored in an AoSoA allocation
+     The accessors match the member views of the SoA layout so that Segments and
+       the copy functions can be used with either layout
+   */
+  template <typename M, typename Device, int TileSize>
+  class TiledView {
+  public:
+    typedef typename MemberTraits<M>::type T;
+    typedef typename BaseType<T>::type BT;
+    typedef Device device_type;
+    typedef typename Device::memory_space memory_space;
+    typedef typename Device::execution_space execution_space;
+    typedef Kokkos::View<char*, Device> BufferView;
+    static constexpr int rank = BaseType<T*>::rank;
+    static constexpr int num_comps = BaseType<T>::size;
+    //Bytes of the member within one tile
+    static constexpr std::size_t tile_bytes =
+      (TileSize * num_comps * sizeof(BT) + AOSOA_ALIGNMENT - 1) /
+      AOSOA_ALIGNMENT * AOSOA_ALIGNMENT;
+    static_assert(AOSOA_ALIGNMENT % sizeof(BT) == 0,
+                  "AoSoA member types must evenly divide the tile alignment");
+
+    TiledView() : ptr(NULL), n(0), tile_stride(0) {}
+    /* buffer - the allocation shared by every member
+       offset - bytes from the start of a tile to this member
+       stride - bytes of an entire tile
+       size - number of particles
+    */
+    TiledView(BufferView buffer, std::size_t offset, std::size_t stride, lid_t size)
+      : buffer_(buffer), ptr(reinterpret_cast<BT*>(buffer.data() + offset)), n(size),
+        tile_stride(stride / sizeof(BT)) {}
+
+    //The allocation shared by every member
+    BufferView buffer() const {return buffer_;}
+
+    PP_INLINE lid_t size() const {return n * num_comps;}
+    PP_INLINE lid_t extent(int dim) const {
+      return dim == 0 ? n : static_cast<lid_t>(extentOf(dim - 1));
+    }
+
+    PP_INLINE BT& operator()(const int& p) const {return ptr[index(p, 0)];}
+    PP_INLINE BT& operator()(const int& p, const int& i) const {return ptr[index(p, i)];}
+    PP_INLINE BT& operator()(const int& p, const int& i, const int& j) const {
+      return ptr[index(p, i * std::extent<T, 1>::value + j)];
+    }
+    PP_INLINE BT& operator()(const int& p, const int& i, const int& j, const int& k) const {
+      return ptr[index(p, (i * std::extent<T, 1>::value + j) * std::extent<T, 2>::value + k)];
+    }
+
+  private:
+    BufferView buffer_;
+    BT* ptr;
+    lid_t n;
+    lid_t tile_stride;
+
+    PP_INLINE lid_t index(const lid_t p, const lid_t comp) const {
+      return (p / TileSize) * tile_stride + comp * TileSize + p % TileSize;
+    }
+    PP_INLINE static std::size_t extentOf(int dim) {
+      return dim == 0 ? std::extent<T, 0>::value :
+        (dim == 1 ? std::extent<T, 1>::value : std::extent<T, 2>::value);
+    }
+  };
+
+  //Bytes of one tile of an AoSoA holding every member of Types
+  template <int TileSize, typename Device, typename... Types> struct AoSoATileBytes;
+  template <int TileSize, typename Device> struct AoSoATileBytes<TileSize, Device> {
+    static constexpr std::size_t value = 0;
+  };
+  template <int TileSize, typename Device, typename T, typename... Types>
+  struct AoSoATileBytes<TileSize, Device, T, Types...> {
+    static constexpr std::size_t value =
+      (MemberTraits<T>::hot ? TiledView<T, Device, TileSize>::tile_bytes : 0) +
+      AoSoATileBytes<TileSize, Device, Types...>::value;
+  };
+
+  /* StorageView<Storage, T, Device>::type - the view type of a member in the given storage
+   */
+  template <typename Storage, typename T, typename Device> struct StorageView;
+  template <typename T, typename Device> struct StorageView<SoA, T, Device> {
+    typedef MemberTypeView<T, Device> type;
+  };
+  template <int TileSize, typename T, typename Device>
+  struct StorageView<AoSoA<TileSize>, T, Device> {
+    typedef typename std::conditional<MemberTraits<T>::hot,
+                                      TiledView<T, Device, TileSize>,
+                                      MemberTypeView<T, Device> >::type type;
+  };
+
+  /* CopyMember<T> - copies the value of one particle between member views of any storage
+       Usage: CopyMember<T>(DestinationView, DestinationIndex, SourceView, SourceIndex);
+   */
+  template <class T> struct CopyMember {
+    template <class DstView, class SrcView>
+    PP_INLINE CopyMember(const DstView& dst, int dst_index, const SrcView& src, int src_index) {
+      dst(dst_index) = src(src_index);
+    }
+  };
+  template <class T, int N> struct CopyMember<T[N]> {
+    template <class DstView, class SrcView>
+    PP_INLINE CopyMember(const DstView& dst, int dst_index, const SrcView& src, int src_index) {
+      for (int i = 0; i < N; ++i)
+        dst(dst_index, i) = src(src_index, i);
+    }
+  };
+  template <class T, int N, int M> struct CopyMember<T[N][M]> {
+    template <class DstView, class SrcView>
+    PP_INLINE CopyMember(const DstView& dst, int dst_index, const SrcView& src, int src_index) {
+      for (int i = 0; i < N; ++i)
+        for (int j = 0; j < M; ++j)
+          dst(dst_index, i, j) = src(src_index, i, j);
+    }
+  };
+  template <class T, int N, int M, int P> struct CopyMember<T[N][M][P]> {
+    template <class DstView, class SrcView>
+    PP_INLINE CopyMember(const DstView& dst, int dst_index, const SrcView& src, int src_index) {
+      for (int i = 0; i < N; ++i)
+        for (int j = 0; j < M; ++j)
+          for (int k = 0; k < P; ++k)
+            dst(dst_index, i, j, k) = src(src_index, i, j, k);
+    }
+  };
+  template <class T, class Layout, std::size_t Alignment, bool Hot>
+  struct CopyMember<Member<T, Layout, Alignment, Hot> > {
+    template <class DstView, class SrcView>
+    PP_INLINE CopyMember(const DstView& dst, int dst_index, const SrcView& src, int src_index) {
+      CopyMember<T>(dst, dst_index, src, src_index);
+    }
+  };
+}
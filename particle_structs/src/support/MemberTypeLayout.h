@@ -0,0 +1,53 @@
+#pragma once
+
+#include <type_traits>
+#include <Kokkos_Core.hpp>
+#include <ppTypes.h>
+#include <ppView.h>
+#include "MemberTypes.h"
+
+namespace pumipic {
+
+  /* MemberLayout<T>::type - the Kokkos array layout of the view of member T
+       Members without a layout option use Kokkos::LayoutLeft
+   */
+  template <typename T> struct MemberLayout {
+    typedef typename MemberTraits<T>::layout Declared;
+    typedef typename std::conditional<std::is_void<Declared>::value,
+                                      Kokkos::LayoutLeft, Declared>::type type;
+  };
+
+  //The view of one member of MemberTypes with the options of the member applied
+  template <typename T, typename Device>
+  using MemberTypeView = View<typename MemberTraits<T>::type*, Device,
+                              typename MemberLayout<T>::type>;
+
+  /* MemberPadding<Types...>::value - number of particles the extent of the member views is
+                                      rounded up to
+
+     Kokkos allocations start on (at least) a 64 byte boundary. Rounding every member view to
+       the same particle extent keeps the component columns of each aligned LayoutLeft member
+       on its alignment while views of the same size still have matching extents.
+   */
+  template <typename... Types> struct MemberPadding;
+  template <> struct MemberPadding<> {
+    static constexpr std::size_t value = 1;
+  };
+  template <typename T, typename... Types> struct MemberPadding<T, Types...> {
+    typedef MemberTraits<T> Traits;
+    typedef typename BaseType<typename Traits::type>::type BT;
+    static_assert(Traits::alignment % sizeof(BT) == 0,
+                  "Member alignment must be a multiple of the size of its base type");
+    static constexpr std::size_t self = Traits::alignment == 0 ? 1 :
+      Traits::alignment / sizeof(BT);
+    static constexpr std::size_t rest = MemberPadding<Types...>::value;
+    static constexpr std::size_t value = self > rest ? self : rest;
+  };
+
+  //Number of particles allocated in each member view for size particles
+  template <typename... Types>
+  lid_t paddedMemberExtent(lid_t size) {
+    const lid_t pad = MemberPadding<Types...>::value;
+    return (size + pad - 1) / pad * pad;
+  }
+}
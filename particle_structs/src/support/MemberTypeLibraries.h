@@ -3,6 +3,9 @@
 #include <ViewComm.h>
 #include <SupportKK.h>
 #include "MemberTypeArray.h"
+#include "MemberTypeLayout.h"
+#include "MemberTypeAoSoA.h"
+#include "MemberTypePack.h"
 #include <ppMacros.h>
 #include <ppTypes.h>
 #include <ppView.h>
@@ -15,7 +18,7 @@ namespace pumipic {
   //This type represents an array of views for each type of the given DataTypes
   using MemberTypeViews = void**;
   using MemberTypeViewsConst = void* const*;
-  template <typename T, typename Device> using MemberTypeView = View<T*, Device>;
+  //MemberTypeView<T, Device> is the view of a single member (see MemberTypeLayout.h)
 
   /* Template Fuctions for external usage
        Note: MemorySpace defaults to the default memory space if none is provided
@@ -33,7 +36,7 @@ namespace pumipic {
     MemberTypeViews createMemberViews(int size);
 
   template <typename DataTypes, size_t N, typename MemSpace = DefaultMemSpace>
-    MemberTypeView<typename MemberTypeAtIndex<N,DataTypes>::type,typename MemSpace::device_type>
+    MemberTypeView<typename MemberTypeAtIndex<N,DataTypes>::member,typename MemSpace::device_type>
     getMemberView(MemberTypeViews view);
 
   template <typename DataTypes, typename MemSpace = DefaultMemSpace>
@@ -56,6 +59,13 @@ namespace pumipic {
                                                       DestionationIndexPerSource);
   */
   template <typename PS, typename... Types> struct CopyViewsToViews;
+  /* CopyViewsToPS<ParticleStructure, DataTypes> - copies particle info from views to specific
+                                                   indices in the storage of a particle structure
+       Usage: CopyViewsToPS<ParticleStructure, MemberTypes>(PSMemberTypeViews,
+                                                            SourceMemberTypeViews,
+                                                            DestionationIndexPerSource);
+  */
+  template <typename PS, typename... Types> struct CopyViewsToPS;
   /* ShuffleParticles<ParticleStructure, DataTypes> - shuffles particle info within a ps
                                                       and add new particles
        Usage: ShuffleParticles<ParticleStructure, MemberTypes>(PSMemberTypeViews,
@@ -77,12 +87,26 @@ namespace pumipic {
                                              MPI_Comm, ArrayOfRequests);
    */
   template <typename Device, typename... Types> struct RecvViews;
+  /* UnpackParticles<Device, DataTypes> - copies the members of packed particle records
+                                          (see MemberTypePack.h) into member views
+       Usage: UnpackParticles<Device, MemberTypes>(DestinationMemberTypeViews, RecordBuffer,
+                                                   NumberOfRecords);
+  */
+  template <typename Device, typename... Types> struct UnpackParticles;
   /* CopyMemSpaceToMemSpace<DestinationMemSpace, SourceMemSpace, DataTypes> -
            Copies Member type views from one memory space to another memory space
       Usage: CopyMSpaceToMSpace<DestinationMemSpace, SourceMemSpace, MemberTypes>(DestinationMTV,
                                                                                   SourceMTV)
   */
   template <typename MSpace1, typename MSpace2, typename... Types> struct CopyMemSpaceToMemSpace;
+  /* StorageViews<Storage, Device, DataTypes> - creates, destroys and copies member views
+                                                 in the storage layout of a particle structure
+       Usage: StorageViews<Storage, Device, MemberTypes>::create(MemberTypeViews, size);
+              StorageViews<Storage, Device, MemberTypes>::destroy(MemberTypeViews);
+              StorageViews<Storage, Device, MemberTypes>::copy<SourceDevice>(DestinationMTV,
+                                                                            SourceMTV);
+  */
+  template <typename Storage, typename Device, typename DataTypes> struct StorageViews;
 
 
   //Functions
@@ -93,9 +117,9 @@ namespace pumipic {
     return views;
   }
   template <typename DataTypes, size_t N,typename MemSpace>
-    MemberTypeView<typename MemberTypeAtIndex<N,DataTypes>::type,typename MemSpace::device_type>
+    MemberTypeView<typename MemberTypeAtIndex<N,DataTypes>::member,typename MemSpace::device_type>
     getMemberView(MemberTypeViews view) {
-    using Type = typename MemberTypeAtIndex<N, DataTypes>::type;
+    using Type = typename MemberTypeAtIndex<N, DataTypes>::member;
     return *(static_cast<MemberTypeView<Type, typename MemSpace::device_type>*>(view[N]));
   }
   template <typename DataTypes, typename MemSpace>
@@ -122,7 +146,7 @@ namespace pumipic {
   template <typename Device, typename... Types> struct CreateViews<Device, MemberTypes<Types...> > {
     CreateViews(MemberTypeViews& views, int size) {
       views = new void*[MemberTypes<Types...>::size];
-      CreateViewsImpl<Device, Types...>(views, size, 0);
+      CreateViewsImpl<Device, Types...>(views, paddedMemberExtent<Types...>(size), 0);
     }
   };
 
@@ -130,15 +154,17 @@ namespace pumipic {
 
 
 
-  template <typename View, typename... Types> struct CopyViewsToViewsImpl;
-  template <typename View> struct CopyViewsToViewsImpl<View> {
+  template <typename Storage, typename View, typename... Types> struct CopyViewsToViewsImpl;
+  template <typename Storage, typename View> struct CopyViewsToViewsImpl<Storage, View> {
     typedef typename View::device_type Device;
     CopyViewsToViewsImpl(MemberTypeViewsConst,
                          MemberTypeViewsConst,
                          View) {}
   };
-  template <typename View, typename T, typename... Types> struct CopyViewsToViewsImpl<View, T,Types...> {
+  template <typename Storage, typename View, typename T, typename... Types>
+  struct CopyViewsToViewsImpl<Storage, View, T,Types...> {
     typedef typename View::device_type Device;
+    typedef typename StorageView<Storage, T, Device>::type DstView;
     CopyViewsToViewsImpl(MemberTypeViewsConst dsts,
                          MemberTypeViewsConst srcs,
                          View ps_indices) {
@@ -147,7 +173,7 @@ namespace pumipic {
     void enclose(MemberTypeViewsConst dsts,
                  MemberTypeViewsConst srcs,
                  View ps_indices) {
-      MemberTypeView<T, Device> dst = *static_cast<MemberTypeView<T, Device> const*>(dsts[0]);
+      DstView dst = *static_cast<DstView const*>(dsts[0]);
       MemberTypeView<T, Device> src = *static_cast<MemberTypeView<T, Device> const*>(srcs[0]);
       int size = dst.extent(0);
       Kokkos::parallel_for(ps_indices.size(), KOKKOS_LAMBDA(const int& i) {
@@ -155,9 +181,9 @@ namespace pumipic {
         if (index >= size || index < 0) {
           printf("[ERROR] copying view to view from %d to %d outside of [0-%d)\n", i, index, size);
         }
-        CopyViewToView<T,Device>(dst, index, src, i);
+        CopyMember<T>(dst, index, src, i);
       });
-      CopyViewsToViewsImpl<View, Types...>(dsts+1, srcs+1, ps_indices);
+      CopyViewsToViewsImpl<Storage, View, Types...>(dsts+1, srcs+1, ps_indices);
     }
   };
   template <typename View, typename... Types> struct CopyViewsToViews<View, MemberTypes<Types...> > {
@@ -166,7 +192,16 @@ namespace pumipic {
                      MemberTypeViewsConst srcs,
                          View ps_indices) {
       if (dsts != NULL && srcs != NULL)
-        CopyViewsToViewsImpl<View, Types...>(dsts, srcs, ps_indices);
+        CopyViewsToViewsImpl<SoA, View, Types...>(dsts, srcs, ps_indices);
+    }
+  };
+  template <typename PS, typename... Types> struct CopyViewsToPS<PS, MemberTypes<Types...> > {
+    typedef typename PS::kkLidView View;
+    CopyViewsToPS(MemberTypeViewsConst dsts,
+                  MemberTypeViewsConst srcs,
+                  View ps_indices) {
+      if (dsts != NULL && srcs != NULL)
+        CopyViewsToViewsImpl<typename PS::storage_type, View, Types...>(dsts, srcs, ps_indices);
     }
   };
 
@@ -226,8 +261,9 @@ namespace pumipic {
     void enclose(MemberTypeViewsConst ps,
                  MemberTypeViewsConst new_particles,
                  LidView old_indices, LidView new_indices, LidView fromPS) {
+      typedef typename StorageView<typename PS::storage_type, T, Device>::type PSView;
       int nMoving = old_indices.size();
-      MemberTypeView<T, Device> ps_view = *static_cast<MemberTypeView<T, Device> const*>(ps[0]);
+      PSView ps_view = *static_cast<PSView const*>(ps[0]);
       MemberTypeView<T, Device> new_view;
       if (new_particles != NULL) {
         new_view = *static_cast<MemberTypeView<T, Device> const*>(new_particles[0]);
@@ -238,8 +274,10 @@ namespace pumipic {
           const lid_t old_index = old_indices(i);
           const lid_t new_index = new_indices(i);
           const lid_t isPS = fromPS(i);
-          auto src = (isPS == 1 ? ps_view : new_view);
-          CopyViewToView<T, Device>(ps_view, new_index, src, old_index);
+          if (isPS == 1)
+            CopyMember<T>(ps_view, new_index, ps_view, old_index);
+          else
+            CopyMember<T>(ps_view, new_index, new_view, old_index);
       });
       ShuffleParticlesImpl<PS, Types...>(ps+1, new_particles, old_indices, new_indices, fromPS);
     }
@@ -297,6 +335,35 @@ namespace pumipic {
     }
   };
 
+  template <typename Device, typename Offsets, typename... Types> struct UnpackParticlesImpl;
+  template <typename Device, typename Offsets> struct UnpackParticlesImpl<Device, Offsets> {
+    UnpackParticlesImpl(MemberTypeViewsConst, char*, std::size_t, lid_t) {}
+  };
+  template <typename Device, typename Offsets, typename T, typename... Types>
+  struct UnpackParticlesImpl<Device, Offsets, T, Types...> {
+    UnpackParticlesImpl(MemberTypeViewsConst dsts, char* buffer, std::size_t record_size,
+                        lid_t num_records) {
+      MemberTypeView<T, Device> dst = *static_cast<MemberTypeView<T, Device> const*>(dsts[0]);
+      PackedMember<T> src(buffer, Offsets::offset, record_size);
+      Kokkos::parallel_for("unpack_particles", num_records, KOKKOS_LAMBDA(const lid_t& i) {
+        CopyMember<T>(dst, i, src, i);
+      });
+      UnpackParticlesImpl<Device, typename Offsets::Next, Types...>(dsts + 1, buffer,
+                                                                     record_size, num_records);
+    }
+  };
+
+  template <typename Device, typename... Types>
+  struct UnpackParticles<Device, MemberTypes<Types...> > {
+    typedef PackedLayout<MemberTypes<Types...> > Layout;
+    UnpackParticles(MemberTypeViewsConst dsts, char* buffer, lid_t num_records) {
+      if (num_records > 0)
+        UnpackParticlesImpl<Device, typename Layout::Members, Types...>(dsts, buffer,
+                                                                        Layout::size,
+                                                                        num_records);
+    }
+  };
+
   //Implementation to deallocate views of different types
   template <typename Device, typename... Types> struct DestroyViewsImpl;
   template <typename Device> struct DestroyViewsImpl<Device> {
@@ -317,4 +384,102 @@ namespace pumipic {
     }
   };
 
+  //Create, destroy and copy the member views of each storage layout
+  template <typename Device, typename DataTypes> struct StorageViews<SoA, Device, DataTypes> {
+    static void create(MemberTypeViews& views, int size) {
+      CreateViews<Device, DataTypes>(views, size);
+    }
+    static void destroy(MemberTypeViews views) {
+      DestroyViews<Device, DataTypes>(views+0);
+    }
+    template <typename Device2>
+    static void copy(MemberTypeViews dsts, MemberTypeViewsConst srcs) {
+      CopyMemSpaceToMemSpace<Device, Device2, DataTypes>(dsts, srcs);
+    }
+  };
+
+  template <int TileSize, typename Device, typename... Types> struct CreateTiledViewsImpl;
+  template <int TileSize, typename Device> struct CreateTiledViewsImpl<TileSize, Device> {
+    CreateTiledViewsImpl(MemberTypeViews, Kokkos::View<char*, Device>, std::size_t,
+                         std::size_t, int) {}
+  };
+  template <int TileSize, typename Device, typename T, typename... Types>
+  struct CreateTiledViewsImpl<TileSize, Device, T, Types...> {
+    typedef TiledView<T, Device, TileSize> ViewType;
+    CreateTiledViewsImpl(MemberTypeViews views, Kokkos::View<char*, Device> buffer,
+                         std::size_t offset, std::size_t stride, int size) {
+      std::size_t next_offset = offset;
+      //Cold members are allocated outside of the tiles
+      if (MemberTraits<T>::hot) {
+        views[0] = new ViewType(buffer, offset, stride, size);
+        next_offset += ViewType::tile_bytes;
+      }
+      else
+        views[0] = new MemberTypeView<T, Device>("aosoa_cold_data", size);
+      CreateTiledViewsImpl<TileSize, Device, Types...>(views+1, buffer, next_offset,
+                                                       stride, size);
+    }
+  };
+
+  template <int TileSize, typename Device, typename... Types> struct DestroyTiledViewsImpl;
+  template <int TileSize, typename Device> struct DestroyTiledViewsImpl<TileSize, Device> {
+    DestroyTiledViewsImpl(MemberTypeViews) {}
+  };
+  template <int TileSize, typename Device, typename T, typename... Types>
+  struct DestroyTiledViewsImpl<TileSize, Device, T, Types...> {
+    DestroyTiledViewsImpl(MemberTypeViews data) {
+      delete static_cast<typename StorageView<AoSoA<TileSize>, T, Device>::type*>(data[0]);
+      DestroyTiledViewsImpl<TileSize, Device, Types...>(data+1);
+    }
+  };
+
+  //Copies the tiles with the first hot member and each cold member separately
+  template <int TileSize, typename Device1, typename Device2, typename... Types>
+  struct CopyTiledViewsImpl;
+  template <int TileSize, typename Device1, typename Device2>
+  struct CopyTiledViewsImpl<TileSize, Device1, Device2> {
+    CopyTiledViewsImpl(MemberTypeViews, MemberTypeViewsConst, bool) {}
+  };
+  template <int TileSize, typename Device1, typename Device2, typename T, typename... Types>
+  struct CopyTiledViewsImpl<TileSize, Device1, Device2, T, Types...> {
+    typedef typename StorageView<AoSoA<TileSize>, T, Device1>::type DstView;
+    typedef typename StorageView<AoSoA<TileSize>, T, Device2>::type SrcView;
+    CopyTiledViewsImpl(MemberTypeViews dsts, MemberTypeViewsConst srcs, bool tiles_copied) {
+      if (!MemberTraits<T>::hot || !tiles_copied)
+        copyMember(static_cast<DstView*>(dsts[0]), static_cast<SrcView const*>(srcs[0]));
+      CopyTiledViewsImpl<TileSize, Device1, Device2, Types...>(dsts+1, srcs+1,
+                                                               tiles_copied ||
+                                                               MemberTraits<T>::hot);
+    }
+    template <typename M1, typename M2>
+    static void copyMember(TiledView<M1, Device1, TileSize>* dst,
+                           TiledView<M2, Device2, TileSize> const* src) {
+      Kokkos::deep_copy(dst->buffer(), src->buffer());
+    }
+    template <typename V1, typename V2>
+    static void copyMember(V1* dst, V2 const* src) {
+      deep_copy(*dst, *src);
+    }
+  };
+
+  template <int TileSize, typename Device, typename... Types>
+  struct StorageViews<AoSoA<TileSize>, Device, MemberTypes<Types...> > {
+    //Every hot member shares one allocation of whole tiles
+    static void create(MemberTypeViews& views, int size) {
+      const std::size_t tile_bytes = AoSoATileBytes<TileSize, Device, Types...>::value;
+      const std::size_t num_tiles = (size + TileSize - 1) / TileSize;
+      Kokkos::View<char*, Device> buffer("aosoa_data", num_tiles * tile_bytes);
+      views = new void*[MemberTypes<Types...>::size];
+      CreateTiledViewsImpl<TileSize, Device, Types...>(views, buffer, 0, tile_bytes, size);
+    }
+    static void destroy(MemberTypeViews views) {
+      DestroyTiledViewsImpl<TileSize, Device, Types...>(views+0);
+      delete [] views;
+    }
+    //The layouts match so the tiles are copied at once
+    template <typename Device2>
+    static void copy(MemberTypeViews dsts, MemberTypeViewsConst srcs) {
+      CopyTiledViewsImpl<TileSize, Device, Device2, Types...>(dsts, srcs, false);
+    }
+  };
 }
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <type_traits>
+#include <Kokkos_Core.hpp>
+#include <ppMacros.h>
+#include <ppTypes.h>
+#include "MemberTypes.h"
+
+namespace pumipic {
+
+  /* PackedLayout<DataTypes> - byte layout of one particle packed into a migration message
+
+     The element of the particle is stored first followed by each member at an offset aligned
+       to the base type of the member. The size of a record is rounded up to the largest
+       alignment so every record of a buffer of records stays aligned.
+       Usage: PackedLayout<MemberTypes>::size - number of bytes of one record
+              PackedLayout<MemberTypes>::element(buffer, index) - element of record index
+              PackedLayout<MemberTypes>::Members - offsets of the members (see PackedOffsets)
+  */
+  template <typename DataTypes> struct PackedLayout;
+
+  /* PackedOffsets<Start, Types...> - offset of the first member of Types starting from byte
+                                      Start and the offsets of the remaining members in Next
+  */
+  template <std::size_t Start, typename... Types> struct PackedOffsets;
+  template <std::size_t Start> struct PackedOffsets<Start> {
+    static constexpr std::size_t end = Start;
+    static constexpr std::size_t alignment = 1;
+  };
+  template <std::size_t Start, typename T, typename... Types>
+  struct PackedOffsets<Start, T, Types...> {
+    typedef typename MemberTraits<T>::type Type;
+    typedef typename BaseType<Type>::type BT;
+    static constexpr std::size_t offset = (Start + alignof(BT) - 1) / alignof(BT) * alignof(BT);
+    typedef PackedOffsets<offset + sizeof(Type), Types...> Next;
+    static constexpr std::size_t end = Next::end;
+    static constexpr std::size_t alignment = alignof(BT) > Next::alignment ? alignof(BT) :
+      Next::alignment;
+  };
+
+  template <typename... Types> struct PackedLayout<MemberTypes<Types...> > {
+    typedef PackedOffsets<sizeof(lid_t), Types...> Members;
+    static constexpr std::size_t alignment = Members::alignment > alignof(lid_t) ?
+      Members::alignment : alignof(lid_t);
+    static constexpr std::size_t size = (Members::end + alignment - 1) / alignment * alignment;
+    PP_INLINE static lid_t& element(char* buffer, lid_t index) {
+      return *reinterpret_cast<lid_t*>(buffer + index * size);
+    }
+  };
+
+  /* PackedMember<T> - accesses member T of the records of a packed buffer like a member view
+       so that CopyMember<T> can copy between member views and packed records
+       Usage: PackedMember<T> records(buffer, MemberOffset, RecordSize);
+              CopyMember<T>(records, RecordIndex, SourceView, SourceIndex);
+  */
+  template <typename T> struct PackedMember {
+    typedef typename MemberTraits<T>::type Type;
+    typedef typename BaseType<Type>::type BT;
+    //Extents of the second and third dimension of array members
+    static constexpr int dim1 = std::extent<Type, 1>::value ? std::extent<Type, 1>::value : 1;
+    static constexpr int dim2 = std::extent<Type, 2>::value ? std::extent<Type, 2>::value : 1;
+
+    PackedMember(char* buffer, std::size_t offset, std::size_t record_size) :
+      data(buffer + offset), stride(record_size) {}
+
+    PP_INLINE BT& operator()(int index, int i = 0, int j = 0, int k = 0) const {
+      BT* record = reinterpret_cast<BT*>(data + index * stride);
+      return record[(i * dim1 + j) * dim2 + k];
+    }
+
+    char* data;
+    std::size_t stride;
+  };
+}
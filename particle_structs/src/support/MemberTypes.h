@@ -5,6 +5,45 @@
 
 namespace pumipic {
 
+/* Compile-time options for one member of MemberTypes
+     T - the type of the member
+     Layout - the Kokkos array layout of the member view, void selects Kokkos::LayoutLeft
+     Alignment - byte boundary each component of the member view starts on, 0 for none
+                 The particle extent of the views is padded so that every component of a
+                 LayoutLeft member starts on an aligned address.
+     Hot - false marks a member that is rarely used in kernels (cold)
+           Cold members are kept out of the tiles of AoSoA storage.
+
+   Example: MemberTypes<Aligned<double[3]>, Member<int[2], Kokkos::LayoutRight>, Cold<int> >
+*/
+template <typename T, typename Layout = void, std::size_t Alignment = 0, bool Hot = true>
+struct Member {};
+
+//Member stored with each component aligned to Alignment bytes
+template <typename T, std::size_t Alignment = 64>
+using Aligned = Member<T, void, Alignment>;
+//Member kept apart from the frequently accessed members
+template <typename T>
+using Cold = Member<T, void, 0, false>;
+
+//Options of a member of MemberTypes (see Member)
+template <typename T>
+struct MemberTraits {
+  using type = T;
+  using layout = void;
+  static constexpr std::size_t alignment = 0;
+  static constexpr bool hot = true;
+};
+template <typename T, typename Layout, std::size_t Alignment, bool Hot>
+struct MemberTraits<Member<T, Layout, Alignment, Hot> > {
+  static_assert((Alignment & (Alignment - 1)) == 0,
+                "Member alignment must be a power of two");
+  using type = T;
+  using layout = Layout;
+  static constexpr std::size_t alignment = Alignment;
+  static constexpr bool hot = Hot;
+};
+
 template<std::size_t N, typename T, typename... Types>
 struct MemberSize;
 
@@ -15,7 +54,8 @@ struct MemberSize<0, T,Types...> {
 
 template<std::size_t N, typename T, typename... Types>
 struct MemberSize {
-  static constexpr std::size_t memsize = sizeof(T) + MemberSize<N-1, Types...>::memsize;
+  static constexpr std::size_t memsize = sizeof(typename MemberTraits<T>::type) +
+    MemberSize<N-1, Types...>::memsize;
 };
 
 template<typename... Types>
@@ -30,7 +70,8 @@ struct MemberTypes<> {
 template<typename H, typename... T>
   struct MemberTypes<H,T...> {
   static constexpr std::size_t size = 1 + MemberTypes<T...>::size;
-  static constexpr std::size_t memsize = sizeof(H) + MemberTypes<T...>::memsize;
+  static constexpr std::size_t memsize = sizeof(typename MemberTraits<H>::type) +
+    MemberTypes<T...>::memsize;
 
   template <std::size_t I>
     static std::size_t sizeToIndex() {return MemberSize<I,H,T...,void>::memsize;}
@@ -56,7 +97,9 @@ struct MemberTypeAtIndex;
 
 template<std::size_t N, typename... Types>
 struct MemberTypeAtIndex<N,MemberTypes<Types...> > {
-  using type = typename MemberTypeAtIndexImpl<N, Types...>::type;
+  //The member as declared, including any Member options
+  using member = typename MemberTypeAtIndexImpl<N, Types...>::type;
+  using type = typename MemberTraits<member>::type;
 };
 
 }
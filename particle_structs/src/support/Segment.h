@@ -6,16 +6,18 @@
 namespace pumipic {
 
   //Forware declare subsegment
-  template <typename Type, typename Device>
+  template <typename Type, typename Device, typename ViewType>
   class SubSegment;
 
 
-  template <typename Type, typename Device>
+  /* ViewType is the member view of the storage layout of the structure
+       (see StorageView in MemberTypeAoSoA.h)
+  */
+  template <typename Type, typename Device, typename ViewType = View<Type*, Device> >
   class Segment {
   public:
     using Base=typename BaseType<Type>::type;
 
-    using ViewType=View<Type*, Device>;
     Segment() {}
     Segment(ViewType v) : view(v){}
 
@@ -46,8 +48,8 @@ namespace pumipic {
     }
 
 
-    PP_INLINE SubSegment<Type, Device> getComponents(const int& particle_index) const {
-      return SubSegment<Type, Device>(view, particle_index);
+    PP_INLINE SubSegment<Type, Device, ViewType> getComponents(const int& particle_index) const {
+      return SubSegment<Type, Device, ViewType>(view, particle_index);
     }
 
   private:
@@ -55,15 +57,14 @@ namespace pumipic {
   };
 
 
-  template <typename Type, typename Device>
+  template <typename Type, typename Device, typename ViewType>
   class SubSegment {
   public:
-    using ViewType=View<Type*, Device>;
     using Base=typename BaseType<Type>::type;
 
     PP_INLINE SubSegment(const ViewType& view, const int& particle_index)
       : view_(view), p(particle_index) {}
-    PP_INLINE SubSegment(const SubSegment<Type, Device>& old)
+    PP_INLINE SubSegment(const SubSegment<Type, Device, ViewType>& old)
       : view_(old.view_), p(old.p) {}
 
     template <typename U, std::size_t N>
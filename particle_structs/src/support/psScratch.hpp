@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <ppTypes.h>
+#include <Kokkos_Core.hpp>
+
+namespace pumipic {
+  /* A pool of scratch arrays owned by a particle structure and reused across calls
+
+     Each buffer is identified by an integer id and is grown geometrically so repeated
+     requests of similar sizes do not allocate. Views of different ids may be used at the
+     same time. A view is overwritten by the next request of the same id.
+  */
+  template <typename Space = DefaultMemSpace>
+  class ScratchPool {
+  public:
+    typedef Kokkos::View<lid_t*, typename Space::device_type> kkLidView;
+
+    ScratchPool(double growth_factor = 1.5);
+
+    /* Returns a view of size n backed by the buffer id
+       zero - fill the view with zeros, only pass false if every entry is written
+    */
+    kkLidView get(int id, lid_t n, bool zero = true);
+
+    //Release all of the buffers
+    void clear();
+
+    //Number of bytes currently allocated
+    std::size_t allocated() const;
+    //Largest number of bytes that have been allocated at once
+    std::size_t highWater() const {return high_water;}
+  private:
+    double growth;
+    std::vector<kkLidView> buffers;
+    std::size_t high_water;
+  };
+
+  template <typename Space>
+  ScratchPool<Space>::ScratchPool(double growth_factor) : growth(growth_factor),
+                                                          high_water(0) {}
+
+  template <typename Space>
+  typename ScratchPool<Space>::kkLidView ScratchPool<Space>::get(int id, lid_t n, bool zero) {
+    if (id >= static_cast<int>(buffers.size()))
+      buffers.resize(id + 1);
+    kkLidView& buffer = buffers[id];
+    if (static_cast<lid_t>(buffer.size()) < n) {
+      lid_t new_size = buffer.size() * growth;
+      if (new_size < n)
+        new_size = n;
+      //Release the old buffer before allocating the new one
+      buffer = kkLidView();
+      buffer = kkLidView(Kokkos::ViewAllocateWithoutInitializing("scratch_buffer"), new_size);
+      const std::size_t bytes = allocated();
+      if (bytes > high_water)
+        high_water = bytes;
+    }
+    kkLidView view = Kokkos::subview(buffer, Kokkos::make_pair(0, n));
+    if (zero)
+      Kokkos::deep_copy(view, 0);
+    return view;
+  }
+
+  template <typename Space>
+  void ScratchPool<Space>::clear() {
+    buffers.clear();
+  }
+
+  template <typename Space>
+  std::size_t ScratchPool<Space>::allocated() const {
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < buffers.size(); ++i)
+      bytes += buffers[i].size() * sizeof(lid_t);
+    return bytes;
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <ppMacros.h>
+
+namespace pumipic {
+
+  //Number of bits of each coordinate in the keys of the space filling curves
+  const int SFC_BITS = 21;
+
+  //Spreads the low SFC_BITS bits of x so there are two zero bits between each of them
+  PP_INLINE uint64_t spreadBits3(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+  }
+
+  //Index of the cell (x, y, z) along the Morton (Z-order) curve
+  PP_INLINE uint64_t mortonKey(uint32_t x, uint32_t y, uint32_t z) {
+    return (spreadBits3(x) << 2) | (spreadBits3(y) << 1) | spreadBits3(z);
+  }
+
+  /* Index of the cell (x, y, z) along the Hilbert curve through a grid of 2^bits cells per side
+     Consecutive indices are always neighboring cells. Uses the transpose algorithm of
+       J. Skilling, "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004).
+  */
+  PP_INLINE uint64_t hilbertKey(uint32_t x, uint32_t y, uint32_t z, int bits = SFC_BITS) {
+    uint32_t X[3] = {x, y, z};
+    const uint32_t M = 1u << (bits - 1);
+    //Inverse undo of the rotations and reflections
+    for (uint32_t Q = M; Q > 1; Q >>= 1) {
+      const uint32_t P = Q - 1;
+      for (int i = 0; i < 3; ++i) {
+        if (X[i] & Q)
+          X[0] ^= P;
+        else {
+          const uint32_t t = (X[0] ^ X[i]) & P;
+          X[0] ^= t;
+          X[i] ^= t;
+        }
+      }
+    }
+    //Gray encode
+    for (int i = 1; i < 3; ++i)
+      X[i] ^= X[i - 1];
+    uint32_t t = 0;
+    for (uint32_t Q = M; Q > 1; Q >>= 1)
+      if (X[2] & Q)
+        t ^= Q - 1;
+    for (int i = 0; i < 3; ++i)
+      X[i] ^= t;
+    //The bits of the index are transposed across the coordinates
+    return mortonKey(X[0], X[1], X[2]);
+  }
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <mpi.h>
+#include "Distribute.h"
+
+namespace ps = particle_structs;
+typedef double Vector3[3];
+/* Type:
+     int - particle ID
+     double[3] - values computed from the ID
+     short - parity of the ID
+     double[2][2] - values computed from the ID
+ */
+typedef ps::MemberTypes<int, Vector3, short, double[2][2]> Types;
+typedef Kokkos::DefaultExecutionSpace ExeSpace;
+typedef typename ExeSpace::memory_space MemSpace;
+typedef ps::AoSoA<4> Tiles;
+typedef ps::SellCSigma<Types, MemSpace, Tiles> SCS;
+typedef SCS::kkLidView kkLidView;
+using ps::lid_t;
+
+//Checks the members of every particle were moved together
+template <typename Structure>
+int checkValues(Structure* scs, const char* stage) {
+  auto ids = scs->template get<0>();
+  auto vecs = scs->template get<1>();
+  auto parity = scs->template get<2>();
+  auto mats = scs->template get<3>();
+  typename Structure::kkLidView fails("fails", 1);
+  auto check = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    if (mask) {
+      const int id = ids(p);
+      bool bad = parity(p) != id % 2;
+      for (int i = 0; i < 3; ++i)
+        bad |= vecs(p, i) != id * 3 + i;
+      for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 2; ++j)
+          bad |= mats(p, i, j) != id * 4 + i * 2 + j;
+      if (bad)
+        Kokkos::atomic_fetch_add(&fails(0), 1);
+    }
+  };
+  ps::parallel_for(scs, check, "check");
+  int f = ps::getLastValue<lid_t>(fails);
+  if (f)
+    fprintf(stderr, "[ERROR] %d particles have mismatched values after %s\n", f, stage);
+  return f;
+}
+
+int countParticles(SCS* scs) {
+  kkLidView count("count", 1);
+  auto countMask = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    Kokkos::atomic_fetch_add(&count(0), mask);
+  };
+  ps::parallel_for(scs, countMask, "count");
+  return ps::getLastValue<lid_t>(count);
+}
+
+int main(int argc, char* argv[]) {
+  Kokkos::initialize(argc, argv);
+  MPI_Init(&argc, &argv);
+  int comm_rank, comm_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+  int fails = 0;
+  {
+    const int ne = 20;
+    const int np = 500;
+    kkLidView ppe("ptcls_per_elem", ne);
+    kkLidView ptcl_elems("ptcl_elems", np);
+    distribute_particles(ne, np, 1, ppe, ptcl_elems);
+    SCS::kkGidView element_gids("element_gids", ne);
+    Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+      element_gids(i) = i;
+    });
+    Kokkos::TeamPolicy<ExeSpace> po(4, Tiles::tile_size);
+    ps::SCS_Input<Types, MemSpace> input(po, ne, 1024, ne, np, ppe, element_gids);
+    SCS* scs = new SCS(input);
+
+    //Give each particle a unique id and values computed from it
+    auto ids = scs->get<0>();
+    auto vecs = scs->get<1>();
+    auto parity = scs->get<2>();
+    auto mats = scs->get<3>();
+    kkLidView next_id("next_id", 1);
+    const int id_offset = comm_rank * np * 2;
+    auto setValues = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+      if (mask) {
+        const int id = id_offset + Kokkos::atomic_fetch_add(&next_id(0), 1);
+        ids(p) = id;
+        parity(p) = id % 2;
+        for (int i = 0; i < 3; ++i)
+          vecs(p, i) = id * 3 + i;
+        for (int i = 0; i < 2; ++i)
+          for (int j = 0; j < 2; ++j)
+            mats(p, i, j) = id * 4 + i * 2 + j;
+      }
+    };
+    ps::parallel_for(scs, setValues, "setValues");
+    fails += checkValues(scs, "construction");
+
+    //Shift every particle to the next element
+    kkLidView new_element("new_element", scs->capacity());
+    auto shift = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+      new_element(p) = mask ? (e + 1) % ne : -1;
+    };
+    ps::parallel_for(scs, shift, "shift");
+    scs->rebuild(new_element);
+    fails += checkValues(scs, "shifting elements");
+
+    //Remove the odd particles and add new ones to the first element
+    const int num_new = 10;
+    new_element = kkLidView("new_element", scs->capacity());
+    ids = scs->get<0>();
+    auto removeOdd = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+      new_element(p) = (mask && ids(p) % 2 == 0) ? e : -1;
+    };
+    ps::parallel_for(scs, removeOdd, "removeOdd");
+    kkLidView new_ptcl_elems("new_ptcl_elems", num_new);
+    auto new_ptcls = ps::createMemberViews<Types, MemSpace>(num_new);
+    auto new_ids = ps::getMemberView<Types, 0, MemSpace>(new_ptcls);
+    auto new_vecs = ps::getMemberView<Types, 1, MemSpace>(new_ptcls);
+    auto new_parity = ps::getMemberView<Types, 2, MemSpace>(new_ptcls);
+    auto new_mats = ps::getMemberView<Types, 3, MemSpace>(new_ptcls);
+    const int new_offset = id_offset + np;
+    Kokkos::parallel_for(num_new, KOKKOS_LAMBDA(const int& i) {
+      const int id = new_offset + i;
+      new_ptcl_elems(i) = 0;
+      new_ids(i) = id;
+      new_parity(i) = id % 2;
+      for (int j = 0; j < 3; ++j)
+        new_vecs(i, j) = id * 3 + j;
+      for (int j = 0; j < 2; ++j)
+        for (int k = 0; k < 2; ++k)
+          new_mats(i, j, k) = id * 4 + j * 2 + k;
+    });
+    scs->rebuild(new_element, new_ptcl_elems, new_ptcls);
+    ps::destroyViews<Types, MemSpace>(new_ptcls);
+    fails += checkValues(scs, "removing and adding particles");
+    if (scs->nPtcls() != countParticles(scs)) {
+      fprintf(stderr, "[ERROR] Particle count %d does not match the mask\n", scs->nPtcls());
+      ++fails;
+    }
+
+    //Send every third particle to the next process
+    new_element = kkLidView("new_element", scs->capacity());
+    kkLidView new_process("new_process", scs->capacity());
+    ids = scs->get<0>();
+    auto sendRight = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+      new_element(p) = e;
+      new_process(p) = comm_rank;
+      if (mask && ids(p) % 3 == 0)
+        new_process(p) = (comm_rank + 1) % comm_size;
+    };
+    ps::parallel_for(scs, sendRight, "sendRight");
+    scs->migrate(new_element, new_process);
+    fails += checkValues(scs, "migration");
+
+    //Copy to the host and back
+    auto host_scs = ps::copy<Kokkos::HostSpace>(scs);
+    SCS* device_scs = static_cast<SCS*>(ps::copy<MemSpace>(host_scs));
+    delete host_scs;
+    fails += checkValues(device_scs, "copying to the host and back");
+    delete device_scs;
+
+    scs->printMetrics();
+    delete scs;
+  }
+  int total_fails = 0;
+  MPI_Allreduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  cleanup_distribution_memory();
+  MPI_Finalize();
+  Kokkos::finalize();
+  if (comm_rank == 0 && total_fails == 0)
+    printf("All tests passed\n");
+  return total_fails;
+}
@@ -17,6 +17,10 @@ typedef SellCSigma<Type,exe_space> SCS;
 bool defaultTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids);
 bool noSortTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids);
 bool largeCTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids);
+bool sigmaSortTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids);
+bool adaptiveTest();
+bool configTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids);
+bool elementOrderTest();
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
@@ -37,6 +41,10 @@ int main(int argc, char* argv[]) {
     success &= defaultTest(ne, np, ptcls_per_elem_v, element_gids_v);
     success &= noSortTest(ne, np, ptcls_per_elem_v, element_gids_v);
     success &= largeCTest(ne, np, ptcls_per_elem_v, element_gids_v);
+    success &= sigmaSortTest(ne, np, ptcls_per_elem_v, element_gids_v);
+    success &= adaptiveTest();
+    success &= configTest(ne, np, ptcls_per_elem_v, element_gids_v);
+    success &= elementOrderTest();
   }
   Kokkos::finalize();
   MPI_Finalize();
@@ -128,3 +136,244 @@ bool largeCTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView el
   delete scs;
   return f == 0;
 }
+
+bool sigmaSortTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids) {
+  printf("\nBeginning Sigma Sort Test\n");
+  Kokkos::TeamPolicy<exe_space> po(4, 4);
+  SellCSigma<Type, exe_space>* scs =
+    new SellCSigma<Type, exe_space>(po, INT_MAX, 2, ne, np, ptcls_per_elem, element_gids);
+
+  //Enough elements for multiple tiles of the sort with many repeated counts
+  const int n = 10000;
+  SCS::kkLidView counts("counts", n);
+  Kokkos::parallel_for(n, KOKKOS_LAMBDA(const int& i) {
+    counts(i) = (i * 7919) % 97;
+  });
+  SCS::kkLidHostMirror counts_host = particle_structs::deviceToHost(counts);
+
+  bool passed = true;
+  const int sigmas[3] = {64, 1000, INT_MAX};
+  for (int s = 0; s < 3; ++s) {
+    const int sigma = sigmas[s];
+    SCS::PairView pairs;
+    scs->sigmaSort(pairs, n, counts, sigma);
+    SCS::PairView::HostMirror pairs_host = particle_structs::deviceToHost(pairs);
+
+    //Sort each sigma block on the host for comparison
+    std::vector<particle_structs::MyPair> expected(n);
+    for (int i = 0; i < n; ++i) {
+      expected[i].first = counts_host(i);
+      expected[i].second = i;
+    }
+    for (long int i = 0; i < n; i += sigma) {
+      const long int end = std::min<long int>(i + sigma, n);
+      std::sort(expected.begin() + i, expected.begin() + end);
+    }
+    for (int i = 0; i < n; ++i) {
+      if (pairs_host(i).first != expected[i].first ||
+          pairs_host(i).second != expected[i].second) {
+        printf("Sigma %d: entry %d is (%d, %d) instead of (%d, %d)\n", sigma, i,
+               pairs_host(i).first, pairs_host(i).second, expected[i].first, expected[i].second);
+        passed = false;
+        break;
+      }
+    }
+  }
+  delete scs;
+  return passed;
+}
+
+//Counts the particles of each element and compares to the expected counts
+bool checkCounts(SCS* scs, int ne, SCS::kkLidView ptcls_per_elem) {
+  SCS::kkLidView scs_ppe("scs_ppe",ne);
+  auto lamb = PS_LAMBDA(const int& eid, const int& pid, const int& mask) {
+    if (mask > 0)
+      Kokkos::atomic_fetch_add(&scs_ppe(eid),1);
+  };
+  scs->parallel_for(lamb);
+  SCS::kkLidView fail("fail",1);
+  auto check = PS_LAMBDA(const int i) {
+    if (scs_ppe(i) != ptcls_per_elem(i)) {
+      printf("Element %d has incorrect number of particles (%d != %d)\n", i, scs_ppe(i), ptcls_per_elem(i));
+      fail(0) = 1;
+    }
+  };
+  Kokkos::parallel_for(ne, check);
+  return particle_structs::getLastValue<particle_structs::lid_t>(fail) == 0;
+}
+
+bool adaptiveTest() {
+  printf("\nBeginning Adaptive Chunk Test\n");
+  //A few heavy elements among many light elements without sorting
+  const int ne = 200;
+  SCS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = i % 50 == 0 ? 200 : 1;
+  });
+  int np = 0;
+  Kokkos::parallel_reduce(ne, KOKKOS_LAMBDA(const int& i, int& sum) {
+    sum += ptcls_per_elem(i);
+  }, np);
+  SCS::kkGidView element_gids("", 0);
+  const int team_size = 16;
+  const int V = 64;
+  Kokkos::TeamPolicy<exe_space> po(4, team_size);
+  particle_structs::SCS_Input<Type, exe_space> input(po, 1, V, ne, np, ptcls_per_elem, element_gids);
+  input.chunk_strat = particle_structs::CHUNK_ADAPTIVE;
+  SCS* scs = new SCS(input);
+  scs->printMetrics();
+
+  bool passed = checkCounts(scs, ne, ptcls_per_elem);
+  if (scs->C() < 1 || scs->C() > team_size || scs->V() < 1 || scs->V() > V) {
+    printf("Adaptive C %d or V %d is outside of the given sizes\n", scs->C(), scs->V());
+    passed = false;
+  }
+
+  //Move every particle to the next element with a full rebuild
+  SCS::kkLidView new_element("new_element", scs->capacity());
+  auto shift = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    new_element(p) = mask ? (e + 1) % ne : -1;
+  };
+  scs->parallel_for(shift);
+  scs->setShuffling(false);
+  scs->rebuild(new_element);
+  SCS::kkLidView shifted_ppe("shifted_ppe", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    shifted_ppe((i + 1) % ne) = ptcls_per_elem(i);
+  });
+  passed &= checkCounts(scs, ne, shifted_ppe);
+  if (scs->C() < 1 || scs->C() > team_size || scs->V() < 1 || scs->V() > V) {
+    printf("Adaptive C %d or V %d is outside of the given sizes after rebuild\n", scs->C(),
+           scs->V());
+    passed = false;
+  }
+  delete scs;
+  return passed;
+}
+
+bool configTest(int ne, int np, SCS::kkLidView ptcls_per_elem, SCS::kkGidView element_gids) {
+  printf("\nBeginning Config Test\n");
+  const char* filename = "scs_config_test.cfg";
+  FILE* f = fopen(filename, "w");
+  fprintf(f, "# Configuration for the config test\n");
+  fprintf(f, "sigma = INT_MAX\n");
+  fprintf(f, "  V = 3   # vertical slicing\n");
+  fprintf(f, "team_size = 2\n");
+  fprintf(f, "shuffle_padding = 0.5\n");
+  fprintf(f, "padding_strat = PAD_PROPORTIONALLY\n");
+  fprintf(f, "shuffling = false\n");
+  fprintf(f, "name = configured\n");
+  fclose(f);
+
+  Kokkos::TeamPolicy<exe_space> po(4, 4);
+  particle_structs::SCS_Input<Type, exe_space> input(po, 1, 1024, ne, np, ptcls_per_elem,
+                                                      element_gids);
+  bool passed = input.readConfig(filename);
+  if (!passed)
+    printf("Reading the configuration failed\n");
+  if (input.shuffle_padding != 0.5 || input.padding_strat != particle_structs::PAD_PROPORTIONALLY
+      || input.shuffling || input.name != "configured") {
+    printf("The configuration was not applied to the input\n");
+    passed = false;
+  }
+  SCS* scs = new SCS(input);
+  if (scs->C() != 2 || scs->V() != 3 || scs->getName() != "configured") {
+    printf("SCS was built with C %d V %d name %s instead of C 2 V 3 name configured\n",
+           scs->C(), scs->V(), scs->getName().c_str());
+    passed = false;
+  }
+  passed &= checkCounts(scs, ne, ptcls_per_elem);
+  delete scs;
+
+  //Invalid keys and values are reported
+  if (input.setParameter("padding_strat", "PAD_RANDOMLY") || input.setParameter("V", "-1") ||
+      input.setParameter("not_a_parameter", "1")) {
+    printf("Invalid parameters were accepted\n");
+    passed = false;
+  }
+  remove(filename);
+  return passed;
+}
+
+/* Builds an SCS over a 4x4x4 grid of elements numbered out of spatial order with one
+   particle each, so particle i is in row i, and returns the distance between the cells
+   of each pair of consecutive rows
+*/
+std::vector<int> rowDistances(particle_structs::ElementOrder order, int sigma) {
+  const int n = 4;
+  const int ne = n * n * n;
+  //Element (i * 37) % ne is in cell i of the grid
+  SCS::kkLidView cell_of_elem("cell_of_elem", ne);
+  SCS::CentroidView centroids("centroids", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    const int elem = (i * 37) % ne;
+    cell_of_elem(elem) = i;
+    centroids(elem, 0) = i / (n * n) + 0.5;
+    centroids(elem, 1) = i / n % n + 0.5;
+    centroids(elem, 2) = i % n + 0.5;
+  });
+  SCS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  Kokkos::deep_copy(ptcls_per_elem, 1);
+  SCS::kkGidView element_gids("", 0);
+  Kokkos::TeamPolicy<exe_space> po(4, 4);
+  particle_structs::SCS_Input<Type, exe_space> input(po, sigma, 1024, ne, ne, ptcls_per_elem,
+                                                     element_gids);
+  input.shuffle_padding = 0;
+  input.element_order = order;
+  input.element_centroids = centroids;
+  SCS* scs = new SCS(input);
+  SCS::kkLidView row_cell("row_cell", ne);
+  auto setCells = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    if (mask)
+      row_cell(p) = cell_of_elem(e);
+  };
+  scs->parallel_for(setCells);
+  delete scs;
+  auto row_cell_host = particle_structs::deviceToHost(row_cell);
+  std::vector<int> distances;
+  for (int i = 1; i < ne; ++i) {
+    const int a = row_cell_host(i - 1);
+    const int b = row_cell_host(i);
+    distances.push_back(abs(a / (n * n) - b / (n * n)) + abs(a / n % n - b / n % n) +
+                        abs(a % n - b % n));
+  }
+  return distances;
+}
+
+bool elementOrderTest() {
+  printf("\nBeginning Element Order Test\n");
+  bool passed = true;
+  //Consecutive cells of a Hilbert curve are neighbors
+  const int sigmas[] = {1, INT_MAX};
+  for (int s = 0; s < 2; ++s) {
+    std::vector<int> distances = rowDistances(particle_structs::ORDER_HILBERT, sigmas[s]);
+    for (size_t i = 0; i < distances.size(); ++i) {
+      if (distances[i] != 1) {
+        printf("[ERROR] Rows %lu and %lu of the Hilbert order are %d cells apart with sigma %d\n",
+               i, i + 1, distances[i], sigmas[s]);
+        passed = false;
+        break;
+      }
+    }
+  }
+  //Each group of 8 rows of a Morton order is a 2x2x2 block of cells
+  std::vector<int> distances = rowDistances(particle_structs::ORDER_MORTON, 1);
+  for (size_t i = 0; i < distances.size(); ++i) {
+    if (i % 8 != 7 && distances[i] > 3) {
+      printf("[ERROR] Rows %lu and %lu of the Morton order are %d cells apart\n", i, i + 1,
+             distances[i]);
+      passed = false;
+      break;
+    }
+  }
+  //Without ordering the rows follow the scrambled element ids
+  distances = rowDistances(particle_structs::ORDER_NONE, 1);
+  int total = 0;
+  for (size_t i = 0; i < distances.size(); ++i)
+    total += distances[i];
+  if (total <= (int)distances.size()) {
+    printf("[ERROR] Unordered rows are as close as ordered rows\n");
+    passed = false;
+  }
+  return passed;
+}
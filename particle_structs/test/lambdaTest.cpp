@@ -14,6 +14,44 @@ typedef MemberTypes<int> Type;
 typedef Kokkos::DefaultExecutionSpace exe_space;
 typedef SellCSigma<Type,exe_space> SCS;
 
+//Checks every slot of the scs is visited exactly once by each traversal strategy
+int testTraversals(SCS* scs) {
+  const particle_structs::TraversalStrategy strats[4] =
+    {particle_structs::TRAVERSE_DEFAULT, particle_structs::TRAVERSE_ROW_PER_THREAD,
+     particle_structs::TRAVERSE_ROW_PER_LANE, particle_structs::TRAVERSE_FLAT};
+  const char* names[4] = {"default", "row per thread", "row per lane", "flat"};
+  int fails = 0;
+  for (int s = 0; s < 4; ++s) {
+    scs->setTraversal(strats[s]);
+    SCS::kkLidView visits("visits", scs->capacity());
+    SCS::kkLidView num_active("num_active", 1);
+    auto countVisits = PS_LAMBDA(const int& eid, const int& pid, const int& mask) {
+      Kokkos::atomic_fetch_add(&visits(pid), 1);
+      if (mask > 0)
+        Kokkos::atomic_fetch_add(&num_active(0), 1);
+    };
+    scs->parallel_for(countVisits, "countVisits");
+    SCS::kkLidView bad_slots("bad_slots", 1);
+    Kokkos::parallel_for("check_visits", visits.size(), KOKKOS_LAMBDA(const int& i) {
+      if (visits(i) != 1)
+        Kokkos::atomic_fetch_add(&bad_slots(0), 1);
+    });
+    int bad = particle_structs::getLastValue<particle_structs::lid_t>(bad_slots);
+    int active = particle_structs::getLastValue<particle_structs::lid_t>(num_active);
+    if (bad != 0) {
+      fprintf(stderr, "[ERROR] Traversal %s visited %d slots other than once\n", names[s], bad);
+      ++fails;
+    }
+    if (active != scs->nPtcls()) {
+      fprintf(stderr, "[ERROR] Traversal %s visited %d particles instead of %d\n",
+              names[s], active, scs->nPtcls());
+      ++fails;
+    }
+  }
+  scs->setTraversal(particle_structs::TRAVERSE_DEFAULT);
+  return fails;
+}
+
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
   Kokkos::initialize(argc, argv);
@@ -24,6 +62,7 @@ int main(int argc, char* argv[]) {
   std::vector<int>* ids = new std::vector<int>[ne];
   distribute_particles(ne, np, 0, ptcls_per_elem, ids);
   Kokkos::TeamPolicy<exe_space> po(4, 32);
+  int fails = 0;
   {
     SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
     SCS::kkGidView element_gids_v("", 0);
@@ -41,10 +80,27 @@ int main(int argc, char* argv[]) {
 
     scs->parallel_for(lamb);
 
+    fails += testTraversals(scs);
+    delete scs;
+
+    //Irregular rows with vertical slicing
+    const int ne2 = 100;
+    const int np2 = 2000;
+    int* ppe2 = new int[ne2];
+    std::vector<int>* ids2 = new std::vector<int>[ne2];
+    distribute_particles(ne2, np2, 2, ppe2, ids2);
+    SCS::kkLidView ppe2_v("ppe2_v", ne2);
+    particle_structs::hostToDevice(ppe2_v, ppe2);
+    delete [] ppe2;
+    delete [] ids2;
+    Kokkos::TeamPolicy<exe_space> po2(4, 8);
+    scs = new SellCSigma<Type, exe_space>(po2, 10, 4, ne2, np2, ppe2_v, element_gids_v);
+    fails += testTraversals(scs);
     delete scs;
   }
   Kokkos::finalize();
   MPI_Finalize();
-  printf("All tests passed\n");
-  return 0;
+  if (fails == 0)
+    printf("All tests passed\n");
+  return fails;
 }
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <type_traits>
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <mpi.h>
+#include "Distribute.h"
+
+namespace ps = particle_structs;
+typedef double Vector3[3];
+typedef float Pair[2];
+/* Type:
+     int - particle ID
+     double[3] aligned to 64 bytes - values computed from the ID
+     float[2] stored LayoutRight - values computed from the ID
+     short (cold) - parity of the ID
+ */
+typedef ps::MemberTypes<int, ps::Aligned<Vector3>, ps::Member<Pair, Kokkos::LayoutRight>,
+                        ps::Cold<short> > Types;
+typedef Kokkos::DefaultExecutionSpace ExeSpace;
+typedef typename ExeSpace::memory_space MemSpace;
+typedef ps::SellCSigma<Types, MemSpace> SCS;
+typedef ps::SellCSigma<Types, MemSpace, ps::AoSoA<4> > TiledSCS;
+typedef SCS::kkLidView kkLidView;
+using ps::lid_t;
+
+//The options of a member do not change its type
+static_assert(std::is_same<ps::MemberTypeAtIndex<1, Types>::type, Vector3>::value,
+              "Aligned member type");
+static_assert(std::is_same<ps::MemberTypeAtIndex<2, Types>::type, Pair>::value,
+              "LayoutRight member type");
+static_assert(std::is_same<ps::MemberLayout<ps::MemberTypeAtIndex<2, Types>::member>::type,
+                           Kokkos::LayoutRight>::value, "LayoutRight member layout");
+static_assert(std::is_same<ps::MemberLayout<ps::MemberTypeAtIndex<1, Types>::member>::type,
+                           Kokkos::LayoutLeft>::value, "Default member layout");
+static_assert(Types::memsize == sizeof(int) + sizeof(Vector3) + sizeof(Pair) + sizeof(short),
+              "Member options must not change the size of the members");
+static_assert(!ps::MemberTraits<ps::MemberTypeAtIndex<3, Types>::member>::hot,
+              "Cold member");
+//Migration records place each member on the alignment of its base type after the element
+typedef ps::PackedLayout<Types> Packed;
+static_assert(Packed::Members::offset == sizeof(ps::lid_t) &&
+              Packed::Members::Next::offset == 8 &&
+              Packed::Members::Next::Next::offset == 8 + sizeof(Vector3) &&
+              Packed::Members::Next::Next::Next::offset == 8 + sizeof(Vector3) + sizeof(Pair),
+              "Packed member offsets");
+static_assert(Packed::size % alignof(double) == 0 &&
+              Packed::size >= 8 + sizeof(Vector3) + sizeof(Pair) + sizeof(short),
+              "Packed record size");
+//Only the hot members are stored in the tiles
+static_assert(ps::AoSoATileBytes<4, SCS::device_type, int, ps::Cold<short> >::value ==
+              ps::AOSOA_ALIGNMENT, "Cold members in AoSoA tiles");
+
+//Checks the components of the aligned member start on 64 byte boundaries
+int testAlignment() {
+  int fails = 0;
+  const int sizes[] = {1, 13, 100};
+  for (int s = 0; s < 3; ++s) {
+    ps::MemberTypeViews views = ps::createMemberViews<Types, MemSpace>(sizes[s]);
+    auto aligned = ps::getMemberView<Types, 1, MemSpace>(views);
+    auto right = ps::getMemberView<Types, 2, MemSpace>(views);
+    auto ids = ps::getMemberView<Types, 0, MemSpace>(views);
+    if (aligned.extent(0) < sizes[s] || aligned.extent(0) != ids.extent(0) ||
+        aligned.extent(0) != right.extent(0)) {
+      fprintf(stderr, "[ERROR] Member extents %d %d %d do not match for size %d\n",
+              aligned.extent(0), ids.extent(0), right.extent(0), sizes[s]);
+      ++fails;
+    }
+    const double* start = aligned.view().data();
+    for (int i = 0; i < 3; ++i) {
+      const uintptr_t bytes = reinterpret_cast<uintptr_t>(start + i * aligned.extent(0)) -
+        reinterpret_cast<uintptr_t>(start);
+      if (bytes % 64 != 0) {
+        fprintf(stderr, "[ERROR] Component %d of the aligned member is %lu bytes from the "
+                "start for size %d\n", i, (unsigned long)bytes, sizes[s]);
+        ++fails;
+      }
+    }
+    ps::destroyViews<Types, MemSpace>(views);
+  }
+  return fails;
+}
+
+//Checks the members of every particle were moved together
+template <typename Structure>
+int checkValues(Structure* structure, const char* stage) {
+  auto ids = structure->template get<0>();
+  auto vecs = structure->template get<1>();
+  auto pairs = structure->template get<2>();
+  auto parity = structure->template get<3>();
+  typename Structure::kkLidView fails("fails", 1);
+  auto check = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    if (mask) {
+      const int id = ids(p);
+      bool bad = parity(p) != id % 2;
+      for (int i = 0; i < 3; ++i)
+        bad |= vecs(p, i) != id * 3 + i;
+      for (int i = 0; i < 2; ++i)
+        bad |= pairs(p, i) != id * 2 + i;
+      if (bad)
+        Kokkos::atomic_fetch_add(&fails(0), 1);
+    }
+  };
+  ps::parallel_for(structure, check, "check");
+  int f = ps::getLastValue<lid_t>(fails);
+  if (f)
+    fprintf(stderr, "[ERROR] %d particles of %s have mismatched values after %s\n", f,
+            structure->getName().c_str(), stage);
+  return f;
+}
+
+template <typename Structure>
+int testStructure(const char* name, int comm_rank) {
+  const int ne = 20;
+  const int np = 300;
+  int fails = 0;
+  kkLidView ppe("ptcls_per_elem", ne);
+  kkLidView ptcl_elems("ptcl_elems", np);
+  distribute_particles(ne, np, 1, ppe, ptcl_elems);
+  typename Structure::kkGidView element_gids("element_gids", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    element_gids(i) = i;
+  });
+  Kokkos::TeamPolicy<ExeSpace> po(4, 4);
+  ps::SCS_Input<Types, MemSpace> input(po, ne, 1024, ne, np, ppe, element_gids);
+  input.name = name;
+  Structure* structure = new Structure(input);
+
+  //Give each particle a unique id and values computed from it
+  auto ids = structure->template get<0>();
+  auto vecs = structure->template get<1>();
+  auto pairs = structure->template get<2>();
+  auto parity = structure->template get<3>();
+  kkLidView next_id("next_id", 1);
+  const int id_offset = comm_rank * np * 2;
+  auto setValues = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    if (mask) {
+      const int id = id_offset + Kokkos::atomic_fetch_add(&next_id(0), 1);
+      ids(p) = id;
+      parity(p) = id % 2;
+      for (int i = 0; i < 3; ++i)
+        vecs(p, i) = id * 3 + i;
+      for (int i = 0; i < 2; ++i)
+        pairs(p, i) = id * 2 + i;
+    }
+  };
+  ps::parallel_for(structure, setValues, "setValues");
+  fails += checkValues(structure, "construction");
+
+  //Shift the particles to the next element while adding new particles
+  const int num_new = 7;
+  kkLidView new_element("new_element", structure->capacity());
+  auto shift = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    new_element(p) = mask ? (e + 1) % ne : -1;
+  };
+  ps::parallel_for(structure, shift, "shift");
+  kkLidView new_ptcl_elems("new_ptcl_elems", num_new);
+  auto new_ptcls = ps::createMemberViews<Types, MemSpace>(num_new);
+  auto new_ids = ps::getMemberView<Types, 0, MemSpace>(new_ptcls);
+  auto new_vecs = ps::getMemberView<Types, 1, MemSpace>(new_ptcls);
+  auto new_pairs = ps::getMemberView<Types, 2, MemSpace>(new_ptcls);
+  auto new_parity = ps::getMemberView<Types, 3, MemSpace>(new_ptcls);
+  const int new_offset = id_offset + np;
+  Kokkos::parallel_for(num_new, KOKKOS_LAMBDA(const int& i) {
+    const int id = new_offset + i;
+    new_ptcl_elems(i) = i % ne;
+    new_ids(i) = id;
+    new_parity(i) = id % 2;
+    for (int j = 0; j < 3; ++j)
+      new_vecs(i, j) = id * 3 + j;
+    for (int j = 0; j < 2; ++j)
+      new_pairs(i, j) = id * 2 + j;
+  });
+  structure->rebuild(new_element, new_ptcl_elems, new_ptcls);
+  ps::destroyViews<Types, MemSpace>(new_ptcls);
+  fails += checkValues(structure, "rebuilding");
+  if (structure->nPtcls() != np + num_new) {
+    fprintf(stderr, "[ERROR] %s has %d particles after rebuild instead of %d\n", name,
+            structure->nPtcls(), np + num_new);
+    ++fails;
+  }
+
+  //Send the particles with odd ids to the next process
+  int comm_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  const int next_rank = (comm_rank + 1) % comm_size;
+  auto current_ids = structure->template get<0>();
+  kkLidView migrate_element("migrate_element", structure->capacity());
+  kkLidView migrate_process("migrate_process", structure->capacity());
+  auto sendOdd = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    migrate_element(p) = e;
+    migrate_process(p) = mask && current_ids(p) % 2 ? next_rank : comm_rank;
+  };
+  ps::parallel_for(structure, sendOdd, "sendOdd");
+  structure->migrate(migrate_element, migrate_process);
+  fails += checkValues(structure, "migrating");
+  int num_ptcls = structure->nPtcls(), total_ptcls = 0;
+  MPI_Allreduce(&num_ptcls, &total_ptcls, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (total_ptcls != comm_size * (np + num_new)) {
+    fprintf(stderr, "[ERROR] %s has %d particles after migrate instead of %d\n", name,
+            total_ptcls, comm_size * (np + num_new));
+    ++fails;
+  }
+
+  //Copy to the host and back
+  auto host_structure = ps::copy<Kokkos::HostSpace>(structure);
+  Structure* device_structure = static_cast<Structure*>(ps::copy<MemSpace>(host_structure));
+  delete host_structure;
+  fails += checkValues(device_structure, "copying to the host and back");
+  delete device_structure;
+
+  delete structure;
+  return fails;
+}
+
+int main(int argc, char* argv[]) {
+  Kokkos::initialize(argc, argv);
+  MPI_Init(&argc, &argv);
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+
+  int fails = 0;
+  fails += testAlignment();
+  fails += testStructure<SCS>("soa", comm_rank);
+  fails += testStructure<TiledSCS>("aosoa", comm_rank);
+
+  int total_fails = 0;
+  MPI_Allreduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  cleanup_distribution_memory();
+  MPI_Finalize();
+  Kokkos::finalize();
+  if (comm_rank == 0 && total_fails == 0)
+    printf("All tests passed\n");
+  return total_fails;
+}
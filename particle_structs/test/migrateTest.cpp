@@ -6,6 +6,7 @@
 
 #include "Distribute.h"
 #include <mpi.h>
+#include <set>
 
 using particle_structs::SellCSigma;
 using particle_structs::MemberTypes;
@@ -15,6 +16,9 @@ typedef Kokkos::DefaultExecutionSpace exe_space;
 typedef SellCSigma<Type, exe_space> SCS;
 
 bool sendToOne(int ne, int np);
+bool sendAllToOne(int ne, int np, bool split);
+bool sendToNeighbors(int ne, int np, particle_structs::MigrateStrategy strat, bool split);
+bool sendToShifted(int ne, int np, particle_structs::MigrateStrategy strat);
 
 int main(int argc, char* argv[]) {
   Kokkos::initialize(argc, argv);
@@ -116,6 +120,41 @@ int main(int argc, char* argv[]) {
     printf("SendToOne failed on rank %d\n", comm_rank);
     fails++;
   }
+  if (!sendAllToOne(100, 2000, false)) {
+    printf("SendAllToOne failed on rank %d\n", comm_rank);
+    fails++;
+  }
+  if (!sendAllToOne(100, 2000, true)) {
+    printf("Split-phase SendAllToOne failed on rank %d\n", comm_rank);
+    fails++;
+  }
+  if (!sendToNeighbors(100, 2000, particle_structs::MIGRATE_POINT_TO_POINT, false)) {
+    printf("SendToNeighbors with point to point messages failed on rank %d\n", comm_rank);
+    fails++;
+  }
+  if (!sendToNeighbors(100, 2000, particle_structs::MIGRATE_NEIGHBOR, false)) {
+    printf("SendToNeighbors with neighborhood collectives failed on rank %d\n", comm_rank);
+    fails++;
+  }
+  if (!sendToNeighbors(100, 2000, particle_structs::MIGRATE_POINT_TO_POINT, true)) {
+    printf("Split-phase SendToNeighbors with point to point messages failed on rank %d\n",
+           comm_rank);
+    fails++;
+  }
+  if (!sendToNeighbors(100, 2000, particle_structs::MIGRATE_NEIGHBOR, true)) {
+    printf("Split-phase SendToNeighbors with neighborhood collectives failed on rank %d\n",
+           comm_rank);
+    fails++;
+  }
+  if (!sendToShifted(100, 2000, particle_structs::MIGRATE_POINT_TO_POINT)) {
+    printf("SendToShifted with an all to all of the counts failed on rank %d\n", comm_rank);
+    fails++;
+  }
+  if (!sendToShifted(100, 2000, particle_structs::MIGRATE_NBX)) {
+    printf("SendToShifted with a nonblocking consensus of the counts failed on rank %d\n",
+           comm_rank);
+    fails++;
+  }
   Kokkos::finalize();
   int total_fails;
   MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
@@ -201,3 +240,297 @@ bool sendToOne(int ne, int np) {
   int f = particle_structs::getLastValue(fail);
   return f == 0;
 }
+
+//Every process except 0 sends all of its particles to process 0 and is refilled with a few
+//  particles from process 0
+bool sendAllToOne(int ne, int np, bool split) {
+  int comm_rank;
+  int comm_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  const int num_refill = 3;
+
+  particle_structs::gid_t* gids = new particle_structs::gid_t[ne];
+  int* ptcls_per_elem = new int[ne];
+  for (int i = 0; i < ne; ++i) {
+    gids[i] = i;
+    ptcls_per_elem[i] = np / ne;
+  }
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkGidView element_gids_v("element_gids_v", ne);
+  particle_structs::hostToDevice(ptcls_per_elem_v, ptcls_per_elem);
+  particle_structs::hostToDevice(element_gids_v, gids);
+  delete [] ptcls_per_elem;
+  delete [] gids;
+  Kokkos::TeamPolicy<exe_space> po(4, 32);
+  SCS* scs = new SCS(po, ne, 100, ne, np, ptcls_per_elem_v, element_gids_v);
+
+  SCS::kkLidView new_element("new_element", scs->capacity());
+  SCS::kkLidView new_process("new_process", scs->capacity());
+  SCS::kkLidView num_sent("num_sent", 1);
+  auto int_slice = scs->get<0>();
+  auto double_slice = scs->get<1>();
+  auto setValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+    int_slice(ptcl_id) = comm_rank;
+    double_slice(ptcl_id, 0) = elem_id;
+    new_element(ptcl_id) = (elem_id + 1) % ne;
+    new_process(ptcl_id) = 0;
+    if (mask && comm_rank == 0) {
+      const int sent = Kokkos::atomic_fetch_add(&num_sent(0), 1);
+      if (sent < num_refill * (comm_size - 1))
+        new_process(ptcl_id) = 1 + sent / num_refill;
+    }
+  };
+  scs->parallel_for(setValues);
+
+  const int num_ptcls = scs->nPtcls();
+  const int num_senders = comm_size - 1;
+  const int staying = comm_rank == 0 ? num_ptcls - num_refill * num_senders : 0;
+  const int expected = comm_rank == 0 ? staying + num_senders * num_ptcls : num_refill;
+  bool passed = true;
+  if (split) {
+    scs->migrate_begin(new_element, new_process);
+    if (scs->nPtcls() != staying) {
+      fprintf(stderr, "Rank %d has %d particles after migrate_begin instead of %d\n",
+              comm_rank, scs->nPtcls(), staying);
+      passed = false;
+    }
+    //The structure is only rebuilt by migrate_end so the staying particles have not moved
+    SCS::kkLidView moved("moved", 1);
+    auto checkNotMoved = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+      if (mask && double_slice(ptcl_id, 0) != elem_id)
+        moved(0) = 1;
+    };
+    scs->parallel_for(checkNotMoved);
+    if (particle_structs::getLastValue(moved)) {
+      fprintf(stderr, "Rank %d moved particles before migrate_end\n", comm_rank);
+      passed = false;
+    }
+    scs->migrate_end();
+  }
+  else
+    scs->migrate(new_element, new_process);
+
+  if (scs->nPtcls() != expected) {
+    fprintf(stderr, "Rank %d has incorrect number of particles (%d != %d)\n", comm_rank,
+            scs->nPtcls(), expected);
+    passed = false;
+  }
+  int_slice = scs->get<0>();
+  double_slice = scs->get<1>();
+  SCS::kkLidView counts("counts", 2);
+  auto checkValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+    if (mask) {
+      const int old_elem = double_slice(ptcl_id, 0);
+      Kokkos::atomic_fetch_add(&counts(0), 1);
+      if ((comm_rank != 0 && int_slice(ptcl_id) != 0) || (old_elem + 1) % ne != elem_id)
+        counts(1) = 1;
+    }
+  };
+  scs->parallel_for(checkValues);
+  auto counts_host = particle_structs::deviceToHost(counts);
+  if (counts_host(0) != expected || counts_host(1)) {
+    fprintf(stderr, "Rank %d has %d particles in the structure (%d expected) and wrong values "
+            "%d\n", comm_rank, counts_host(0), expected, counts_host(1));
+    passed = false;
+  }
+  delete scs;
+  return passed;
+}
+
+//Sends particles around a ring with a Distributor of the neighboring ranks
+bool sendToNeighbors(int ne, int np, particle_structs::MigrateStrategy strat, bool split) {
+  int comm_rank;
+  int comm_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  const int left = (comm_rank + comm_size - 1) % comm_size;
+  const int right = (comm_rank + 1) % comm_size;
+  std::set<int> ring = {left, comm_rank, right};
+  std::vector<int> ring_ranks(ring.begin(), ring.end());
+  const particle_structs::Distributor<exe_space> dist(ring_ranks.size(), ring_ranks.data());
+
+  particle_structs::gid_t* gids = new particle_structs::gid_t[ne];
+  int* ptcls_per_elem = new int[ne];
+  for (int i = 0; i < ne; ++i) {
+    gids[i] = i;
+    ptcls_per_elem[i] = np / ne;
+  }
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkGidView element_gids_v("element_gids_v", ne);
+  particle_structs::hostToDevice(ptcls_per_elem_v, ptcls_per_elem);
+  particle_structs::hostToDevice(element_gids_v, gids);
+  delete [] ptcls_per_elem;
+  delete [] gids;
+  Kokkos::TeamPolicy<exe_space> po(4, 32);
+  SCS* scs = new SCS(po, ne, 100, ne, np, ptcls_per_elem_v, element_gids_v);
+  scs->setMigrateStrategy(strat);
+
+  //The neighborhood is reused by the second migration and rebuilt for the third
+  bool passed = true;
+  for (int step = 0; step < 3; ++step) {
+    if (step == 2)
+      scs->markNeighborsStale();
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    SCS::kkLidView new_process("new_process", scs->capacity());
+    SCS::kkLidView num_sent("num_sent", 2);
+    auto int_slice = scs->get<0>();
+    auto double_slice = scs->get<1>();
+    auto setValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+      int_slice(ptcl_id) = comm_rank;
+      double_slice(ptcl_id, 0) = elem_id;
+      double_slice(ptcl_id, 1) = elem_id * 2;
+      double_slice(ptcl_id, 2) = comm_rank;
+      new_element(ptcl_id) = elem_id;
+      new_process(ptcl_id) = comm_rank;
+      //Rank 0 only sends on the second step so a rank has nothing to send on the first
+      if (mask && (comm_rank > 0 || step > 0) && (elem_id + step) % 3 == 0) {
+        new_process(ptcl_id) = right;
+        Kokkos::atomic_fetch_add(&num_sent(0), 1);
+      }
+      else if (mask && (comm_rank > 0 || step > 0) && (elem_id + step) % 5 == 1) {
+        new_process(ptcl_id) = left;
+        Kokkos::atomic_fetch_add(&num_sent(1), 1);
+      }
+    };
+    scs->parallel_for(setValues);
+    auto num_sent_host = particle_structs::deviceToHost(num_sent);
+    int sent[2] = {num_sent_host(0), num_sent_host(1)};
+    int recv[2] = {0, 0};
+    MPI_Sendrecv(sent, 1, MPI_INT, right, 0, recv, 1, MPI_INT, left, 0, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+    MPI_Sendrecv(sent + 1, 1, MPI_INT, left, 1, recv + 1, 1, MPI_INT, right, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    const int expected = scs->nPtcls() - sent[0] - sent[1] + recv[0] + recv[1];
+
+    if (split) {
+      //Only the particles staying on this process are in the structure until migrate_end
+      //  (in serial the particles sent to the neighbors stay)
+      scs->migrate_begin(new_element, new_process, dist);
+      const int staying = comm_size > 1 ? expected - recv[0] - recv[1] : expected;
+      if (scs->nPtcls() != staying) {
+        fprintf(stderr, "Rank %d has %d particles after migrate_begin instead of %d\n",
+                comm_rank, scs->nPtcls(), staying);
+        passed = false;
+      }
+      int_slice = scs->get<0>();
+      SCS::kkLidView not_staying("not_staying", 1);
+      auto checkStaying = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+        if (mask && int_slice(ptcl_id) != comm_rank)
+          not_staying(0) = 1;
+      };
+      scs->parallel_for(checkStaying);
+      if (particle_structs::getLastValue(not_staying)) {
+        fprintf(stderr, "Rank %d has received particles before migrate_end\n", comm_rank);
+        passed = false;
+      }
+      scs->migrate_end();
+    }
+    else
+      scs->migrate(new_element, new_process, dist);
+
+    if (scs->nPtcls() != expected) {
+      fprintf(stderr, "Rank %d has incorrect number of particles (%d != %d)\n", comm_rank,
+              scs->nPtcls(), expected);
+      passed = false;
+    }
+    int_slice = scs->get<0>();
+    double_slice = scs->get<1>();
+    SCS::kkLidView fail("fail", 1);
+    auto checkValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+      if (mask) {
+        const int rank = int_slice(ptcl_id);
+        if (rank != comm_rank && rank != left && rank != right)
+          fail(0) = 1;
+        if (double_slice(ptcl_id, 0) != elem_id || double_slice(ptcl_id, 1) != elem_id * 2 ||
+            double_slice(ptcl_id, 2) != rank)
+          fail(0) = 1;
+      }
+    };
+    scs->parallel_for(checkValues);
+    if (particle_structs::getLastValue(fail)) {
+      fprintf(stderr, "Rank %d received particles with the wrong values\n", comm_rank);
+      passed = false;
+    }
+  }
+  delete scs;
+  return passed;
+}
+
+//Migrates with the world Distributor to a different process each step
+bool sendToShifted(int ne, int np, particle_structs::MigrateStrategy strat) {
+  int comm_rank;
+  int comm_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+  particle_structs::gid_t* gids = new particle_structs::gid_t[ne];
+  int* ptcls_per_elem = new int[ne];
+  for (int i = 0; i < ne; ++i) {
+    gids[i] = i;
+    ptcls_per_elem[i] = np / ne;
+  }
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkGidView element_gids_v("element_gids_v", ne);
+  particle_structs::hostToDevice(ptcls_per_elem_v, ptcls_per_elem);
+  particle_structs::hostToDevice(element_gids_v, gids);
+  delete [] ptcls_per_elem;
+  delete [] gids;
+  Kokkos::TeamPolicy<exe_space> po(4, 32);
+  SCS* scs = new SCS(po, ne, 100, ne, np, ptcls_per_elem_v, element_gids_v);
+  scs->setMigrateStrategy(strat);
+
+  //Several steps so consecutive count exchanges follow each other closely
+  bool passed = true;
+  for (int step = 0; step < 4; ++step) {
+    const int dest = (comm_rank + step + 1) % comm_size;
+    const int source = (comm_rank + comm_size - (step + 1) % comm_size) % comm_size;
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    SCS::kkLidView new_process("new_process", scs->capacity());
+    SCS::kkLidView num_sent("num_sent", 1);
+    auto int_slice = scs->get<0>();
+    auto double_slice = scs->get<1>();
+    auto setValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+      int_slice(ptcl_id) = comm_rank;
+      double_slice(ptcl_id, 0) = elem_id;
+      new_element(ptcl_id) = elem_id;
+      new_process(ptcl_id) = comm_rank;
+      //The last rank does not send on the first step
+      if (mask && (comm_rank != comm_size - 1 || step > 0) && elem_id % 4 == step &&
+          dest != comm_rank) {
+        new_process(ptcl_id) = dest;
+        Kokkos::atomic_fetch_add(&num_sent(0), 1);
+      }
+    };
+    scs->parallel_for(setValues);
+    int sent = particle_structs::getLastValue(num_sent);
+    int recv = 0;
+    MPI_Sendrecv(&sent, 1, MPI_INT, dest, 0, &recv, 1, MPI_INT, source, 0, MPI_COMM_WORLD,
+                 MPI_STATUS_IGNORE);
+    const int expected = scs->nPtcls() - sent + recv;
+
+    scs->migrate(new_element, new_process);
+
+    if (scs->nPtcls() != expected) {
+      fprintf(stderr, "Rank %d has incorrect number of particles on step %d (%d != %d)\n",
+              comm_rank, step, scs->nPtcls(), expected);
+      passed = false;
+    }
+    int_slice = scs->get<0>();
+    double_slice = scs->get<1>();
+    SCS::kkLidView fail("fail", 1);
+    auto checkValues = PS_LAMBDA(int elem_id, int ptcl_id, int mask) {
+      if (mask && (double_slice(ptcl_id, 0) != elem_id ||
+                   (int_slice(ptcl_id) != comm_rank && int_slice(ptcl_id) != source)))
+        fail(0) = 1;
+    };
+    scs->parallel_for(checkValues);
+    if (particle_structs::getLastValue(fail)) {
+      fprintf(stderr, "Rank %d received particles with the wrong values on step %d\n",
+              comm_rank, step);
+      passed = false;
+    }
+  }
+  delete scs;
+  return passed;
+}
@@ -17,6 +17,12 @@ typedef SellCSigma<Type> SCS;
 bool shuffleParticlesTests();
 bool resortElementsTest();
 bool reshuffleTests();
+bool growChunksTest();
+bool shrinkTest();
+bool inPlaceTest();
+bool sortRowsTest();
+bool deterministicTest();
+bool addRemoveTest();
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
@@ -35,6 +41,30 @@ int main(int argc, char* argv[]) {
     passed = false;
     printf("[ERROR] reshuffleTests() failed\n");
   }
+  if (!growChunksTest()) {
+    passed = false;
+    printf("[ERROR] growChunksTest() failed\n");
+  }
+  if (!shrinkTest()) {
+    passed = false;
+    printf("[ERROR] shrinkTest() failed\n");
+  }
+  if (!inPlaceTest()) {
+    passed = false;
+    printf("[ERROR] inPlaceTest() failed\n");
+  }
+  if (!sortRowsTest()) {
+    passed = false;
+    printf("[ERROR] sortRowsTest() failed\n");
+  }
+  if (!deterministicTest()) {
+    passed = false;
+    printf("[ERROR] deterministicTest() failed\n");
+  }
+  if (!addRemoveTest()) {
+    passed = false;
+    printf("[ERROR] addRemoveTest() failed\n");
+  }
 
   Kokkos::finalize();
   MPI_Finalize();
@@ -281,6 +311,10 @@ bool reshuffleTests() {
   scs->rebuild(new_element, new_particle_elems, new_particle_info);
 
   scs->printFormat();
+  if (scs->nPtcls() != np + 2) {
+    printf("[ERROR] Particle count is %d after adding 2 particles to %d\n", scs->nPtcls(), np);
+    fail(0) = 1;
+  }
 
 
   //Remove all particles from element 0 & 2, move particles from 1 & 3 to 0 & 2
@@ -317,6 +351,649 @@ bool reshuffleTests() {
     }
   };
   scs->parallel_for(checkFinal);
+
+  //The particle count is derived from the row counts, compare it to the mask
+  SCS::kkLidView num_masked("num_masked", 1);
+  auto countMask = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    Kokkos::atomic_fetch_add(&num_masked(0), mask);
+  };
+  scs->parallel_for(countMask);
+  int masked = particle_structs::getLastValue<lid_t>(num_masked);
+  if (scs->nPtcls() != masked) {
+    printf("[ERROR] Particle count %d does not match the %d particles in the mask\n",
+           scs->nPtcls(), masked);
+    fail(0) = 1;
+  }
   int f = particle_structs::getLastValue<lid_t>(fail);
   return !f;
 }
+
+bool growChunksTest() {
+  //Overflow one row so only its chunk is grown instead of rebuilding the structure
+  printf("\n\nGrow Chunks Test\n");
+  int ne = 8;
+  int np = 40;
+  int* ptcls_per_elem = new int[ne];
+  std::vector<int>* ids = new std::vector<int>[ne];
+  distribute_particles(ne, np, 0, ptcls_per_elem, ids);
+  delete [] ids;
+
+  int C = 4;
+  Kokkos::TeamPolicy<exe_space> po(128, C);
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  particle_structs::hostToDevice(ptcls_per_elem_v, ptcls_per_elem);
+  delete [] ptcls_per_elem;
+
+  SCS* scs = new SCS(po, 1, 1024, ne, np, ptcls_per_elem_v, element_gids_v);
+  scs->printFormat();
+  const lid_t old_capacity = scs->capacity();
+
+  auto pids = scs->get<0>();
+  SCS::kkLidView new_element("new_element", scs->capacity());
+  //Move one particle from element 0 to the full element 4
+  SCS::kkLidView moved("moved", 1);
+  auto moveOne = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    pids(particle_id) = particle_id;
+    new_element(particle_id) = element_id;
+    if (mask && element_id == 0 && Kokkos::atomic_fetch_add(&moved(0), 1) == 0) {
+      new_element(particle_id) = 4;
+      pids(particle_id) = -1;
+    }
+  };
+  scs->parallel_for(moveOne);
+  scs->rebuild(new_element);
+  scs->printFormat();
+
+  SCS::kkLidView fail("fail", 1);
+  if (scs->nPtcls() != np) {
+    printf("[ERROR] Particle count changed after growing chunks (%d != %d)\n",
+           scs->nPtcls(), np);
+    fail(0) = 1;
+  }
+  if (scs->capacity() <= old_capacity) {
+    printf("[ERROR] Capacity did not grow (%d <= %d)\n", scs->capacity(), old_capacity);
+    fail(0) = 1;
+  }
+  pids = scs->get<0>();
+  auto checkIndices = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask) {
+      if (pids(particle_id) == -1 && element_id != 4) {
+        printf("[ERROR] Moved particle is in element %d instead of 4\n", element_id);
+        fail(0) = 1;
+      }
+      if (pids(particle_id) != -1 && pids(particle_id) != particle_id) {
+        printf("[ERROR] Particle %d was moved to index %d\n", pids(particle_id), particle_id);
+        fail(0) = 1;
+      }
+    }
+  };
+  scs->parallel_for(checkIndices);
+  int f = getLastValue<lid_t>(fail);
+  delete scs;
+  return !f;
+}
+
+//Rebuilds without moving any particles
+void rebuildStaying(SCS* scs) {
+  SCS::kkLidView new_element("new_element", scs->capacity());
+  auto stay = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    new_element(particle_id) = mask ? element_id : -1;
+  };
+  scs->parallel_for(stay);
+  scs->rebuild(new_element);
+}
+
+//Checks every particle has an id that is a multiple of keep and counts them
+bool checkKept(SCS* scs, int keep, int expected, const char* stage) {
+  auto pids = scs->get<0>();
+  SCS::kkLidView counts("counts", 2);
+  auto check = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask) {
+      Kokkos::atomic_fetch_add(&counts(0), 1);
+      if (pids(particle_id) % keep != 0 || pids(particle_id) / 10 != element_id)
+        Kokkos::atomic_fetch_add(&counts(1), 1);
+    }
+  };
+  scs->parallel_for(check);
+  auto counts_host = particle_structs::deviceToHost(counts);
+  if (counts_host(0) != expected || scs->nPtcls() != expected || counts_host(1) != 0) {
+    printf("[ERROR] %d particles (%d expected) with %d wrong ids after %s\n", counts_host(0),
+           expected, counts_host(1), stage);
+    return false;
+  }
+  return true;
+}
+
+bool shrinkTest() {
+  //Remove most of the particles and check the allocations shrink
+  printf("\n\nShrink Test\n");
+  const int ne = 100;
+  const int np = 1000;
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  Kokkos::deep_copy(ptcls_per_elem_v, np / ne);
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  Kokkos::TeamPolicy<exe_space> po(128, 4);
+  particle_structs::SCS_Input<Type> input(po, 1, 1024, ne, np, ptcls_per_elem_v,
+                                          element_gids_v);
+  input.shrink_threshold = 0.5;
+  bool passed = true;
+  for (int keep_swap = 1; keep_swap >= 0; --keep_swap) {
+    input.keep_swap = keep_swap;
+    SCS* scs = new SCS(input);
+    //Particle ids are ordered by element so the element can be checked from the id
+    auto pids = scs->get<0>();
+    SCS::kkLidView next_id("next_id", ne);
+    auto setIds = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+      if (mask)
+        pids(particle_id) = element_id * 10 + Kokkos::atomic_fetch_add(&next_id(element_id), 1);
+    };
+    scs->parallel_for(setIds);
+    const std::size_t full_allocation = scs->allocatedSize();
+    if (!keep_swap && full_allocation >= 2 * (std::size_t)scs->capacity()) {
+      printf("[ERROR] The swap buffer was allocated without keep_swap\n");
+      passed = false;
+    }
+
+    //Remove all but every fifth particle, a full rebuild each time
+    scs->setShuffling(false);
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    auto removeParticles = PS_LAMBDA(const int& element_id, const int& particle_id,
+                                     const bool mask) {
+      new_element(particle_id) = mask && pids(particle_id) % 5 == 0 ? element_id : -1;
+    };
+    scs->parallel_for(removeParticles);
+    scs->rebuild(new_element);
+    passed &= checkKept(scs, 5, np / 5, "removing particles");
+    //A second rebuild replaces the last of the large allocations
+    rebuildStaying(scs);
+    passed &= checkKept(scs, 5, np / 5, "rebuilding");
+    if (scs->allocatedSize() * 2 > full_allocation) {
+      printf("[ERROR] Allocation did not shrink (%zu of %zu)\n", scs->allocatedSize(),
+             full_allocation);
+      passed = false;
+    }
+    if (!keep_swap && scs->allocatedSize() >= 2 * (std::size_t)scs->capacity()) {
+      printf("[ERROR] The swap buffer was kept without keep_swap\n");
+      passed = false;
+    }
+
+    scs->shrinkToFit();
+    passed &= checkKept(scs, 5, np / 5, "shrinkToFit");
+    if (scs->allocatedSize() != (std::size_t)scs->capacity()) {
+      printf("[ERROR] Allocation %zu is not the capacity %d after shrinkToFit\n",
+             scs->allocatedSize(), scs->capacity());
+      passed = false;
+    }
+    //Rebuilding after shrinking allocates the swap again
+    rebuildStaying(scs);
+    passed &= checkKept(scs, 5, np / 5, "rebuilding after shrinkToFit");
+    delete scs;
+  }
+  return passed;
+}
+
+//Checks each particle id is in its expected element and appears exactly once
+bool checkExpected(SCS* scs, SCS::kkLidView expected, const char* stage) {
+  auto pids = scs->get<0>();
+  SCS::kkLidView seen("seen", expected.size());
+  SCS::kkLidView wrong("wrong", 1);
+  auto check = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask) {
+      const int id = pids(particle_id);
+      if (id < 0 || id >= (int)expected.size() || expected(id) != element_id)
+        Kokkos::atomic_fetch_add(&wrong(0), 1);
+      else
+        Kokkos::atomic_fetch_add(&seen(id), 1);
+    }
+  };
+  scs->parallel_for(check);
+  lid_t missing = 0;
+  lid_t active = 0;
+  Kokkos::parallel_reduce("check_seen", expected.size(),
+                          KOKKOS_LAMBDA(const int& id, lid_t& sum) {
+    sum += seen(id) != (expected(id) != -1);
+  }, missing);
+  Kokkos::parallel_reduce("count_expected", expected.size(),
+                          KOKKOS_LAMBDA(const int& id, lid_t& sum) {
+    sum += expected(id) != -1;
+  }, active);
+  const lid_t num_wrong = getLastValue<lid_t>(wrong);
+  if (num_wrong || missing || scs->nPtcls() != active) {
+    printf("[ERROR] %d particles in the wrong element and %d missing or repeated after %s\n",
+           num_wrong, missing, stage);
+    return false;
+  }
+  return true;
+}
+
+bool inPlaceTest() {
+  //Full rebuilds that move, remove and add particles without the swap buffer
+  printf("\n\nIn Place Rebuild Test\n");
+  const int ne = 50;
+  const int np = 1000;
+  const int num_new = 20;
+  const int steps = 3;
+  //Enough new particles on the last step that the structure must grow
+  const int num_grow = 2 * np;
+  const int max_ids = np + steps * num_new + num_grow;
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  Kokkos::deep_copy(ptcls_per_elem_v, np / ne);
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  Kokkos::TeamPolicy<exe_space> po(128, 4);
+  particle_structs::SCS_Input<Type> input(po, INT_MAX, 8, ne, np, ptcls_per_elem_v,
+                                          element_gids_v);
+  input.rebuild_strat = particle_structs::REBUILD_IN_PLACE;
+  //Stage fewer cycles than there are so the staging is done in batches
+  input.staging_size = 1;
+  input.shuffling = false;
+  SCS* scs = new SCS(input);
+  bool passed = true;
+  if (scs->allocatedSize() >= 2 * (std::size_t)scs->capacity()) {
+    printf("[ERROR] The swap buffer was allocated for an in place rebuild\n");
+    passed = false;
+  }
+
+  auto pids = scs->get<0>();
+  SCS::kkLidView expected("expected", max_ids);
+  Kokkos::deep_copy(expected, -1);
+  SCS::kkLidView next_id("next_id", 1);
+  auto setIds = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask) {
+      const int id = Kokkos::atomic_fetch_add(&next_id(0), 1);
+      pids(particle_id) = id;
+      expected(id) = element_id;
+    }
+  };
+  scs->parallel_for(setIds);
+  passed &= checkExpected(scs, expected, "construction");
+
+  for (int step = 0; step <= steps; ++step) {
+    const bool grow = step == steps;
+    const std::size_t allocation = scs->allocatedSize();
+    //Remove every seventh particle and move the rest forward by a few elements
+    pids = scs->get<0>();
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    auto move = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+      new_element(particle_id) = -1;
+      if (mask) {
+        const int id = pids(particle_id);
+        const int elem = (id + step) % 7 == 0 ? -1 : (element_id + 1 + id % 3) % ne;
+        new_element(particle_id) = elem;
+        expected(id) = elem;
+      }
+    };
+    scs->parallel_for(move);
+    const int n = grow ? num_grow : num_new;
+    const int first_id = grow ? np + steps * num_new : np + step * num_new;
+    SCS::kkLidView new_ptcl_elems("new_ptcl_elems", n);
+    auto new_ptcls = particle_structs::createMemberViews<Type>(n);
+    auto new_ids = particle_structs::getMemberView<Type, 0>(new_ptcls);
+    Kokkos::parallel_for(n, KOKKOS_LAMBDA(const int& i) {
+      new_ptcl_elems(i) = (i * 3) % ne;
+      new_ids(i) = first_id + i;
+      expected(first_id + i) = (i * 3) % ne;
+    });
+    scs->rebuild(new_element, new_ptcl_elems, new_ptcls);
+    particle_structs::destroyViews<Type>(new_ptcls);
+    passed &= checkExpected(scs, expected, grow ? "growing" : "rebuilding in place");
+    if (!grow && scs->allocatedSize() != allocation) {
+      printf("[ERROR] Allocation changed from %zu to %zu rebuilding in place\n", allocation,
+             scs->allocatedSize());
+      passed = false;
+    }
+    if (scs->allocatedSize() >= 2 * (std::size_t)scs->capacity()) {
+      printf("[ERROR] The swap buffer was kept after an in place rebuild\n");
+      passed = false;
+    }
+  }
+  delete scs;
+  return passed;
+}
+
+//Checks the particle ids increase (or decrease) along the slots of each element
+bool checkRowsSorted(SCS* scs, bool ascending, const char* stage) {
+  auto pids = scs->get<0>();
+  SCS::kkLidView slot_elem("slot_elem", scs->capacity());
+  SCS::kkLidView slot_id("slot_id", scs->capacity());
+  auto record = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    slot_elem(particle_id) = mask ? element_id : -1;
+    slot_id(particle_id) = pids(particle_id);
+  };
+  scs->parallel_for(record);
+  auto slot_elem_h = particle_structs::deviceToHost(slot_elem);
+  auto slot_id_h = particle_structs::deviceToHost(slot_id);
+  std::vector<int> last(scs->nElems(), -1);
+  int unsorted = 0;
+  for (int slot = 0; slot < scs->capacity(); ++slot) {
+    const int elem = slot_elem_h(slot);
+    if (elem == -1)
+      continue;
+    const int id = slot_id_h(slot);
+    if (last[elem] != -1 && (ascending ? id < last[elem] : id > last[elem]))
+      ++unsorted;
+    last[elem] = id;
+  }
+  if (unsorted) {
+    printf("[ERROR] %d particles out of order within their row after %s\n", unsorted, stage);
+    return false;
+  }
+  return true;
+}
+
+bool sortRowsTest() {
+  //Particles ordered by their id within each row through reshuffles and full rebuilds
+  printf("\n\nSort Rows Test\n");
+  const int ne = 20;
+  const int np = 400;
+  const int num_new = 30;
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  Kokkos::deep_copy(ptcls_per_elem_v, np / ne);
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  Kokkos::TeamPolicy<exe_space> po(128, 4);
+  particle_structs::SCS_Input<Type> input(po, INT_MAX, 4, ne, np, ptcls_per_elem_v,
+                                          element_gids_v);
+  input.sort_key_member = 0;
+  input.shuffle_padding = 0.5;
+  SCS* scs = new SCS(input);
+
+  //Ids decrease along the slots so every row starts out of order
+  auto pids = scs->get<0>();
+  const int cap = scs->capacity();
+  const int max_ids = cap + 3 * num_new;
+  SCS::kkLidView expected("expected", max_ids);
+  Kokkos::deep_copy(expected, -1);
+  auto setIds = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask) {
+      pids(particle_id) = cap - 1 - particle_id;
+      expected(cap - 1 - particle_id) = element_id;
+    }
+  };
+  scs->parallel_for(setIds);
+  bool passed = true;
+
+  const char* stages[] = {"reshuffling without moves", "reshuffling moved particles",
+                          "a full rebuild"};
+  for (int step = 0; step < 3; ++step) {
+    scs->setShuffling(step < 2);
+    pids = scs->get<0>();
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    auto move = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+      if (mask) {
+        const int id = pids(particle_id);
+        const int elem = step == 0 || id % 5 ? element_id : (element_id + 1 + id % 3) % ne;
+        new_element(particle_id) = elem;
+        expected(id) = elem;
+      }
+    };
+    scs->parallel_for(move);
+    const int first_id = cap + step * num_new;
+    SCS::kkLidView new_ptcl_elems("new_ptcl_elems", num_new);
+    auto new_ptcls = particle_structs::createMemberViews<Type>(num_new);
+    auto new_ids = particle_structs::getMemberView<Type, 0>(new_ptcls);
+    Kokkos::parallel_for(num_new, KOKKOS_LAMBDA(const int& i) {
+      new_ptcl_elems(i) = (i * 7) % ne;
+      //Ids of new particles interleave with the ids already in the rows
+      new_ids(i) = first_id + i;
+      expected(first_id + i) = (i * 7) % ne;
+    });
+    const lid_t failed = scs->numFailedReshuffles();
+    scs->rebuild(new_element, new_ptcl_elems, new_ptcls);
+    particle_structs::destroyViews<Type>(new_ptcls);
+    if (step < 2 && scs->numFailedReshuffles() != failed) {
+      printf("[ERROR] Reshuffle failed while %s\n", stages[step]);
+      passed = false;
+    }
+    passed &= checkExpected(scs, expected, stages[step]);
+    passed &= checkRowsSorted(scs, true, stages[step]);
+  }
+
+  //Sorting by explicit keys reverses the rows
+  pids = scs->get<0>();
+  Kokkos::View<uint64_t*, SCS::device_type> keys("keys", scs->capacity());
+  auto setKeys = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    if (mask)
+      keys(particle_id) = max_ids - pids(particle_id);
+  };
+  scs->parallel_for(setKeys);
+  scs->sortRows(keys);
+  passed &= checkExpected(scs, expected, "sorting by keys");
+  passed &= checkRowsSorted(scs, false, "sorting by keys");
+  delete scs;
+  return passed;
+}
+
+//Copies the id in each slot (-1 for empty slots) to the host
+SCS::kkLidHostMirror slotIds(SCS* scs) {
+  auto pids = scs->get<0>();
+  SCS::kkLidView ids("ids", scs->capacity());
+  auto record = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    ids(particle_id) = mask ? pids(particle_id) : -1;
+  };
+  scs->parallel_for(record);
+  return particle_structs::deviceToHost(ids);
+}
+
+bool deterministicTest() {
+  //Two structures given the same input and moves keep identical layouts
+  printf("\n\nDeterministic Test\n");
+  const int ne = 30;
+  const int np = 600;
+  const int num_new = 25;
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkLidView ptcl_elems("ptcl_elems", np);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    ptcl_elems(i) = (i * 7) % ne;
+    Kokkos::atomic_fetch_add(&ptcls_per_elem_v((i * 7) % ne), 1);
+  });
+  auto ptcl_info = particle_structs::createMemberViews<Type>(np);
+  auto info_ids = particle_structs::getMemberView<Type, 0>(ptcl_info);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    info_ids(i) = i;
+  });
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  Kokkos::TeamPolicy<exe_space> po(128, 4);
+  particle_structs::SCS_Input<Type> input(po, 5, 4, ne, np, ptcls_per_elem_v, element_gids_v,
+                                          ptcl_elems, ptcl_info);
+  input.deterministic = true;
+  input.shuffle_padding = 0.5;
+  SCS* scs[2] = {new SCS(input), new SCS(input)};
+  particle_structs::destroyViews<Type>(ptcl_info);
+  const int max_ids = np + 5 * num_new;
+  SCS::kkLidView expected("expected", max_ids);
+  Kokkos::deep_copy(expected, -1);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    expected(i) = ptcl_elems(i);
+  });
+
+  bool passed = true;
+  const char* stages[] = {"construction", "reshuffling", "reshuffling with new particles",
+                          "a full rebuild", "a full rebuild with new particles"};
+  for (int step = 0; step < 5; ++step) {
+    for (int s = 0; s < 2 && step > 0; ++s) {
+      scs[s]->setShuffling(step < 3);
+      auto pids = scs[s]->get<0>();
+      SCS::kkLidView new_element("new_element", scs[s]->capacity());
+      auto move = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+        if (mask) {
+          const int id = pids(particle_id);
+          int elem = id % 4 ? element_id : (element_id + step) % ne;
+          if (id % 11 == step)
+            elem = -1;
+          new_element(particle_id) = elem;
+          expected(id) = elem;
+        }
+      };
+      scs[s]->parallel_for(move);
+      const int n = step % 2 ? 0 : num_new;
+      const int first_id = np + step * num_new;
+      SCS::kkLidView new_ptcl_elems("new_ptcl_elems", n);
+      auto new_ptcls = particle_structs::createMemberViews<Type>(n);
+      auto new_ids = particle_structs::getMemberView<Type, 0>(new_ptcls);
+      Kokkos::parallel_for(n, KOKKOS_LAMBDA(const int& i) {
+        new_ptcl_elems(i) = (i * 3) % ne;
+        new_ids(i) = first_id + i;
+        expected(first_id + i) = (i * 3) % ne;
+      });
+      scs[s]->rebuild(new_element, new_ptcl_elems, new_ptcls);
+      particle_structs::destroyViews<Type>(new_ptcls);
+    }
+    passed &= checkExpected(scs[0], expected, stages[step]);
+    //The particles of each row are placed in the order they were given
+    if (step == 0)
+      passed &= checkRowsSorted(scs[0], true, stages[step]);
+    auto ids0 = slotIds(scs[0]);
+    auto ids1 = slotIds(scs[1]);
+    int differ = ids0.size() != ids1.size();
+    for (std::size_t i = 0; !differ && i < ids0.size(); ++i)
+      differ += ids0(i) != ids1(i);
+    if (differ) {
+      printf("[ERROR] The layouts of the structures differ after %s\n", stages[step]);
+      passed = false;
+    }
+  }
+  delete scs[0];
+  delete scs[1];
+  return passed;
+}
+
+//Removes the particles with id % every == 0 and records them as removed in expected
+void removeEvery(SCS* scs, int every, SCS::kkLidView expected) {
+  auto pids = scs->get<0>();
+  SCS::kkLidView ptcl_ids("ptcl_ids", scs->nPtcls() + 2);
+  SCS::kkLidView count("count", 1);
+  auto select = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    const int id = pids(particle_id);
+    if (mask && id % every == 0) {
+      ptcl_ids(Kokkos::atomic_fetch_add(&count(0), 1)) = particle_id;
+      expected(id) = -1;
+    }
+  };
+  scs->parallel_for(select);
+  //Repeated and out of range indices are ignored
+  const int n = getLastValue<lid_t>(count);
+  Kokkos::parallel_for(1, KOKKOS_LAMBDA(const int&) {
+    ptcl_ids(n) = n > 0 ? ptcl_ids(0) : -1;
+    ptcl_ids(n + 1) = -1;
+  });
+  scs->removeParticles(Kokkos::subview(ptcl_ids, Kokkos::make_pair(0, n + 2)));
+}
+
+//Adds n particles with ids starting at first_id to elem + i % span
+void addToElements(SCS* scs, int n, int first_id, int elem, int span,
+                   SCS::kkLidView expected) {
+  SCS::kkLidView new_ptcl_elems("new_ptcl_elems", n);
+  auto new_ptcls = particle_structs::createMemberViews<Type>(n);
+  auto new_ids = particle_structs::getMemberView<Type, 0>(new_ptcls);
+  Kokkos::parallel_for(n, KOKKOS_LAMBDA(const int& i) {
+    new_ptcl_elems(i) = elem + i % span;
+    new_ids(i) = first_id + i;
+    expected(first_id + i) = elem + i % span;
+  });
+  scs->addParticles(new_ptcl_elems, new_ptcls);
+  particle_structs::destroyViews<Type>(new_ptcls);
+}
+
+//Rebuilds keeping the current particles and adding n particles like addToElements
+void rebuildWithNew(SCS* scs, int n, int first_id, int elem, int span,
+                    SCS::kkLidView expected) {
+  SCS::kkLidView new_element("new_element", scs->capacity());
+  auto stay = PS_LAMBDA(const int& element_id, const int& particle_id, const bool mask) {
+    new_element(particle_id) = mask ? element_id : -1;
+  };
+  scs->parallel_for(stay);
+  SCS::kkLidView new_ptcl_elems("new_ptcl_elems", n);
+  auto new_ptcls = particle_structs::createMemberViews<Type>(n);
+  auto new_ids = particle_structs::getMemberView<Type, 0>(new_ptcls);
+  Kokkos::parallel_for(n, KOKKOS_LAMBDA(const int& i) {
+    new_ptcl_elems(i) = elem + i % span;
+    new_ids(i) = first_id + i;
+    expected(first_id + i) = elem + i % span;
+  });
+  scs->rebuild(new_element, new_ptcl_elems, new_ptcls);
+  particle_structs::destroyViews<Type>(new_ptcls);
+}
+
+//Checks the particles that were in the structure before did not change slots
+bool checkStayed(SCS* scs, SCS::kkLidHostMirror before, const char* stage) {
+  auto after = slotIds(scs);
+  int moved = 0;
+  for (std::size_t i = 0; i < before.size(); ++i)
+    moved += before(i) != -1 && after(i) != -1 && before(i) != after(i);
+  if (moved) {
+    printf("[ERROR] %d particles changed slots after %s\n", moved, stage);
+    return false;
+  }
+  return true;
+}
+
+bool addRemoveTest() {
+  //Particles are added and removed without moving the other particles
+  printf("\n\nAdd/Remove Particles Test\n");
+  const int ne = 20;
+  const int np = 200;
+  const int max_ids = 1000;
+  SCS::kkLidView ptcls_per_elem_v("ptcls_per_elem_v", ne);
+  SCS::kkLidView ptcl_elems("ptcl_elems", np);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    ptcl_elems(i) = i % ne;
+    Kokkos::atomic_fetch_add(&ptcls_per_elem_v(i % ne), 1);
+  });
+  auto ptcl_info = particle_structs::createMemberViews<Type>(np);
+  auto info_ids = particle_structs::getMemberView<Type, 0>(ptcl_info);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    info_ids(i) = i;
+  });
+  SCS::kkGidView element_gids_v("element_gids_v", 0);
+  Kokkos::TeamPolicy<exe_space> po(128, 4);
+  particle_structs::SCS_Input<Type> input(po, 5, 4, ne, np, ptcls_per_elem_v, element_gids_v,
+                                          ptcl_elems, ptcl_info);
+  input.shuffle_padding = 0.2;
+  SCS* scs = new SCS(input);
+  particle_structs::destroyViews<Type>(ptcl_info);
+  SCS::kkLidView expected("expected", max_ids);
+  Kokkos::deep_copy(expected, -1);
+  Kokkos::parallel_for(np, KOKKOS_LAMBDA(const int& i) {
+    expected(i) = ptcl_elems(i);
+  });
+
+  bool passed = true;
+  auto before = slotIds(scs);
+  removeEvery(scs, 5, expected);
+  passed &= checkExpected(scs, expected, "removing particles");
+  passed &= checkStayed(scs, before, "removing particles");
+
+  //The new particles fit in the holes left by the removed ones
+  const lid_t cap = scs->capacity();
+  before = slotIds(scs);
+  addToElements(scs, 20, np, 0, ne, expected);
+  passed &= checkExpected(scs, expected, "adding particles to holes");
+  passed &= checkStayed(scs, before, "adding particles to holes");
+  if (scs->capacity() != cap) {
+    printf("[ERROR] Adding particles to holes changed the capacity\n");
+    passed = false;
+  }
+
+  //Overflowing rows grow their chunk or fall back to a full rebuild
+  addToElements(scs, 300, np + 20, 3, 2, expected);
+  passed &= checkExpected(scs, expected, "adding particles to full rows");
+
+  //Every particle is removed and the empty structure is refilled
+  removeEvery(scs, 1, expected);
+  passed &= checkExpected(scs, expected, "removing every particle");
+  addToElements(scs, 50, np + 320, 0, ne, expected);
+  passed &= checkExpected(scs, expected, "adding particles to an empty structure");
+
+  //A rebuild of an empty structure with a few new particles is not a reshuffle since the
+  //  holes of the empty structure are not visited
+  removeEvery(scs, 1, expected);
+  const lid_t empty_cap = scs->capacity();
+  rebuildWithNew(scs, 3, np + 370, 2, 1, expected);
+  passed &= checkExpected(scs, expected, "rebuilding an empty structure with new particles");
+  if (scs->capacity() > empty_cap) {
+    printf("[ERROR] Rebuilding an empty structure with new particles grew the capacity\n");
+    passed = false;
+  }
+  delete scs;
+  return passed;
+}
@@ -18,6 +18,7 @@ typedef ps::SCS_Input<Type> Input;
 bool padEvenly(Input& input);
 bool padProportionally(Input& input);
 bool padInversely(Input& input);
+bool padAdaptive();
 
 int main(int argc, char* argv[]) {
   MPI_Init(&argc, &argv);
@@ -55,6 +56,10 @@ int main(int argc, char* argv[]) {
       printf("[ERROR] padInversely() failed\n");
     }
   }
+  if (!padAdaptive()) {
+    ++fails;
+    printf("[ERROR] padAdaptive() failed\n");
+  }
   Kokkos::finalize();
   MPI_Finalize();
   if (fails == 0)
@@ -109,3 +114,73 @@ bool padInversely(Input& input) {
   delete scs;
   return true;
 }
+
+/* Moves one particle from each of five elements into element 0 every step
+   Returns the number of reshuffles that failed or -1 if particles were lost
+*/
+int sinkSteps(ps::PaddingStrategy strat, int steps) {
+  const int ne = 100;
+  const int ppe = 10;
+  SCS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  Kokkos::deep_copy(ptcls_per_elem, ppe);
+  SCS::kkGidView element_gids("", 0);
+  Kokkos::TeamPolicy<exe_space> po(4, 4);
+  Input input(po, 1, 1024, ne, ne * ppe, ptcls_per_elem, element_gids);
+  input.padding_strat = strat;
+  input.shuffle_padding = 0.2;
+  input.extra_padding = 0;
+  SCS* scs = new SCS(input);
+
+  int result = 0;
+  SCS::kkLidView moved("moved", ne);
+  SCS::kkLidView counts("counts", ne);
+  for (int step = 0; step < steps; ++step) {
+    const int first_donor = 1 + 5 * (step % 19);
+    SCS::kkLidView new_element("new_element", scs->capacity());
+    Kokkos::deep_copy(moved, 0);
+    auto sink = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      new_element(p) = mask ? e : -1;
+      if (mask && e >= first_donor && e < first_donor + 5 &&
+          Kokkos::atomic_fetch_add(&moved(e), 1) == 0)
+        new_element(p) = 0;
+    };
+    ps::parallel_for(scs, sink, "sink");
+    scs->rebuild(new_element);
+
+    Kokkos::deep_copy(counts, 0);
+    auto count = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+      if (mask)
+        Kokkos::atomic_fetch_add(&counts(e), 1);
+    };
+    ps::parallel_for(scs, count, "count");
+    auto counts_host = ps::deviceToHost(counts);
+    int total = 0;
+    for (int i = 0; i < ne; ++i)
+      total += counts_host(i);
+    if (scs->nPtcls() != ne * ppe || total != ne * ppe ||
+        counts_host(0) != ppe + 5 * (step + 1)) {
+      printf("[ERROR] Particles were lost on step %d of a sink with strategy %d\n", step,
+             strat);
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0)
+    result = scs->numFailedReshuffles();
+  scs->printMetrics();
+  delete scs;
+  return result;
+}
+
+bool padAdaptive() {
+  const int steps = 40;
+  printf("\nPadAdaptive\n");
+  const int even_fails = sinkSteps(ps::PAD_EVENLY, steps);
+  const int adaptive_fails = sinkSteps(ps::PAD_ADAPTIVE, steps);
+  printf("Failed reshuffles of %d: PAD_EVENLY %d PAD_ADAPTIVE %d\n", steps, even_fails,
+         adaptive_fails);
+  if (even_fails < 0 || adaptive_fails < 0)
+    return false;
+  //Padding the sink should avoid some of the full rebuilds
+  return adaptive_fails < even_fails;
+}
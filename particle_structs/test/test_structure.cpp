@@ -24,6 +24,7 @@ int addCSRs(std::vector<PS*>& structures, std::vector<std::string>& names,
 int testCounts(const char* name, PS* structure, lid_t num_elems, lid_t num_ptcls);
 int testParticleExistence(const char* name, PS* structure, lid_t num_ptcls);
 int setValues(const char* name, PS* structure);
+int testActiveParticles(const char* name, PS* structure);
 
 //Functionality tests
 int testRebuild(const char* name, PS* structure);
@@ -73,10 +74,8 @@ int main(int argc, char* argv[]) {
     fails += addSCSs(structures, names, num_elems, num_ptcls, ppe, element_gids,
                      particle_elements, particle_info);
     //Add CSR
-    /* Uncomment when CSR is being implemented
     fails += addCSRs(structures, names, num_elems, num_ptcls, ppe, element_gids,
                      particle_elements, particle_info);
-    */
 
 
 
@@ -85,9 +84,11 @@ int main(int argc, char* argv[]) {
       fails += testCounts(names[i].c_str(), structures[i], num_elems, num_ptcls);
       fails += testParticleExistence(names[i].c_str(), structures[i], num_ptcls);
       fails += setValues(names[i].c_str(), structures[i]);
+      fails += testActiveParticles(names[i].c_str(), structures[i]);
       fails += testMetrics(names[i].c_str(), structures[i]);
       fails += testRebuild(names[i].c_str(), structures[i]);
       fails += testMigration(names[i].c_str(), structures[i]);
+      fails += testActiveParticles(names[i].c_str(), structures[i]);
       fails += testCopy(names[i].c_str(), structures[i]);
       fails += testSegmentComp(names[i].c_str(), structures[i]);
       fails += migrateToEmptyAndRefill(names[i].c_str(), structures[i]);
@@ -243,6 +244,36 @@ int setValues(const char* name, PS* structure) {
   return fails;
 }
 
+int testActiveParticles(const char* name, PS* structure) {
+  int fails = 0;
+  kkLidView failures("fails", 1);
+  //Record the element of each particle from the full parallel_for
+  kkLidView elems("elems", structure->capacity());
+  kkLidView visits("visits", structure->capacity());
+  auto setElems = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    elems(p) = mask ? e : -1;
+  };
+  ps::parallel_for(structure, setElems, "setElems");
+  auto visitActive = PS_LAMBDA(const lid_t& e, const lid_t& p, const bool& mask) {
+    Kokkos::atomic_fetch_add(&(visits(p)), 1);
+    if (!mask || elems(p) != e) {
+      printf("[ERROR] Test %s: Particle %d visited with element %d instead of %d\n",
+             name, p, e, elems(p));
+      failures(0) = 1;
+    }
+  };
+  ps::parallel_for_active(structure, visitActive, "visitActive");
+  Kokkos::parallel_for(structure->capacity(), KOKKOS_LAMBDA(const lid_t& p) {
+    if (visits(p) != (elems(p) != -1)) {
+      printf("[ERROR] Test %s: Particle %d visited %d times by parallel_for_active\n",
+             name, p, visits(p));
+      failures(0) = 1;
+    }
+  });
+  fails += ps::getLastValue<lid_t>(failures);
+  return fails;
+}
+
 //Functionality tests
 int testRebuild(const char* name, PS* structure) {
   int fails = 0;
@@ -12,6 +12,10 @@ add_test(NAME rebuild COMMAND ./rebuild)
 
 add_test(NAME lambdaTest COMMAND ./lambdaTest)
 
+add_test(NAME aosoa COMMAND ./aosoaTest)
+add_test(NAME memberLayout COMMAND ./memberLayoutTest)
+add_test(NAME memberLayout4 COMMAND mpirun -np 4 ./memberLayoutTest)
+
 add_test(NAME migrateNothing COMMAND ./migrateTest)
 
 add_test(NAME migrate4 COMMAND mpirun -np 4 ./migrateTest)
@@ -0,0 +1,235 @@
+#include <particle_structs.hpp>
+#include <algorithm>
+#include <cmath>
+#include "perfTypes.hpp"
+#include "../particle_structs/test/Distribute.h"
+
+typedef pumipic::SellCSigma<PerfTypes, MemSpace> SCS;
+
+/* Parameters swept by the autotuner
+   The padding strategies are only swept when there is shuffle padding
+*/
+const int team_sizes[] = {8, 16, 32};
+const int sigmas[] = {1, 1024, INT_MAX};
+const int vertical_sizes[] = {32, 128, 1024};
+const double shuffle_paddings[] = {0.0, 0.1, 0.2};
+const pumipic::PaddingStrategy padding_strats[] = {pumipic::PAD_EVENLY,
+                                                   pumipic::PAD_PROPORTIONALLY,
+                                                   pumipic::PAD_INVERSELY,
+                                                   pumipic::PAD_ADAPTIVE};
+const char* padding_names[] = {"PAD_EVENLY", "PAD_PROPORTIONALLY", "PAD_INVERSELY",
+                               "PAD_ADAPTIVE"};
+const int num_padding_strats = 4;
+const int num_distributions = 4;
+
+struct Config {
+  int C;
+  int sigma;
+  int V;
+  double shuffle_padding;
+  int pad_strat;
+};
+
+/* Timings of one config on one distribution
+     reshuffle - rebuild with shuffling enabled
+     rebuild - rebuild with shuffling disabled
+     push - parallel_for updating a member of every particle
+*/
+struct Timings {
+  std::vector<double> reshuffle;
+  std::vector<double> rebuild;
+  std::vector<double> push;
+};
+
+double push(SCS* scs);
+double moveParticles(SCS* scs, int strat, double percentMoved, bool shuffle);
+double median(std::vector<double> times);
+double stddev(const std::vector<double>& times);
+Timings runConfig(const Config& config, int num_elems, int num_ptcls, int strat,
+                  double percentMoved, int trials);
+void writeConfig(const char* filename, const Config& config, int num_elems, int num_ptcls,
+                 const std::vector<int>& strats, double percentMoved);
+
+int main(int argc, char* argv[]) {
+  Kokkos::initialize(argc, argv);
+  MPI_Init(&argc, &argv);
+
+  /* Check commandline arguments */
+  if (argc < 6 || argc > 7) {
+    fprintf(stderr, "Usage: %s <num elems> <num ptcls> <distribution (-1 for all)> "
+            "<%% ptcls move> <num trials> [output file]\n", argv[0]);
+    MPI_Finalize();
+    Kokkos::finalize();
+    return 1;
+  }
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+
+  {
+    int num_elems = atoi(argv[1]);
+    int num_ptcls = atoi(argv[2]);
+    int strat = atoi(argv[3]);
+    double percentMoved = atof(argv[4]);
+    int trials = atoi(argv[5]);
+    const char* filename = argc == 7 ? argv[6] : "scs_autotune.cfg";
+    std::vector<int> strats;
+    if (strat < 0)
+      for (int i = 0; i < num_distributions; ++i)
+        strats.push_back(i);
+    else
+      strats.push_back(strat);
+
+    /* Build the configurations to sweep */
+    std::vector<Config> configs;
+    for (int c : team_sizes)
+      for (int sigma : sigmas)
+        for (int V : vertical_sizes)
+          for (double pad : shuffle_paddings)
+            for (int ps = 0; ps < (pad > 0 ? num_padding_strats : 1); ++ps) {
+              Config config = {c, sigma, V, pad, ps};
+              configs.push_back(config);
+            }
+    printf("Sweeping %lu configurations over %lu distributions with %d trials\n",
+           configs.size(), strats.size(), trials);
+
+    /* The score of a config is the sum over distributions of the median time of a step
+       (one push and one rebuild with shuffling) plus the median time of a full rebuild */
+    std::vector<double> scores(configs.size(), 0);
+    std::vector<int> best_per_dist(strats.size(), 0);
+    for (size_t d = 0; d < strats.size(); ++d) {
+      printf("Distribution: %s\n", distribute_name(strats[d]));
+      printf("%-4s %-10s %-5s %-5s %-20s | %-22s %-22s %-22s\n", "C", "sigma", "V", "pad",
+             "strategy", "reshuffle (med/std)", "rebuild (med/std)", "push (med/std)");
+      double best_dist_score = -1;
+      for (size_t i = 0; i < configs.size(); ++i) {
+        const Config& config = configs[i];
+        Timings t = runConfig(config, num_elems, num_ptcls, strats[d], percentMoved, trials);
+        const double shuffle_med = median(t.reshuffle);
+        const double rebuild_med = median(t.rebuild);
+        const double push_med = median(t.push);
+        const double score = shuffle_med + rebuild_med + push_med;
+        scores[i] += score;
+        if (best_dist_score < 0 || score < best_dist_score) {
+          best_dist_score = score;
+          best_per_dist[d] = i;
+        }
+        printf("%-4d %-10d %-5d %-5.2f %-20s | %.3e %.3e  %.3e %.3e  %.3e %.3e\n", config.C,
+               config.sigma, config.V, config.shuffle_padding, padding_names[config.pad_strat],
+               shuffle_med, stddev(t.reshuffle), rebuild_med, stddev(t.rebuild), push_med,
+               stddev(t.push));
+      }
+      const Config& best = configs[best_per_dist[d]];
+      printf("Best for %s: C %d sigma %d V %d padding %.2f %s (%.2f Mptcls/s per step)\n",
+             distribute_name(strats[d]), best.C, best.sigma, best.V, best.shuffle_padding,
+             padding_names[best.pad_strat], num_ptcls / best_dist_score / 1e6);
+    }
+
+    const size_t best = std::min_element(scores.begin(), scores.end()) - scores.begin();
+    const Config& config = configs[best];
+    printf("Best configuration: C %d sigma %d V %d padding %.2f %s\n", config.C, config.sigma,
+           config.V, config.shuffle_padding, padding_names[config.pad_strat]);
+    if (comm_rank == 0)
+      writeConfig(filename, config, num_elems, num_ptcls, strats, percentMoved);
+  }
+
+  cleanup_distribution_memory();
+  MPI_Finalize();
+  Kokkos::finalize();
+  return 0;
+}
+
+Timings runConfig(const Config& config, int num_elems, int num_ptcls, int strat,
+                  double percentMoved, int trials) {
+  Timings timings;
+  kkLidView ppe("ptcls_per_elem", num_elems);
+  kkLidView ptcl_elems("ptcl_elems", num_ptcls);
+  kkGidView element_gids("", 0);
+  distribute_particles(num_elems, num_ptcls, strat, ppe, ptcl_elems);
+
+  Kokkos::TeamPolicy<ExeSpace> policy(4, config.C);
+  pumipic::SCS_Input<PerfTypes> input(policy, config.sigma, config.V, num_elems, num_ptcls,
+                                      ppe, element_gids);
+  input.shuffle_padding = config.shuffle_padding;
+  input.padding_strat = padding_strats[config.pad_strat];
+  input.name = "autotune";
+  SCS* scs = new SCS(input);
+
+  //Warmup so the first allocations are not timed
+  push(scs);
+  moveParticles(scs, strat, percentMoved, true);
+
+  for (int i = 0; i < trials; ++i) {
+    timings.push.push_back(push(scs));
+    timings.reshuffle.push_back(moveParticles(scs, strat, percentMoved, true));
+    timings.rebuild.push_back(moveParticles(scs, strat, percentMoved, false));
+  }
+  delete scs;
+  return timings;
+}
+
+//Times a trivial push kernel over the particles
+double push(SCS* scs) {
+  auto dbls = scs->get<2>();
+  auto touch = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+    if (mask)
+      dbls(p) += 1;
+  };
+  Kokkos::Timer t;
+  scs->parallel_for(touch, "autotune_push");
+  Kokkos::fence();
+  return t.seconds();
+}
+
+//Times a rebuild after moving percentMoved of the particles
+double moveParticles(SCS* scs, int strat, double percentMoved, bool shuffle) {
+  kkLidView new_elms("new_elems", scs->capacity());
+  redistribute_particles(scs, strat, percentMoved, new_elms);
+  scs->setShuffling(shuffle);
+  Kokkos::Timer t;
+  scs->rebuild(new_elms);
+  Kokkos::fence();
+  return t.seconds();
+}
+
+double median(std::vector<double> times) {
+  if (times.empty())
+    return 0;
+  std::sort(times.begin(), times.end());
+  const size_t n = times.size();
+  return n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+}
+
+double stddev(const std::vector<double>& times) {
+  if (times.size() < 2)
+    return 0;
+  double mean = 0;
+  for (double t : times)
+    mean += t;
+  mean /= times.size();
+  double var = 0;
+  for (double t : times)
+    var += (t - mean) * (t - mean);
+  return std::sqrt(var / (times.size() - 1));
+}
+
+void writeConfig(const char* filename, const Config& config, int num_elems, int num_ptcls,
+                 const std::vector<int>& strats, double percentMoved) {
+  FILE* f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "[ERROR] Cannot open %s to write the configuration\n", filename);
+    return;
+  }
+  fprintf(f, "# SCS_Input configuration chosen by ps_autotune\n");
+  fprintf(f, "# elements %d particles %d moved %.2f%% distributions:", num_elems, num_ptcls,
+          percentMoved);
+  for (size_t i = 0; i < strats.size(); ++i)
+    fprintf(f, " %s", distribute_name(strats[i]));
+  fprintf(f, "\n");
+  fprintf(f, "team_size = %d\n", config.C);
+  fprintf(f, "sigma = %d\n", config.sigma);
+  fprintf(f, "V = %d\n", config.V);
+  fprintf(f, "shuffle_padding = %g\n", config.shuffle_padding);
+  fprintf(f, "padding_strat = %s\n", padding_names[config.pad_strat]);
+  fclose(f);
+  printf("Wrote the best configuration to %s\n", filename);
+}
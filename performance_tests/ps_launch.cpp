@@ -0,0 +1,101 @@
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "perfTypes.hpp"
+#include "../particle_structs/test/Distribute.h"
+
+PS* createSCS(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids, int C, int sigma, int V, std::string name);
+PS* createCSR(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids);
+
+int main(int argc, char* argv[]) {
+  Kokkos::initialize(argc, argv);
+  MPI_Init(&argc, &argv);
+
+  /* Check commandline arguments */
+  if (argc != 5) {
+    fprintf(stderr, "Usage: %s <num elems> <num ptcls> <distribution> <num launches>\n",
+            argv[0]);
+    MPI_Finalize();
+    Kokkos::finalize();
+    return 1;
+  }
+
+  /* Enable timing on every process */
+  pumipic::SetTimingVerbosity(0);
+
+  {
+    /* Create initial distribution of particles */
+    int num_elems = atoi(argv[1]);
+    int num_ptcls = atoi(argv[2]);
+    int strat = atoi(argv[3]);
+    int num_launches = atoi(argv[4]);
+    kkLidView ppe("ptcls_per_elem", num_elems);
+    kkLidView ptcl_elems("ptcl_elems", num_ptcls);
+    kkGidView element_gids("",0);
+    printf("Generating particle distribution with strategy: %s\n", distribute_name(strat));
+    distribute_particles(num_elems, num_ptcls, strat, ppe, ptcl_elems);
+
+    /* Create particle structure */
+    ParticleStructures structures;
+    structures.push_back(std::make_pair("Sell-32-ne",
+                                        createSCS(num_elems, num_ptcls, ppe, element_gids,
+                                                  32, num_elems, 1024, "Sell-32-ne")));
+    structures.push_back(std::make_pair("CSR",
+                                        createCSR(num_elems, num_ptcls, ppe, element_gids)));
+
+    /* Baseline: launching an empty kernel directly with Kokkos */
+    Kokkos::View<int*> count("count", 1);
+    for (int i = 0; i < num_launches; ++i) {
+      Kokkos::Timer t;
+      Kokkos::parallel_for("empty_launch", 1, KOKKOS_LAMBDA(const int& j) {
+        count(j) += 1;
+      });
+      Kokkos::fence();
+      pumipic::RecordTime("kokkos launch", t.seconds());
+    }
+
+    printf("Performing %d launches of parallel_for on each structure\n", num_launches);
+    for (int i = 0; i < structures.size(); ++i) {
+      std::string name = structures[i].first;
+      PS* ptcls = structures[i].second;
+      printf("Beginning launches on structure %s\n", name.c_str());
+      auto dbls = ptcls->get<2>();
+      /* Trivial kernel so the time is dominated by the launch */
+      auto touch = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+        if (mask)
+          dbls(p) += 1;
+      };
+      for (int j = 0; j < num_launches; ++j) {
+        Kokkos::Timer t;
+        pumipic::parallel_for(ptcls, touch, "touch");
+        Kokkos::fence();
+        pumipic::RecordTime(name + " launch", t.seconds());
+      }
+      /* Only dispatch on the active particles */
+      for (int j = 0; j < num_launches; ++j) {
+        Kokkos::Timer t;
+        pumipic::parallel_for_active(ptcls, touch, "touch_active");
+        Kokkos::fence();
+        pumipic::RecordTime(name + " active launch", t.seconds());
+      }
+    }
+
+    for (size_t i = 0; i < structures.size(); ++i)
+      delete structures[i].second;
+    structures.clear();
+  }
+
+  cleanup_distribution_memory();
+  pumipic::SummarizeTime();
+  Kokkos::finalize();
+  return 0;
+}
+
+PS* createSCS(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids, int C, int sigma, int V, std::string name) {
+  Kokkos::TeamPolicy<ExeSpace> policy(4, C);
+  pumipic::SCS_Input<PerfTypes> input(policy, sigma, V, num_elems, num_ptcls, ppe, elm_gids);
+  input.name = name;
+  return new pumipic::SellCSigma<PerfTypes, MemSpace>(input);
+}
+PS* createCSR(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids) {
+  return new pumipic::CSR<PerfTypes, MemSpace>(num_elems, num_ptcls, ppe, elm_gids);
+}
@@ -0,0 +1,112 @@
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include <set>
+#include "perfTypes.hpp"
+#include "../particle_structs/test/Distribute.h"
+
+typedef pumipic::SellCSigma<PerfTypes, MemSpace> SCS;
+
+SCS* createSCS(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids,
+               pumipic::MigrateStrategy strat, std::string name);
+
+/* Times migrate with each communication strategy and split-phase migrate_begin/migrate_end
+   Every process sends a percentage of its particles to the processes up to num_neighbors/2
+     ranks away (a symmetric neighborhood like the buffered ranks of a picpart)
+*/
+int main(int argc, char* argv[]) {
+  Kokkos::initialize(argc, argv);
+  MPI_Init(&argc, &argv);
+
+  /* Check commandline arguments */
+  if (argc < 5 || argc > 6) {
+    fprintf(stderr, "Usage: %s <num elems> <num ptcls> <num neighbors> <%% ptcls migrate> "
+            "[num iterations]\n", argv[0]);
+    MPI_Finalize();
+    Kokkos::finalize();
+    return 1;
+  }
+  int comm_rank, comm_size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+  {
+    int num_elems = atoi(argv[1]);
+    int num_ptcls = atoi(argv[2]);
+    int num_neighbors = atoi(argv[3]);
+    double percentMoved = atof(argv[4]);
+    int iters = argc == 6 ? atoi(argv[5]) : 100;
+
+    /* Neighborhood of each process */
+    std::set<int> neighborhood;
+    neighborhood.insert(comm_rank);
+    for (int i = 1; i <= num_neighbors / 2 && i < comm_size; ++i) {
+      neighborhood.insert((comm_rank + i) % comm_size);
+      neighborhood.insert((comm_rank + comm_size - i) % comm_size);
+    }
+    std::vector<int> ranks(neighborhood.begin(), neighborhood.end());
+    const pumipic::Distributor<MemSpace> dist(ranks.size(), ranks.data());
+    kkLidView ranks_d("ranks_d", ranks.size());
+    pumipic::hostToDevice(ranks_d, ranks.data());
+    const int num_ranks = ranks.size();
+    if (!comm_rank)
+      printf("Migrating %.2f%% of the particles to %d neighbors for %d iterations\n",
+             percentMoved, num_ranks - 1, iters);
+
+    /* Every process has the same elements so particles keep their element */
+    kkLidView ppe("ptcls_per_elem", num_elems);
+    kkLidView ptcl_elems("ptcl_elems", num_ptcls);
+    kkGidView element_gids("element_gids", num_elems);
+    distribute_particles(num_elems, num_ptcls, 0, ppe, ptcl_elems);
+    Kokkos::parallel_for(num_elems, KOKKOS_LAMBDA(const int& i) {
+      element_gids(i) = i;
+    });
+
+    const pumipic::MigrateStrategy strats[] = {pumipic::MIGRATE_POINT_TO_POINT,
+                                               pumipic::MIGRATE_NEIGHBOR,
+                                               pumipic::MIGRATE_POINT_TO_POINT};
+    const bool split[] = {false, false, true};
+    const char* names[] = {"Sell-p2p", "Sell-neighbor", "Sell-p2p-split"};
+    for (int s = 0; s < 3; ++s) {
+      SCS* scs = createSCS(num_elems, num_ptcls, ppe, element_gids, strats[s], names[s]);
+      for (int i = 0; i < iters; ++i) {
+        kkLidView new_element("new_element", scs->capacity());
+        kkLidView new_process("new_process", scs->capacity());
+        const int step = i;
+        auto setDestination = PS_LAMBDA(const int& e, const int& p, const bool& mask) {
+          new_element(p) = e;
+          new_process(p) = comm_rank;
+          //Pick the moving particles and their destination with a hash of the slot
+          const unsigned int hash = (p * 2654435761u) ^ (step * 40503u);
+          if (mask && num_ranks > 1 && hash % 10000 < percentMoved * 100)
+            new_process(p) = ranks_d((hash >> 16) % num_ranks);
+        };
+        scs->parallel_for(setDestination, "setDestination");
+        Kokkos::Timer timer;
+        if (split[s]) {
+          scs->migrate_begin(new_element, new_process, dist);
+          scs->migrate_end();
+        }
+        else
+          scs->migrate(new_element, new_process, dist);
+        pumipic::RecordTime(names[s], timer.seconds());
+      }
+      delete scs;
+    }
+  }
+
+  cleanup_distribution_memory();
+  pumipic::SummarizeTime();
+  MPI_Finalize();
+  Kokkos::finalize();
+  return 0;
+}
+
+SCS* createSCS(int num_elems, int num_ptcls, kkLidView ppe, kkGidView elm_gids,
+               pumipic::MigrateStrategy strat, std::string name) {
+  Kokkos::TeamPolicy<ExeSpace> policy(4, 32);
+  pumipic::SCS_Input<PerfTypes> input(policy, 1024, 1024, num_elems, num_ptcls, ppe,
+                                      elm_gids);
+  input.name = name;
+  input.migrate_strat = strat;
+  return new SCS(input);
+}
@@ -406,7 +406,8 @@ bool search_mesh(o::Mesh& mesh, ps::ParticleStructure< ParticleType >* ptcls,
       } //if active particle
     };
 
-    ps::parallel_for(ptcls, lamb, "adj_search");
+    //lamb only acts on active particles so the padding is skipped
+    ps::parallel_for_active(ptcls, lamb, "adj_search");
 
     found = true;
     auto cp_elm_ids = OMEGA_H_LAMBDA( o::LO i) {
@@ -517,7 +518,7 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         lastEdge[pid] = edges[idx];
       }
     };
-    ps::parallel_for(ptcls, checkCurrentElm);
+    ps::parallel_for_active(ptcls, checkCurrentElm);
 
     auto checkExposedEdges = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
       if( mask > 0 && !ptcl_done[pid] ) {
@@ -530,7 +531,7 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         elem_ids[pid] = exposed ? -1 : elem_ids[pid]; //leaves domain if exposed
       }
     };
-    ps::parallel_for(ptcls, checkExposedEdges, "pumipic_checkExposedEdges");
+    ps::parallel_for_active(ptcls, checkExposedEdges, "pumipic_checkExposedEdges");
 
     auto e2f_vals = edges2faces.ab2b; // CSR value array
     auto e2f_offsets = edges2faces.a2ab; // CSR offset array, index by mesh edge ids
@@ -551,7 +552,7 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         elem_ids[pid] = nextElm;
       }
     };
-    ps::parallel_for(ptcls, setNextElm, "pumipic_setNextElm");
+    ps::parallel_for_active(ptcls, setNextElm, "pumipic_setNextElm");
 
     found = true;
     o::LOs ptcl_done_r(ptcl_done);
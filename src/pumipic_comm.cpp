@@ -13,6 +13,8 @@ namespace pumipic {
                        Omega_h::LOs ent_owners) {
     int rank = commptr->rank();
     int comm_size = commptr->size();
+    //The requests of reduceCommArray are bound to the previous neighbors
+    freeCommPlans(edim);
 
     int nents = picpart->nents(edim);
     Omega_h::Write<Omega_h::LO> ent_rank_lids(nents,0);
@@ -217,7 +219,129 @@ namespace pumipic {
     return y;
   }
 
+  //Copies between the device arrays and the host buffers of a communication plan
+  template <class T>
+  using HostBuffer = Kokkos::View<T*, Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged> >;
+  template <class T>
+  void copyToHost(Omega_h::Write<T> array, T* buffer) {
+    Kokkos::deep_copy(HostBuffer<T>(buffer, array.size()), array.view());
+  }
+  template <class T>
+  void copyToDevice(const T* buffer, Omega_h::Write<T> array) {
+    Kokkos::deep_copy(array.view(), HostBuffer<T>(const_cast<T*>(buffer), array.size()));
+  }
+
+  static void startAll(std::vector<MPI_Request>& requests) {
+    if (!requests.empty())
+      MPI_Startall(requests.size(), requests.data());
+  }
+  static void waitAll(std::vector<MPI_Request>& requests) {
+    if (!requests.empty())
+      MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  }
+  static void freeAll(std::vector<MPI_Request>& requests) {
+    for (std::size_t i = 0; i < requests.size(); ++i)
+      MPI_Request_free(&(requests[i]));
+    requests.clear();
+  }
+
+  Mesh::CommPlan& Mesh::commPlan(int edim, MPI_Datatype type, int type_size, int nvals) {
+    std::vector<CommPlan>& plans = comm_plans[edim];
+    for (std::size_t i = 0; i < plans.size(); ++i)
+      if (plans[i].type == type && plans[i].nvals == nvals)
+        return plans[i];
+    plans.push_back(CommPlan());
+    CommPlan& plan = plans.back();
+    plan.type = type;
+    plan.nvals = nvals;
+
+    MPI_Comm comm = commptr->get_impl();
+    const int self = commptr->rank();
+    const int entry_size = nvals * type_size;
+    Omega_h::HostRead<Omega_h::LO> ent_offsets(offset_ents_per_rank_per_dim[edim]);
+    const int my_num_entries = ent_offsets[self+1] - ent_offsets[self];
+
+    //Fan in receives the core region from the complete buffers and the boundaries from the
+    //  parts bounding this part
+    int neighbor_size = 0;
+    for (int i = 0; i < num_cores[edim]; ++i) {
+      int rank = buffered_parts[edim][i];
+      int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
+      if (num_entries > 0 && is_complete_part[edim][rank] == 2) {
+        plan.recv_ranks.push_back(rank);
+        plan.recv_tags.push_back(2);
+        plan.recv_offsets.push_back(neighbor_size);
+        neighbor_size += my_num_entries * entry_size;
+      }
+    }
+    for (Omega_h::LO i = 0; i < num_boundaries[edim]; ++i) {
+      int rank = boundary_parts[edim][i];
+      int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
+      plan.recv_ranks.push_back(rank);
+      plan.recv_tags.push_back(1);
+      plan.recv_offsets.push_back(neighbor_size);
+      neighbor_size += size * entry_size;
+    }
+    plan.array.resize(nents(edim) * entry_size);
+    plan.neighbor_values.resize(neighbor_size);
+    plan.boundary_values.resize(bounded_ent_ids[edim].size() * entry_size);
+
+    //The buffers are not resized after this so the requests always point to them
+    char* data = plan.array.data();
+    for (std::size_t i = 0; i < plan.recv_ranks.size(); ++i) {
+      const int rank = plan.recv_ranks[i];
+      const int size = plan.recv_tags[i] == 2 ? my_num_entries :
+        offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
+      plan.fan_in_recvs.push_back(MPI_REQUEST_NULL);
+      MPI_Recv_init(plan.neighbor_values.data() + plan.recv_offsets[i], size * nvals, type,
+                    rank, plan.recv_tags[i], comm, &(plan.fan_in_recvs.back()));
+    }
+    for (int i = 0; i < num_cores[edim]; ++i) {
+      int rank = buffered_parts[edim][i];
+      int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
+      if (num_entries > 0) {
+        //Fan in sends each core region to its owner
+        plan.fan_in_sends.push_back(MPI_REQUEST_NULL);
+        MPI_Send_init(data + ent_offsets[rank] * entry_size, num_entries * nvals, type, rank,
+                      is_complete_part[edim][rank], comm, &(plan.fan_in_sends.back()));
+        //Fan out sends the reduced core region to the complete buffers and receives the
+        //  reduced core regions of the buffered parts
+        if (is_complete_part[edim][rank] == 2) {
+          plan.fan_out_sends.push_back(MPI_REQUEST_NULL);
+          MPI_Send_init(data + ent_offsets[self] * entry_size, my_num_entries * nvals, type,
+                        rank, 3, comm, &(plan.fan_out_sends.back()));
+        }
+        plan.fan_out_recvs.push_back(MPI_REQUEST_NULL);
+        MPI_Recv_init(data + ent_offsets[rank] * entry_size, num_entries * nvals, type, rank, 3,
+                      comm, &(plan.fan_out_recvs.back()));
+      }
+    }
+    for (int i = 0; i < num_boundaries[edim]; ++i) {
+      int rank = boundary_parts[edim][i];
+      int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
+      int start = offset_bounded_per_dim[edim][rank] * entry_size;
+      plan.fan_out_sends.push_back(MPI_REQUEST_NULL);
+      MPI_Send_init(plan.boundary_values.data() + start, size * nvals, type, rank, 3, comm,
+                    &(plan.fan_out_sends.back()));
+    }
+    return plan;
+  }
+
+  void Mesh::freeCommPlans(int edim) {
+    int finalized;
+    MPI_Finalized(&finalized);
+    for (std::size_t i = 0; i < comm_plans[edim].size() && !finalized; ++i) {
+      CommPlan& plan = comm_plans[edim][i];
+      freeAll(plan.fan_in_sends);
+      freeAll(plan.fan_in_recvs);
+      freeAll(plan.fan_out_sends);
+      freeAll(plan.fan_out_recvs);
+    }
+    comm_plans[edim].clear();
+  }
+
   //Reductions are done by a bulk fan-in fan-out through the core region of each picpart
+  //  The messages are persistent requests of the plan of the dimension started each call
   template <class T>
   void Mesh::reduceCommArray(int edim, Op op, Omega_h::Write<T> comm_array) {
     int length = comm_array.size();
@@ -256,57 +380,34 @@ namespace pumipic {
     };
     Omega_h::parallel_for(ne, convertToComm, "convertToComm");
 
-    /***************** Fan In ******************/
-    //Move values to host
-    Omega_h::HostWrite<T> host_array(array);
-    T* data = host_array.data();
-
-    //Prepare sending and receiving data of cores to the owner of that region
+    CommPlan& plan = commPlan(edim, MpiTraits<T>::datatype(), sizeof(T), nvals);
+    T* data = reinterpret_cast<T*>(plan.array.data());
     Omega_h::HostRead<Omega_h::LO> ent_offsets(offset_ents_per_rank_per_dim[edim]);
+    const Omega_h::LO start_index = ent_offsets[commptr->rank()]*nvals;
     int my_num_entries = ent_offsets[commptr->rank()+1] - ent_offsets[commptr->rank()];
-    int num_recvs = num_cores[edim] - num_bounds[edim] + num_boundaries[edim];
-    int num_sends = num_cores[edim];
-    MPI_Request* send_requests = new MPI_Request[num_sends];
-    MPI_Request* recv_requests = new MPI_Request[num_recvs];
-    int index = 0;
+    Omega_h::LOs bounded_ent_ids_local = bounded_ent_ids[edim];
+
+    /***************** Fan In ******************/
     //Fan in is skipped for accept_op
     if (op != BCAST_OP) {
-      Omega_h::HostWrite<T>** neighbor_arrays = new Omega_h::HostWrite<T>*[num_recvs];
-      for (int i = 0; i < num_recvs; ++i)
-        neighbor_arrays[i] = new Omega_h::HostWrite<T>(my_num_entries*nvals);
-
-      for (int i = 0; i < num_cores[edim]; ++i) {
-        int rank = buffered_parts[edim][i];
-        int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
-        if (num_entries > 0) {
-          MPI_Isend(data + ent_offsets[rank]*nvals, num_entries*nvals, MpiTraits<T>::datatype(),
-                    rank, is_complete_part[edim][rank], commptr->get_impl(), send_requests + i);
-          if (is_complete_part[edim][rank] == 2) {
-            T* neighbor_data = neighbor_arrays[index]->data();
-            MPI_Irecv(neighbor_data, my_num_entries*nvals, MpiTraits<T>::datatype(), rank, 2,
-                      commptr->get_impl(), recv_requests + index++);
-          }
-        }
-      }
+      //Move values to the host and send the data of cores to the owner of that region
+      copyToHost(array, data);
+      startAll(plan.fan_in_recvs);
+      startAll(plan.fan_in_sends);
 
-      //Recv data from bounding parts
-      for (Omega_h::LO i = 0; i < num_boundaries[edim]; ++i) {
-        int rank = boundary_parts[edim][i];
-        T* neighbor_data = neighbor_arrays[index]->data();
-        int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
-        MPI_Irecv(neighbor_data, size*nvals, MpiTraits<T>::datatype(), rank, 1,
-                  commptr->get_impl(), recv_requests + index++);
-      }
       //Wait for recv completion
-      Omega_h::LOs bounded_ent_ids_local = bounded_ent_ids[edim];
+      int num_recvs = plan.fan_in_recvs.size();
       for (Omega_h::LO i = 0; i < num_recvs; ++i) {
         int finished_neighbor = -1;
-        MPI_Status status;
-        MPI_Waitany(num_recvs, recv_requests, &finished_neighbor, &status);
+        MPI_Waitany(num_recvs, plan.fan_in_recvs.data(), &finished_neighbor, MPI_STATUS_IGNORE);
         //When recv finishes copy data to the device and perform op
-        const Omega_h::LO start_index = ent_offsets[commptr->rank()]*nvals;
-        Omega_h::Write<T> recv_array(*(neighbor_arrays[finished_neighbor]));
-        if (status.MPI_TAG == 2) {
+        const int rank = plan.recv_ranks[finished_neighbor];
+        const T* neighbor_data =
+          reinterpret_cast<const T*>(plan.neighbor_values.data() +
+                                     plan.recv_offsets[finished_neighbor]);
+        if (plan.recv_tags[finished_neighbor] == 2) {
+          Omega_h::Write<T> recv_array(my_num_entries*nvals);
+          copyToDevice(neighbor_data, recv_array);
           if (op == SUM_OP) {
             auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
               Kokkos::atomic_fetch_add(&(array[start_index + i]),recv_array[i]);
@@ -331,9 +432,11 @@ namespace pumipic {
           }
         }
         else {
-          const int size = offset_bounded_per_dim[edim][finished_neighbor+1] -
-            offset_bounded_per_dim[edim][finished_neighbor];
-          const int start = offset_bounded_per_dim[edim][finished_neighbor];
+          const int size = offset_bounded_per_dim[edim][rank+1] -
+            offset_bounded_per_dim[edim][rank];
+          const int start = offset_bounded_per_dim[edim][rank];
+          Omega_h::Write<T> recv_array(size*nvals);
+          copyToDevice(neighbor_data, recv_array);
           if (op == SUM_OP) {
             auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
               int index = bounded_ent_ids_local[start+i];
@@ -369,66 +472,29 @@ namespace pumipic {
             Omega_h::parallel_for(size, reduce_op, "reduce_op");
           }
         }
-        delete neighbor_arrays[finished_neighbor];
       }
-      MPI_Waitall(num_sends, send_requests,MPI_STATUSES_IGNORE);
-      delete [] neighbor_arrays;
+      waitAll(plan.fan_in_sends);
     }
     /***************** Fan Out ******************/
-    //Flip the sizes of the request arrays
-    MPI_Request* temp = send_requests;
-    send_requests = recv_requests;
-    recv_requests = temp;
-    int tempi = num_sends;
-    num_sends = num_recvs;
-    num_recvs = tempi;
-    Omega_h::HostWrite<T> reduced_host_array(array);
-    data = reduced_host_array.data();
-    index = 0;
-    for (int i = 0; i < num_cores[edim]; ++i) {
-      int rank = buffered_parts[edim][i];
-      int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
-      if (num_entries > 0) {
-        if (is_complete_part[edim][rank]==2) {
-          MPI_Isend(data + ent_offsets[commptr->rank()]*nvals, my_num_entries*nvals,
-                    MpiTraits<T>::datatype(), rank, 3,
-                    commptr->get_impl(), send_requests + index++);
-        }
-        MPI_Irecv(data + ent_offsets[rank]*nvals, num_entries*nvals, MpiTraits<T>::datatype(),
-                  rank, 3, commptr->get_impl(), recv_requests + i);
-      }
-    }
+    //Receive the reduced core regions into the host copy of the reduced array
+    copyToHost(array, data);
+    startAll(plan.fan_out_recvs);
+
     //Gather the boundary data to send
-    Omega_h::LOs bounded_ent_ids_local = bounded_ent_ids[edim];
     Omega_h::Write<T> boundary_array(bounded_ent_ids_local.size()*nvals);
-    const Omega_h::LO start_index = ent_offsets[commptr->rank()]*nvals;
     auto gatherBoundaryData = OMEGA_H_LAMBDA(const Omega_h::LO id) {
       const Omega_h::LO index = bounded_ent_ids_local[id];
       for (int i = 0; i < nvals; ++i)
         boundary_array[id*nvals + i] = array[start_index + index*nvals + i];
     };
     Omega_h::parallel_for(bounded_ent_ids_local.size(),gatherBoundaryData, "gatherBoundaryData");
-
-    Omega_h::HostWrite<T> boundary_array_host(boundary_array);
-    T* sending_data = boundary_array_host.data();
-    for (int i = 0; i < num_boundaries[edim]; ++i) {
-      int rank = boundary_parts[edim][i];
-      int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
-      int start = offset_bounded_per_dim[edim][rank]*nvals;
-      MPI_Isend(sending_data+start, size*nvals, MpiTraits<T>::datatype(), rank, 3,
-                commptr->get_impl(), send_requests + index++);
-    }
-    MPI_Waitall(num_recvs, recv_requests,MPI_STATUSES_IGNORE);
-    MPI_Waitall(num_sends, send_requests,MPI_STATUSES_IGNORE);
-    delete [] send_requests;
-    delete [] recv_requests;
+    copyToHost(boundary_array, reinterpret_cast<T*>(plan.boundary_values.data()));
+    startAll(plan.fan_out_sends);
+    waitAll(plan.fan_out_recvs);
+    waitAll(plan.fan_out_sends);
 
     //Copy reduced array from host to device
-    Omega_h::Write<T> reduced_array(reduced_host_array);
-    auto setArrayValues = OMEGA_H_LAMBDA(Omega_h::LO i) {
-      array[i] = reduced_array[i];
-    };
-    Omega_h::parallel_for(array.size(), setArrayValues, "setArrayValues");
+    copyToDevice(data, array);
 
     auto convertFromComm = OMEGA_H_LAMBDA(const Omega_h::LO id) {
       const Omega_h::LO index = arr_index[id];
@@ -2,6 +2,8 @@
 #include "pumipic_lb.hpp"
 namespace pumipic {
   Mesh::~Mesh() {
+    for (int i = 0; i < 4; ++i)
+      freeCommPlans(i);
     if (!isFullMesh())
       delete picpart;
     if (ptcl_balancer)
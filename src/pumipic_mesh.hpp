@@ -1,4 +1,6 @@
 #pragma once
+#include <vector>
+#include <mpi.h>
 #include <Omega_h_mesh.hpp>
 #include "pumipic_library.hpp"
 #include "pumipic_input.hpp"
@@ -126,6 +128,26 @@ namespace pumipic {
     //The entities to send to each part for boundary
     Omega_h::LOs bounded_ent_ids[4];
 
+    /* Persistent requests and host buffers of reduceCommArray for one entity dimension,
+     * datatype and number of values per entity. The plans of a dimension are kept until
+     * setupComm changes its neighbors.
+     */
+    struct CommPlan {
+      MPI_Datatype type;
+      int nvals;
+      //Host copy of the comm array in bulk communication ordering
+      std::vector<char> array;
+      //Values received by the fan in and the boundary values sent by the fan out
+      std::vector<char> neighbor_values, boundary_values;
+      //Source rank, tag and byte offset into neighbor_values of each fan in receive
+      std::vector<int> recv_ranks, recv_tags, recv_offsets;
+      std::vector<MPI_Request> fan_in_sends, fan_in_recvs, fan_out_sends, fan_out_recvs;
+    };
+    std::vector<CommPlan> comm_plans[4];
+    //Returns the plan of dimension edim for the datatype, creating it on first use
+    CommPlan& commPlan(int edim, MPI_Datatype type, int type_size, int nvals);
+    void freeCommPlans(int edim);
+
     ParticleBalancer* ptcl_balancer = NULL;
   };
 }
@@ -4,6 +4,7 @@
 #include "SupportKK.h"
 #include <unordered_map>
 #include <mpi.h>
+#include <type_traits>
 namespace pumipic {
   /* Routines to be abstracted
      MPI_Allgather/NCCL
@@ -289,6 +290,45 @@ namespace pumipic {
   template <typename ViewT>
   int PS_Comm_Allreduce(ViewT send_view, ViewT recv_view, int count, MPI_Op op, MPI_Comm comm);
 
+  /*!
+    \brief Wrapper around MPI_Ineighbor_alltoallv for views
+
+    \tparam ViewT The type of view, supports Kokkos::View & pumipic::View
+
+    \param send_view The view with data on either the host or device to send
+
+    \param send_counts The number of entries to send to each neighbor (host array)
+
+    \param send_displs The index of the first entry sent to each neighbor (host array)
+
+    \param[out] recv_view The view in the same memory space as `send_view` to receive
+
+    \param recv_counts The number of entries to receive from each neighbor (host array)
+
+    \param recv_displs The index where the entries of each neighbor are received (host array)
+
+    \param comm The MPI communicator with a distributed graph topology
+
+    \param[out] request The MPI request to be filled after the MPI_Ineighbor_alltoallv completes
+
+    \return The error value returned by the call to MPI
+
+    \note The function call is equivalent to
+    MPI_Ineighbor_alltoallv(send_view.data(), send_counts, send_displs, send_datatype,
+                            recv_view.data(), recv_counts, recv_displs, recv_datatype, comm,
+                            request);
+    where the counts and displacements are in entries of the views
+
+    \note The counts and displacements must not change until the request completes and
+    PS_Comm_Wait/PS_Comm_Waitall must be used to finish receiving on the device.
+
+  */
+  template <typename ViewT>
+  int PS_Comm_Ineighbor_alltoallv(ViewT send_view, const int* send_counts,
+                                  const int* send_displs, ViewT recv_view,
+                                  const int* recv_counts, const int* recv_displs,
+                                  MPI_Comm comm, MPI_Request* request);
+
 #endif
 
   template <typename T> struct MpiType;
@@ -310,6 +350,43 @@ namespace pumipic {
   CREATE_MPITYPE(long long int, MPI_LONG_LONG_INT);
 #undef CREATE_MPI_TYPE
 
+  /* Datatype of one entry of a view
+     The components of array entries are contiguous for LayoutRight views and strided by the
+       extent of the view for LayoutLeft views, so the type depends on the view it describes
+  */
+  template <typename View> struct MpiEntryType {
+    typedef typename BaseType<typename View::data_type>::type Base;
+    static const int size = BaseType<typename View::data_type>::size;
+    static MPI_Datatype create(const View& view) {
+      MPI_Datatype type = MpiType<Base>::mpitype();
+      if (size == 1)
+        return type;
+      if (std::is_same<typename View::array_layout, Kokkos::LayoutLeft>::value) {
+        MPI_Datatype strided;
+        MPI_Type_vector(size, 1, view.stride(1), MpiType<Base>::mpitype(), &strided);
+        //Consecutive entries start one component apart
+        MPI_Type_create_resized(strided, 0, sizeof(Base), &type);
+        MPI_Type_free(&strided);
+      }
+      else
+        MPI_Type_contiguous(size, MpiType<Base>::mpitype(), &type);
+      MPI_Type_commit(&type);
+      return type;
+    }
+    static void destroy(MPI_Datatype& type) {
+      if (size > 1)
+        MPI_Type_free(&type);
+    }
+  };
+
+  //The Kokkos::View of a Kokkos::View or pumipic::View
+  template <typename T, typename... Props>
+  Kokkos::View<T, Props...> kokkosView(const Kokkos::View<T, Props...>& view) {return view;}
+  template <typename T, typename Space, typename Layout>
+  typename View<T, Space, Layout>::KView kokkosView(View<T, Space, Layout> view) {
+    return view.view();
+  }
+
   template <typename T> using BT = typename BaseType<T>::type;
   template <typename View> using ViewType = typename View::data_type;
   template <typename View> using ViewSpace = typename View::memory_space;
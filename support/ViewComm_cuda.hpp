@@ -220,4 +220,34 @@ IsCuda<ViewSpace<ViewT> > PS_Comm_Allreduce(ViewT send_view, ViewT recv_view, in
 }
 
 
+//ineighbor alltoallv
+template <typename ViewT>
+IsCuda<ViewSpace<ViewT> > PS_Comm_Ineighbor_alltoallv(ViewT send_view, const int* send_counts,
+                                                      const int* send_displs, ViewT recv_view,
+                                                      const int* recv_counts,
+                                                      const int* recv_displs, MPI_Comm comm,
+                                                      MPI_Request* request) {
+  MPI_Datatype send_type = MpiEntryType<ViewT>::create(send_view);
+  MPI_Datatype recv_type = MpiEntryType<ViewT>::create(recv_view);
+#ifdef PS_CUDA_AWARE_MPI
+  int ret = MPI_Ineighbor_alltoallv(send_view.data(), send_counts, send_displs, send_type,
+                                    recv_view.data(), recv_counts, recv_displs, recv_type, comm,
+                                    request);
+#else
+  typename ViewT::HostMirror send_host = deviceToHost(send_view);
+  //Entries that are not received keep their values
+  typename ViewT::HostMirror recv_host = deviceToHost(recv_view);
+  int ret = MPI_Ineighbor_alltoallv(send_host.data(), send_counts, send_displs, send_type,
+                                    recv_host.data(), recv_counts, recv_displs, recv_type, comm,
+                                    request);
+  get_map()[request] = [=]() {
+    (void)send_host;
+    deep_copy(recv_view, recv_host);
+  };
+#endif
+  MpiEntryType<ViewT>::destroy(send_type);
+  MpiEntryType<ViewT>::destroy(recv_type);
+  return ret;
+}
+
 #endif
@@ -2,38 +2,50 @@
 template <typename Space> using IsHost =
   typename std::enable_if<Kokkos::SpaceAccessibility<typename Space::memory_space,
                                                      Kokkos::HostSpace>::accessible, int>::type;
+//Entries of array types are sent whole for either layout of the view
 //Send
 template <typename ViewT>
 IsHost<ViewSpace<ViewT> > PS_Comm_Send(ViewT view, int offset, int size,
                                        int dest, int tag, MPI_Comm comm) {
-  int size_per_entry = BaseType<ViewType<ViewT> >::size;
-  return MPI_Send(view.data() + offset, size*size_per_entry,
-                  MpiType<BT<ViewType<ViewT> > >::mpitype(), dest, tag, comm);
+  auto kview = kokkosView(view);
+  MPI_Datatype type = MpiEntryType<decltype(kview)>::create(kview);
+  int ret = MPI_Send(kview.data() + offset * kview.stride(0), size, type, dest, tag, comm);
+  MpiEntryType<decltype(kview)>::destroy(type);
+  return ret;
 }
 //Recv
 template <typename ViewT>
 IsHost<ViewSpace<ViewT> > PS_Comm_Recv(ViewT view, int offset, int size,
                                        int sender, int tag, MPI_Comm comm) {
-  int size_per_entry = BaseType<ViewType<ViewT> >::size;
-  return MPI_Recv(view.data() + offset, size*size_per_entry, MpiType<BT<ViewType<ViewT> > >::mpitype(),
-                  sender, tag, comm, MPI_STATUS_IGNORE);
+  auto kview = kokkosView(view);
+  MPI_Datatype type = MpiEntryType<decltype(kview)>::create(kview);
+  int ret = MPI_Recv(kview.data() + offset * kview.stride(0), size, type, sender, tag, comm,
+                     MPI_STATUS_IGNORE);
+  MpiEntryType<decltype(kview)>::destroy(type);
+  return ret;
 }
 //Isend
 template <typename ViewT>
 IsHost<ViewSpace<ViewT> > PS_Comm_Isend(ViewT view, int offset, int size,
                                         int dest, int tag, MPI_Comm comm, MPI_Request* req) {
-  int size_per_entry = BaseType<ViewType<ViewT> >::size;
-  return MPI_Isend(view.data() + offset, size*size_per_entry, MpiType<BT<ViewType<ViewT> > >::mpitype(),
-                   dest, tag, comm, req);
+  auto kview = kokkosView(view);
+  //Freeing the datatype does not affect the pending send
+  MPI_Datatype type = MpiEntryType<decltype(kview)>::create(kview);
+  int ret = MPI_Isend(kview.data() + offset * kview.stride(0), size, type, dest, tag, comm,
+                      req);
+  MpiEntryType<decltype(kview)>::destroy(type);
+  return ret;
 }
 //Irecv
 template <typename ViewT>
 IsHost<ViewSpace<ViewT> > PS_Comm_Irecv(ViewT view, int offset, int size,
                                         int sender, int tag, MPI_Comm comm, MPI_Request* req) {
-  int size_per_entry = BaseType<ViewType<ViewT> >::size;
-  return MPI_Irecv(view.data() + offset, size*size_per_entry,
-                   MpiType<BT<ViewType<ViewT> > >::mpitype(),
-                   sender, tag, comm, req);
+  auto kview = kokkosView(view);
+  MPI_Datatype type = MpiEntryType<decltype(kview)>::create(kview);
+  int ret = MPI_Irecv(kview.data() + offset * kview.stride(0), size, type, sender, tag, comm,
+                      req);
+  MpiEntryType<decltype(kview)>::destroy(type);
+  return ret;
 }
 
 //Wait
@@ -83,3 +95,21 @@ IsHost<ViewSpace<ViewT> > PS_Comm_Allreduce(ViewT send_view, ViewT recv_view, in
   return MPI_Allreduce(send_view.data(), recv_view.data(), count,
                        MpiType<BT<ViewType<ViewT> > >::mpitype(), op, comm);
 }
+
+//ineighbor alltoallv
+template <typename ViewT>
+IsHost<ViewSpace<ViewT> > PS_Comm_Ineighbor_alltoallv(ViewT send_view, const int* send_counts,
+                                                      const int* send_displs, ViewT recv_view,
+                                                      const int* recv_counts,
+                                                      const int* recv_displs, MPI_Comm comm,
+                                                      MPI_Request* request) {
+  MPI_Datatype send_type = MpiEntryType<ViewT>::create(send_view);
+  MPI_Datatype recv_type = MpiEntryType<ViewT>::create(recv_view);
+  int ret = MPI_Ineighbor_alltoallv(send_view.data(), send_counts, send_displs, send_type,
+                                    recv_view.data(), recv_counts, recv_displs, recv_type, comm,
+                                    request);
+  //Freed datatypes stay valid for the pending operation
+  MpiEntryType<ViewT>::destroy(send_type);
+  MpiEntryType<ViewT>::destroy(recv_type);
+  return ret;
+}